@@ -0,0 +1,203 @@
+#ifndef ARENA_CPP
+#define ARENA_CPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <cstring>
+#include <algorithm>
+#include <cstdint>
+#include "text.cpp"
+
+// 文档的内存预算，0 表示不限制
+struct DocumentLimits
+{
+    size_t maxBytes = 0; // 字符串区域、源文本和节点的估计字节数之和
+    size_t maxNodes = 0; // 元素和文本节点个数
+};
+
+enum class BudgetStatus
+{
+    Ok,
+    NodeLimitExceeded,
+    ByteLimitExceeded,
+};
+
+// 文档的内存占用。bytes 是当前的估计值，peakBytes 还包括解析过程中的临时缓冲区
+struct DocumentUsage
+{
+    size_t bytes = 0;
+    size_t nodes = 0;
+    size_t peakBytes = 0;
+};
+
+// 字符串区域分配器：同一文档的属性值等字符串连续存放在大块内存中，
+// 块一旦分配就不再移动，因此返回的 string_view 在区域存活期间始终有效。
+// 区域同时负责文档的内存记账：字符串块、源文本和树构建器登记的节点都计入预算，
+// 超出预算后 budgetStatus() 不再是 Ok，解析器据此停止解析（已有的字符串仍然有效）。
+class StringArena
+{
+private:
+    static constexpr size_t BLOCK_SIZE = 64 * 1024;
+
+    std::vector<std::unique_ptr<char[]>> blocks;
+    char *current = nullptr;
+    size_t remaining = 0;
+    size_t allocated = 0;
+
+public:
+    StringArena() = default;
+    StringArena(const StringArena &) = delete;
+    StringArena &operator=(const StringArena &) = delete;
+
+    std::string_view store(std::string_view text)
+    {
+        if (text.empty())
+        {
+            return std::string_view();
+        }
+        // 超过块大小一半的字符串单独分配，避免浪费当前块的剩余空间
+        if (text.size() * 2 > BLOCK_SIZE)
+        {
+            blocks.push_back(std::unique_ptr<char[]>(new char[text.size()]));
+            allocated += text.size();
+            checkBytes();
+            std::memcpy(blocks.back().get(), text.data(), text.size());
+            return std::string_view(blocks.back().get(), text.size());
+        }
+        if (text.size() > remaining)
+        {
+            blocks.push_back(std::unique_ptr<char[]>(new char[BLOCK_SIZE]));
+            allocated += BLOCK_SIZE;
+            checkBytes();
+            current = blocks.back().get();
+            remaining = BLOCK_SIZE;
+        }
+        char *destination = current;
+        std::memcpy(destination, text.data(), text.size());
+        current += text.size();
+        remaining -= text.size();
+        return std::string_view(destination, text.size());
+    }
+
+    // 已向系统申请的字节数
+    size_t bytesAllocated() const
+    {
+        return allocated;
+    }
+
+    void setLimits(const DocumentLimits &documentLimits)
+    {
+        limits = documentLimits;
+        checkBytes();
+    }
+
+    const DocumentLimits &getLimits() const
+    {
+        return limits;
+    }
+
+    // 计入文档的估计总字节数
+    size_t bytesUsed() const
+    {
+        return allocated + sourceText.size() + nodeBytes;
+    }
+
+    // 距离字节预算还能使用的字节数；不限制时为 SIZE_MAX
+    size_t remainingBytes() const
+    {
+        if (limits.maxBytes == 0)
+        {
+            return SIZE_MAX;
+        }
+        size_t used = bytesUsed();
+        return used < limits.maxBytes ? limits.maxBytes - used : 0;
+    }
+
+    // 登记一个节点（bytes 是它的估计大小）；超出节点预算时不登记并返回 false
+    bool chargeNode(size_t bytes)
+    {
+        if (limits.maxNodes != 0 && nodeCount >= limits.maxNodes)
+        {
+            exceed(BudgetStatus::NodeLimitExceeded);
+            return false;
+        }
+        ++nodeCount;
+        nodeBytes += bytes;
+        checkBytes();
+        return true;
+    }
+
+    // 记录峰值：当前占用加上调用者持有的临时缓冲区
+    void notePeak(size_t transientBytes)
+    {
+        peakBytes = std::max(peakBytes, bytesUsed() + transientBytes);
+    }
+
+    // 直接标记超出预算（如源文本被截断）
+    void exceed(BudgetStatus reason)
+    {
+        if (status == BudgetStatus::Ok)
+        {
+            status = reason;
+        }
+    }
+
+    BudgetStatus budgetStatus() const
+    {
+        return status;
+    }
+
+    DocumentUsage usage() const
+    {
+        DocumentUsage result;
+        result.bytes = bytesUsed();
+        result.nodes = nodeCount;
+        result.peakBytes = std::max(peakBytes, result.bytes);
+        return result;
+    }
+
+    // 解析器保留的文档源文本（已解码为 UTF-8），元素的 outerHTMLView 指向其中。
+    // 再次向同一文档解析输入会追加源文本，之前取得的视图随之失效。
+    void appendSource(std::string_view text)
+    {
+        sourceText.append(text.data(), text.size());
+        checkBytes();
+    }
+
+    std::string_view source() const
+    {
+        return sourceText;
+    }
+
+    // 解析器按文档顺序登记的文本节点
+    TextTable &texts()
+    {
+        return textTable;
+    }
+
+    const TextTable &texts() const
+    {
+        return textTable;
+    }
+
+private:
+    std::string sourceText;
+    TextTable textTable;
+    DocumentLimits limits;
+    BudgetStatus status = BudgetStatus::Ok;
+    size_t nodeCount = 0;
+    size_t nodeBytes = 0;
+    size_t peakBytes = 0;
+
+    void checkBytes()
+    {
+        if (limits.maxBytes != 0 && bytesUsed() > limits.maxBytes)
+        {
+            exceed(BudgetStatus::ByteLimitExceeded);
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,280 @@
+#ifndef ATTRIBUTESELECTOR_CPP
+#define ATTRIBUTESELECTOR_CPP
+
+#include <string>
+#include <algorithm>
+#include <string_view>
+#include <unordered_map>
+#include <cstring>
+#include <cctype>
+#include <stdexcept>
+#include "element.cpp"
+
+enum class AttributeOperator
+{
+    Exists,    // [attr]
+    Equals,    // [attr=value]
+    Includes,  // [attr~=value] 空白分隔的某一项等于 value
+    DashMatch, // [attr|=value] 等于 value 或以 "value-" 开头
+    Prefix,    // [attr^=value]
+    Suffix,    // [attr$=value]
+    Substring, // [attr*=value]
+};
+
+// 编译后的属性选择器：属性名已驻留为编号，比较值预先处理好（i 标志时转为小写），
+// 匹配时只读取一个属性，前后缀用 memcmp，子串用 memchr 定位首字符后再比较。
+struct AttributeSelector
+{
+    uint32_t nameId = 0;
+    AttributeOperator op = AttributeOperator::Exists;
+    std::string value;
+    bool caseInsensitive = false;
+
+    static char lower(char ch)
+    {
+        return static_cast<char>(std::tolower(static_cast<unsigned char>(ch)));
+    }
+
+    bool equalsAt(std::string_view text, size_t pos) const
+    {
+        if (!caseInsensitive)
+        {
+            return std::memcmp(text.data() + pos, value.data(), value.size()) == 0;
+        }
+        for (size_t i = 0; i < value.size(); ++i)
+        {
+            if (lower(text[pos + i]) != value[i])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool equalsWhole(std::string_view text) const
+    {
+        return text.size() == value.size() && equalsAt(text, 0);
+    }
+
+    bool containsSubstring(std::string_view text) const
+    {
+        if (value.size() > text.size())
+        {
+            return false;
+        }
+        size_t last = text.size() - value.size();
+        if (!caseInsensitive)
+        {
+            // memchr 在 libc 中是向量化实现，用它跳到首字符的候选位置
+            const char *begin = text.data();
+            const char *cursor = begin;
+            while (cursor <= begin + last)
+            {
+                const void *found = std::memchr(cursor, value[0], static_cast<size_t>(begin + last - cursor + 1));
+                if (!found)
+                {
+                    return false;
+                }
+                cursor = static_cast<const char *>(found);
+                if (std::memcmp(cursor, value.data(), value.size()) == 0)
+                {
+                    return true;
+                }
+                ++cursor;
+            }
+            return false;
+        }
+        for (size_t pos = 0; pos <= last; ++pos)
+        {
+            if (equalsAt(text, pos))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool matchesValue(std::string_view text) const
+    {
+        // 空值的 ~= ^= $= *= 按规范永远不匹配
+        if (value.empty() && op != AttributeOperator::Exists && op != AttributeOperator::Equals &&
+            op != AttributeOperator::DashMatch)
+        {
+            return false;
+        }
+        switch (op)
+        {
+        case AttributeOperator::Exists:
+            return true;
+        case AttributeOperator::Equals:
+            return equalsWhole(text);
+        case AttributeOperator::Includes:
+        {
+            size_t pos = 0;
+            while (pos < text.size())
+            {
+                while (pos < text.size() && std::isspace(static_cast<unsigned char>(text[pos])))
+                {
+                    ++pos;
+                }
+                size_t start = pos;
+                while (pos < text.size() && !std::isspace(static_cast<unsigned char>(text[pos])))
+                {
+                    ++pos;
+                }
+                if (pos > start && equalsWhole(text.substr(start, pos - start)))
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+        case AttributeOperator::DashMatch:
+            return equalsWhole(text) ||
+                   (text.size() > value.size() && text[value.size()] == '-' && equalsAt(text, 0));
+        case AttributeOperator::Prefix:
+            return text.size() >= value.size() && equalsAt(text, 0);
+        case AttributeOperator::Suffix:
+            return text.size() >= value.size() && equalsAt(text, text.size() - value.size());
+        case AttributeOperator::Substring:
+            return containsSubstring(text);
+        }
+        return false;
+    }
+
+    bool matches(const Element *element) const
+    {
+        const Attribute *attribute = element->getAttribute(nameId);
+        return attribute && matchesValue(attribute->value());
+    }
+
+    // 解析 [name]、[name op value]、[name op "value" i] 形式的文本
+    static AttributeSelector parse(std::string_view text)
+    {
+        if (text.size() < 3 || text.front() != '[' || text.back() != ']')
+        {
+            throw std::invalid_argument("属性选择器格式错误: " + std::string(text));
+        }
+        text = text.substr(1, text.size() - 2);
+        size_t pos = 0;
+        auto skipSpaces = [&]()
+        {
+            while (pos < text.size() && std::isspace(static_cast<unsigned char>(text[pos])))
+            {
+                ++pos;
+            }
+        };
+
+        AttributeSelector selector;
+        skipSpaces();
+        size_t nameStart = pos;
+        while (pos < text.size() && !std::isspace(static_cast<unsigned char>(text[pos])) &&
+               !std::strchr("=~|^$*", text[pos]))
+        {
+            ++pos;
+        }
+        if (pos == nameStart)
+        {
+            throw std::invalid_argument("属性选择器缺少属性名");
+        }
+        // 解析器把属性名转为小写，HTML 文档中属性名的匹配不区分大小写
+        std::string name(text.substr(nameStart, pos - nameStart));
+        std::transform(name.begin(), name.end(), name.begin(), lower);
+        selector.nameId = AttributeNames::intern(name);
+        skipSpaces();
+        if (pos == text.size())
+        {
+            return selector;
+        }
+
+        if (text[pos] == '=')
+        {
+            selector.op = AttributeOperator::Equals;
+            ++pos;
+        }
+        else if (pos + 1 < text.size() && text[pos + 1] == '=')
+        {
+            switch (text[pos])
+            {
+            case '~':
+                selector.op = AttributeOperator::Includes;
+                break;
+            case '|':
+                selector.op = AttributeOperator::DashMatch;
+                break;
+            case '^':
+                selector.op = AttributeOperator::Prefix;
+                break;
+            case '$':
+                selector.op = AttributeOperator::Suffix;
+                break;
+            case '*':
+                selector.op = AttributeOperator::Substring;
+                break;
+            default:
+                throw std::invalid_argument("未知的属性选择器运算符");
+            }
+            pos += 2;
+        }
+        else
+        {
+            throw std::invalid_argument("未知的属性选择器运算符");
+        }
+
+        skipSpaces();
+        if (pos < text.size() && (text[pos] == '"' || text[pos] == '\''))
+        {
+            char quote = text[pos++];
+            size_t end = text.find(quote, pos);
+            if (end == std::string_view::npos)
+            {
+                throw std::invalid_argument("属性选择器引号不匹配");
+            }
+            selector.value = std::string(text.substr(pos, end - pos));
+            pos = end + 1;
+        }
+        else
+        {
+            size_t start = pos;
+            while (pos < text.size() && !std::isspace(static_cast<unsigned char>(text[pos])))
+            {
+                ++pos;
+            }
+            selector.value = std::string(text.substr(start, pos - start));
+        }
+
+        skipSpaces();
+        if (pos < text.size())
+        {
+            char flag = lower(text[pos++]);
+            skipSpaces();
+            if ((flag != 'i' && flag != 's') || pos != text.size())
+            {
+                throw std::invalid_argument("属性选择器标志错误");
+            }
+            selector.caseInsensitive = flag == 'i';
+        }
+        if (selector.caseInsensitive)
+        {
+            for (char &ch : selector.value)
+            {
+                ch = lower(ch);
+            }
+        }
+        return selector;
+    }
+
+    // 每个线程缓存已编译的属性选择器，同一文本只解析一次
+    static const AttributeSelector &get(const std::string &text)
+    {
+        thread_local std::unordered_map<std::string, AttributeSelector> cache;
+        auto it = cache.find(text);
+        if (it == cache.end())
+        {
+            it = cache.emplace(text, parse(text)).first;
+        }
+        return it->second;
+    }
+};
+
+#endif
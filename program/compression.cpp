@@ -0,0 +1,238 @@
+#ifndef COMPRESSION_CPP
+#define COMPRESSION_CPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <fstream>
+#include <stdexcept>
+#include <cstring>
+#include <cstdint>
+// 使用系统的 zlib 与 libzstd，链接时分别需要 -lz、-lzstd；缺少头文件时对应格式不可用
+#if __has_include(<zlib.h>)
+#include <zlib.h>
+#define COMPRESSION_HAS_ZLIB 1
+#endif
+#if __has_include(<zstd.h>)
+#include <zstd.h>
+#define COMPRESSION_HAS_ZSTD 1
+#endif
+
+enum class Compression
+{
+    None,
+    Gzip, // 也接受 zlib 格式和多个成员首尾相接的 gzip 文件
+    Zstd,
+};
+
+// 按开头的魔数判断压缩格式
+inline Compression detectCompression(std::string_view head)
+{
+    if (head.size() >= 2 && static_cast<unsigned char>(head[0]) == 0x1F && static_cast<unsigned char>(head[1]) == 0x8B)
+    {
+        return Compression::Gzip;
+    }
+    if (head.size() >= 4 && std::memcmp(head.data(), "\x28\xB5\x2F\xFD", 4) == 0)
+    {
+        return Compression::Zstd;
+    }
+    return Compression::None;
+}
+
+// 流式解压器：压缩数据分块传入，解压结果按不超过 CHUNK_SIZE 的块交给 sink，
+// 内存占用只有一个输出块和解压库自身的窗口，与文件大小无关。数据损坏或被截断时抛出 std::runtime_error。
+class Decompressor
+{
+public:
+    using Sink = std::function<void(const char *, size_t)>;
+    static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+private:
+    Compression format;
+    std::vector<char> output;
+    bool ended = false; // 最近一个压缩帧（gzip 成员）已完整结束
+#ifdef COMPRESSION_HAS_ZLIB
+    z_stream zlibStream{};
+#endif
+#ifdef COMPRESSION_HAS_ZSTD
+    ZSTD_DStream *zstdStream = nullptr;
+#endif
+
+    void inflateChunk(const char *data, size_t length, const Sink &sink)
+    {
+#ifdef COMPRESSION_HAS_ZLIB
+        if (ended && length > 0)
+        {
+            inflateReset(&zlibStream);
+            ended = false;
+        }
+        zlibStream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+        zlibStream.avail_in = static_cast<uInt>(length);
+        do
+        {
+            zlibStream.next_out = reinterpret_cast<Bytef *>(output.data());
+            zlibStream.avail_out = static_cast<uInt>(output.size());
+            int result = inflate(&zlibStream, Z_NO_FLUSH);
+            if (result != Z_OK && result != Z_STREAM_END && result != Z_BUF_ERROR)
+            {
+                throw std::runtime_error("gzip 数据损坏");
+            }
+            size_t produced = output.size() - zlibStream.avail_out;
+            if (produced > 0)
+            {
+                sink(output.data(), produced);
+            }
+            if (result == Z_STREAM_END)
+            {
+                if (zlibStream.avail_in == 0)
+                {
+                    ended = true;
+                    break;
+                }
+                // 下一个 gzip 成员
+                inflateReset(&zlibStream);
+            }
+            else if (result == Z_BUF_ERROR)
+            {
+                break;
+            }
+        } while (zlibStream.avail_in > 0 || zlibStream.avail_out == 0);
+#else
+        (void)data, (void)length, (void)sink;
+        throw std::runtime_error("不支持 gzip：编译时没有 zlib");
+#endif
+    }
+
+    void zstdChunk(const char *data, size_t length, const Sink &sink)
+    {
+#ifdef COMPRESSION_HAS_ZSTD
+        ZSTD_inBuffer in{data, length, 0};
+        bool outputFull = true;
+        while (in.pos < in.size || outputFull)
+        {
+            ZSTD_outBuffer out{output.data(), output.size(), 0};
+            size_t hint = ZSTD_decompressStream(zstdStream, &out, &in);
+            if (ZSTD_isError(hint))
+            {
+                throw std::runtime_error(std::string("zstd 数据损坏: ") + ZSTD_getErrorName(hint));
+            }
+            if (out.pos > 0)
+            {
+                sink(output.data(), out.pos);
+            }
+            ended = hint == 0;
+            outputFull = out.pos == out.size;
+        }
+#else
+        (void)data, (void)length, (void)sink;
+        throw std::runtime_error("不支持 zstd：编译时没有 libzstd");
+#endif
+    }
+
+public:
+    explicit Decompressor(Compression compression) : format(compression), output(CHUNK_SIZE)
+    {
+#ifdef COMPRESSION_HAS_ZLIB
+        // 15 + 32：最大窗口，自动识别 gzip 与 zlib 头
+        if (format == Compression::Gzip && inflateInit2(&zlibStream, 15 + 32) != Z_OK)
+        {
+            throw std::runtime_error("无法初始化 zlib");
+        }
+#endif
+#ifdef COMPRESSION_HAS_ZSTD
+        if (format == Compression::Zstd)
+        {
+            zstdStream = ZSTD_createDStream();
+            if (!zstdStream || ZSTD_isError(ZSTD_initDStream(zstdStream)))
+            {
+                ZSTD_freeDStream(zstdStream);
+                throw std::runtime_error("无法初始化 zstd");
+            }
+        }
+#endif
+    }
+
+    Decompressor(const Decompressor &) = delete;
+    Decompressor &operator=(const Decompressor &) = delete;
+
+    ~Decompressor()
+    {
+#ifdef COMPRESSION_HAS_ZLIB
+        if (format == Compression::Gzip)
+        {
+            inflateEnd(&zlibStream);
+        }
+#endif
+#ifdef COMPRESSION_HAS_ZSTD
+        ZSTD_freeDStream(zstdStream);
+#endif
+    }
+
+    void decompress(const char *data, size_t length, const Sink &sink)
+    {
+        switch (format)
+        {
+        case Compression::Gzip:
+            inflateChunk(data, length, sink);
+            break;
+        case Compression::Zstd:
+            zstdChunk(data, length, sink);
+            break;
+        default:
+            sink(data, length);
+            break;
+        }
+    }
+
+    // 输入结束；压缩数据在帧中间被截断时抛出异常
+    void finish() const
+    {
+        if (format != Compression::None && !ended)
+        {
+            throw std::runtime_error("压缩数据不完整");
+        }
+    }
+};
+
+// 把内存中的数据（若已压缩则先解压）分块交给 sink
+inline void decompressTo(std::string_view data, const Decompressor::Sink &sink)
+{
+    Decompressor decompressor(detectCompression(data));
+    decompressor.decompress(data.data(), data.size(), sink);
+    decompressor.finish();
+}
+
+// 分块读取文件，按魔数识别 gzip/zstd 并边读边解压，解压结果分块交给 sink；
+// 不需要把整个文件或解压后的内容放进内存，也不需要临时文件
+inline void streamFile(const std::string &path, const Decompressor::Sink &sink)
+{
+    std::ifstream fileStream(path, std::ios::binary);
+    if (!fileStream.is_open())
+    {
+        throw std::runtime_error("无法打开文件");
+    }
+    std::vector<char> chunk(Decompressor::CHUNK_SIZE);
+    std::unique_ptr<Decompressor> decompressor;
+    while (fileStream)
+    {
+        fileStream.read(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+        size_t length = static_cast<size_t>(fileStream.gcount());
+        if (!decompressor)
+        {
+            decompressor = std::make_unique<Decompressor>(detectCompression(std::string_view(chunk.data(), length)));
+        }
+        if (length > 0)
+        {
+            decompressor->decompress(chunk.data(), length, sink);
+        }
+    }
+    if (fileStream.bad())
+    {
+        throw std::runtime_error("读取文件失败");
+    }
+    decompressor->finish();
+}
+
+#endif
@@ -0,0 +1,712 @@
+#ifndef DOCUMENT_CPP
+#define DOCUMENT_CPP
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <sstream>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include "element.cpp"
+#include "selectormatcher.cpp"
+#include "frozendocument.cpp"
+
+// 按先序编号比较，保证集合中的元素按文档顺序排列
+struct DocumentOrder
+{
+    bool operator()(const std::shared_ptr<Element> &a, const std::shared_ptr<Element> &b) const
+    {
+        return a->order < b->order;
+    }
+};
+
+// 文档对象：持有 DOM 树，维护先序编号、id/class/tag 索引和查询缓存。
+// 所有修改都应通过 appendChild/removeChild/setAttribute/setText 进行，
+// 这些接口只更新受影响的子树，而不是重新解析或重建整个索引。
+// subscribe 注册的选择器在每批修改结束后只重新检查受影响的节点，并回调新增和移除的匹配。
+// Document 不是线程安全的（查询也会更新缓存）；需要多线程并发查询时先调用 freeze()，
+// 之后在各线程中使用返回的 FrozenDocument。
+class Document
+{
+public:
+    using ElementSet = std::set<std::shared_ptr<Element>, DocumentOrder>;
+    using MatchCallback = std::function<void(const std::vector<std::shared_ptr<Element>> &added,
+                                             const std::vector<std::shared_ptr<Element>> &removed)>;
+
+private:
+    // 相邻元素编号之间的间隔，插入子树时在前后编号之间分配，间隔耗尽时整体重新编号
+    static constexpr uint64_t ORDER_GAP = 1u << 16;
+
+    struct CachedQuery
+    {
+        ElementSet results;
+        bool incremental; // 单个复合选择器可以逐节点增量维护，含组合符的选择器修改后直接失效
+    };
+
+    std::shared_ptr<Element> root;
+    std::unordered_map<std::string, ElementSet> idIndex;
+    std::unordered_map<std::string, ElementSet> classIndex;
+    std::unordered_map<std::string, ElementSet> tagIndex;
+    std::unordered_map<uint32_t, ElementSet> attributeIndex; // 按属性名编号索引含该属性的元素，用于属性选择器
+    std::map<std::string, CachedQuery> queryCache;
+    std::shared_ptr<const FrozenDocument> frozen; // freeze() 之后非空，修改接口随之失效
+
+    // 一次修改记录：属性修改时 attribute 非空；子节点修改时 inserted 为新插入的元素（可为空）
+    struct PendingChange
+    {
+        std::shared_ptr<Element> target;
+        std::string attribute;
+        std::shared_ptr<Element> inserted;
+    };
+
+    struct Subscription
+    {
+        CompiledSelector selector;
+        MatchCallback callback;
+        std::set<std::shared_ptr<Element>> matches; // 按指针排序，节点移动重新编号时集合仍然有效
+    };
+
+    std::map<int, Subscription> subscriptions;
+    int nextSubscriptionId = 1;
+    int batchDepth = 0;
+    std::vector<PendingChange> pendingChanges;
+    std::vector<std::shared_ptr<Element>> pendingRemoved;
+
+    static std::vector<std::string> splitClasses(std::string_view value)
+    {
+        std::vector<std::string> classes;
+        std::istringstream classStream{std::string(value)};
+        std::string className;
+        while (classStream >> className)
+        {
+            classes.push_back(className);
+        }
+        return classes;
+    }
+
+    // 先序收集子树中的所有元素（包括 element 本身）
+    static void collectElements(Element *element, std::vector<std::shared_ptr<Element>> &out)
+    {
+        out.push_back(element->shared_from_this());
+        for (Element *child = element->firstElementChild; child; child = child->nextElementSibling)
+        {
+            collectElements(child, out);
+        }
+    }
+
+    static void collectElements(const std::shared_ptr<Element> &element, std::vector<std::shared_ptr<Element>> &out)
+    {
+        collectElements(element.get(), out);
+    }
+
+    void indexAttribute(const std::shared_ptr<Element> &element, uint32_t nameId, std::string_view value)
+    {
+        if (nameId == AttributeNames::Id && !value.empty())
+        {
+            idIndex[std::string(value)].insert(element);
+        }
+        else if (nameId == AttributeNames::Class)
+        {
+            for (const auto &className : splitClasses(value))
+            {
+                classIndex[className].insert(element);
+            }
+        }
+    }
+
+    template <typename Index, typename Key>
+    static void eraseFromIndex(Index &index, const Key &key, const std::shared_ptr<Element> &element)
+    {
+        auto it = index.find(key);
+        if (it == index.end())
+        {
+            return;
+        }
+        it->second.erase(element);
+        if (it->second.empty())
+        {
+            index.erase(it);
+        }
+    }
+
+    void unindexAttribute(const std::shared_ptr<Element> &element, uint32_t nameId, std::string_view value)
+    {
+        if (nameId == AttributeNames::Id)
+        {
+            eraseFromIndex(idIndex, std::string(value), element);
+        }
+        else if (nameId == AttributeNames::Class)
+        {
+            for (const auto &className : splitClasses(value))
+            {
+                eraseFromIndex(classIndex, className, element);
+            }
+        }
+    }
+
+    // 索引必须在元素编号确定之后插入，移除必须在编号改变之前进行
+    void indexElement(const std::shared_ptr<Element> &element)
+    {
+        tagIndex[element->tagName].insert(element);
+        indexAttribute(element, AttributeNames::Id, element->id);
+        indexAttribute(element, AttributeNames::Class, element->className);
+        for (const auto &attribute : element->attributes)
+        {
+            attributeIndex[attribute.nameId].insert(element);
+        }
+    }
+
+    void unindexElement(const std::shared_ptr<Element> &element)
+    {
+        eraseFromIndex(tagIndex, element->tagName, element);
+        unindexAttribute(element, AttributeNames::Id, element->id);
+        unindexAttribute(element, AttributeNames::Class, element->className);
+        for (const auto &attribute : element->attributes)
+        {
+            eraseFromIndex(attributeIndex, attribute.nameId, element);
+        }
+    }
+
+    // 根据最右侧复合选择器中最有选择性的原子，从索引中取出候选元素；无法使用索引时返回空指针
+    const ElementSet *seedCandidates(const std::string &compound) const
+    {
+        static const ElementSet empty;
+        size_t colonPos = findOutsideBrackets(compound, ':');
+        auto atoms = splitCompound(compound.substr(0, colonPos));
+
+        auto lookup = [&](const auto &index, const auto &key) -> const ElementSet *
+        {
+            auto it = index.find(key);
+            return it == index.end() ? &empty : &it->second;
+        };
+        for (const auto &atom : atoms)
+        {
+            if (atom[0] == '#')
+            {
+                return lookup(idIndex, atom.substr(1));
+            }
+        }
+        for (const auto &atom : atoms)
+        {
+            if (atom[0] == '[')
+            {
+                return lookup(attributeIndex, AttributeSelector::get(atom).nameId);
+            }
+        }
+        for (const auto &atom : atoms)
+        {
+            if (atom[0] == '.')
+            {
+                return lookup(classIndex, atom.substr(1));
+            }
+        }
+        for (const auto &atom : atoms)
+        {
+            if (atom != "*")
+            {
+                return lookup(tagIndex, atom);
+            }
+        }
+        return nullptr;
+    }
+
+    // 子树中最后一个（先序最大）元素
+    static Element *lastDescendant(Element *element)
+    {
+        while (element->lastElementChild)
+        {
+            element = element->lastElementChild;
+        }
+        return element;
+    }
+
+    // 先序遍历中紧跟在 element 子树之后的元素，不存在时返回空
+    static Element *nextAfterSubtree(const Element *element)
+    {
+        for (; element; element = element->parentElement)
+        {
+            if (element->nextElementSibling)
+            {
+                return element->nextElementSibling;
+            }
+        }
+        return nullptr;
+    }
+
+    // 对整棵树重新编号，仅在插入位置的间隔耗尽时调用；相对顺序不变，因此索引和缓存中的集合仍然有序
+    void renumber()
+    {
+        std::vector<std::shared_ptr<Element>> elements;
+        collectElements(root, elements);
+        uint64_t next = 0;
+        for (const auto &element : elements)
+        {
+            element->order = next;
+            next += ORDER_GAP;
+        }
+    }
+
+    // 为新插入的子树分配 (lo, hi) 区间内的编号
+    void numberInsertedSubtree(const std::shared_ptr<Element> &subtree)
+    {
+        std::vector<std::shared_ptr<Element>> elements;
+        collectElements(subtree, elements);
+
+        // 新子树已经是 parent 的最后一个子元素，它前面的元素是 parent 原来的最后一个后代
+        const Element *prev = subtree->previousElementSibling ? lastDescendant(subtree->previousElementSibling)
+                                                              : subtree->parentElement;
+        const Element *next = nextAfterSubtree(subtree.get());
+        uint64_t lo = prev->order;
+        uint64_t hi = next ? next->order : lo + ORDER_GAP * (elements.size() + 1);
+
+        uint64_t step = (hi - lo) / (elements.size() + 1);
+        if (step == 0)
+        {
+            // 先临时编号在末尾，重新编号时再统一整理
+            for (const auto &element : elements)
+            {
+                element->order = hi;
+            }
+            renumber();
+            return;
+        }
+        uint64_t current = lo;
+        for (const auto &element : elements)
+        {
+            current += step;
+            element->order = current;
+        }
+    }
+
+    // 元素状态变化后更新缓存：增量缓存逐个重新检查受影响的元素，其他缓存直接丢弃
+    void refreshCache(const std::vector<std::shared_ptr<Element>> &changed, const std::vector<std::shared_ptr<Element>> &removed)
+    {
+        // 修改可能发生在订阅回调中，外层 flushChanges 的 :has() 备忘录已经过期
+        invalidateHasMemo();
+        for (auto it = queryCache.begin(); it != queryCache.end();)
+        {
+            if (!it->second.incremental)
+            {
+                it = queryCache.erase(it);
+                continue;
+            }
+            auto &results = it->second.results;
+            for (const auto &element : removed)
+            {
+                results.erase(element);
+            }
+            for (const auto &element : changed)
+            {
+                if (element != root && MatchSelector(element, it->first))
+                {
+                    results.insert(element);
+                }
+                else
+                {
+                    results.erase(element);
+                }
+            }
+            ++it;
+        }
+    }
+
+    bool isConnected(const std::shared_ptr<Element> &element) const
+    {
+        const Element *current = element.get();
+        while (current && current != root.get())
+        {
+            current = current->parentElement;
+        }
+        return current == root.get();
+    }
+
+    static void sortByOrder(std::vector<std::shared_ptr<Element>> &elements)
+    {
+        std::sort(elements.begin(), elements.end(), DocumentOrder());
+    }
+
+    // 根据选择器的依赖关系计算一次修改后需要重新检查的元素
+    void collectDirty(const Subscription &subscription, const PendingChange &change,
+                      std::set<std::shared_ptr<Element>> &dirty) const
+    {
+        const auto &selector = subscription.selector;
+        if (!isConnected(change.target))
+        {
+            return;
+        }
+        if (!change.attribute.empty() && !selector.attributes.count(change.attribute))
+        {
+            return;
+        }
+
+        std::vector<std::shared_ptr<Element>> scope;
+        if (selector.dependsOnSiblings)
+        {
+            // 兄弟组合符下，一个元素的变化会影响其后所有兄弟及其后代
+            Element *parent = change.attribute.empty() ? change.target.get() : change.target->parentElement;
+            collectElements(parent ? parent : change.target.get(), scope);
+        }
+        else if (selector.dependsOnAncestors && !change.attribute.empty())
+        {
+            collectElements(change.target, scope);
+        }
+        else
+        {
+            scope.push_back(change.target);
+            if (change.inserted && isConnected(change.inserted))
+            {
+                collectElements(change.inserted, scope);
+            }
+        }
+        if (selector.dependsOnDescendants)
+        {
+            // :has() 的结果随后代变化，祖先都要重新检查
+            for (Element *ancestor = change.target->parentElement; ancestor; ancestor = ancestor->parentElement)
+            {
+                scope.push_back(ancestor->shared_from_this());
+            }
+        }
+        dirty.insert(scope.begin(), scope.end());
+    }
+
+    void flushChanges()
+    {
+        HasMemoScope hasMemo;
+        auto changes = std::move(pendingChanges);
+        auto removedElements = std::move(pendingRemoved);
+        pendingChanges.clear();
+        pendingRemoved.clear();
+
+        for (auto &[id, subscription] : subscriptions)
+        {
+            std::vector<std::shared_ptr<Element>> added, removed;
+            for (const auto &element : removedElements)
+            {
+                if (!isConnected(element) && subscription.matches.erase(element))
+                {
+                    removed.push_back(element);
+                }
+            }
+
+            std::set<std::shared_ptr<Element>> dirty;
+            for (const auto &change : changes)
+            {
+                collectDirty(subscription, change, dirty);
+            }
+            for (const auto &element : dirty)
+            {
+                if (element == root)
+                {
+                    continue;
+                }
+                bool matched = matchesSelector(element, subscription.selector);
+                bool wasMatched = subscription.matches.count(element) > 0;
+                if (matched && !wasMatched)
+                {
+                    subscription.matches.insert(element);
+                    added.push_back(element);
+                }
+                else if (!matched && wasMatched)
+                {
+                    subscription.matches.erase(element);
+                    removed.push_back(element);
+                }
+            }
+
+            if (!added.empty() || !removed.empty())
+            {
+                sortByOrder(added);
+                subscription.callback(added, removed);
+            }
+        }
+    }
+
+    void recordChange(PendingChange change, const std::vector<std::shared_ptr<Element>> &removed)
+    {
+        if (subscriptions.empty())
+        {
+            return;
+        }
+        pendingChanges.push_back(std::move(change));
+        pendingRemoved.insert(pendingRemoved.end(), removed.begin(), removed.end());
+        if (batchDepth == 0)
+        {
+            flushChanges();
+        }
+    }
+
+    void checkOwned(const std::shared_ptr<Element> &element) const
+    {
+        if (frozen)
+        {
+            throw std::logic_error("文档已冻结，不能再修改");
+        }
+        if (!element)
+        {
+            throw std::invalid_argument("空节点");
+        }
+        if (!isConnected(element))
+        {
+            throw std::invalid_argument("节点不属于该文档");
+        }
+    }
+
+public:
+    Document(const std::shared_ptr<Element> &rootElement) : root(rootElement)
+    {
+        renumber();
+        std::vector<std::shared_ptr<Element>> elements;
+        collectElements(root, elements);
+        for (const auto &element : elements)
+        {
+            indexElement(element);
+        }
+    }
+
+    const std::shared_ptr<Element> &getRoot() const
+    {
+        return root;
+    }
+
+    // 冻结文档并返回可被多个线程同时查询的只读视图；之后所有修改接口都会抛出 std::logic_error。
+    // 重复调用返回同一个视图
+    std::shared_ptr<const FrozenDocument> freeze()
+    {
+        if (!frozen)
+        {
+            frozen = std::shared_ptr<const FrozenDocument>(new FrozenDocument(root));
+        }
+        return frozen;
+    }
+
+    // 将 child 追加为 parent 的最后一个子节点；child 已在树中时先将其移除
+    void appendChild(const std::shared_ptr<Element> &parent, const std::shared_ptr<Node> &child)
+    {
+        checkOwned(parent);
+        if (!child)
+        {
+            throw std::invalid_argument("空节点");
+        }
+
+        std::shared_ptr<Element> childElement;
+        if (child->nodeType == NodeType::Element)
+        {
+            childElement = std::static_pointer_cast<Element>(child);
+            for (const Element *ancestor = parent.get(); ancestor; ancestor = ancestor->parentElement)
+            {
+                if (ancestor == childElement.get())
+                {
+                    throw std::invalid_argument("不能将节点插入到自己的子树中");
+                }
+            }
+            if (auto oldParent = childElement->parent.lock())
+            {
+                removeChild(oldParent, child);
+            }
+        }
+
+        parent->appendChild(child);
+        std::vector<std::shared_ptr<Element>> changed;
+        if (childElement)
+        {
+            numberInsertedSubtree(childElement);
+            collectElements(childElement, changed);
+            for (const auto &element : changed)
+            {
+                indexElement(element);
+            }
+        }
+        // :empty、:first-letter 等依赖子节点的伪类需要重新检查父元素
+        changed.push_back(parent);
+        refreshCache(changed, {});
+        recordChange({parent, "", childElement}, {});
+    }
+
+    // 从 parent 中移除 child 及其整棵子树
+    void removeChild(const std::shared_ptr<Element> &parent, const std::shared_ptr<Node> &child)
+    {
+        checkOwned(parent);
+        if (std::find(parent->children.begin(), parent->children.end(), child) == parent->children.end())
+        {
+            throw std::invalid_argument("节点不是该元素的子节点");
+        }
+
+        std::vector<std::shared_ptr<Element>> removed;
+        if (child->nodeType == NodeType::Element)
+        {
+            auto childElement = std::static_pointer_cast<Element>(child);
+            collectElements(childElement, removed);
+            for (const auto &element : removed)
+            {
+                unindexElement(element);
+            }
+        }
+        parent->removeChild(child);
+        refreshCache({parent}, removed);
+        recordChange({parent, "", nullptr}, removed);
+    }
+
+    void setAttribute(const std::shared_ptr<Element> &element, const std::string &name, const std::string &value)
+    {
+        checkOwned(element);
+        uint32_t nameId = AttributeNames::intern(name);
+        if (const Attribute *old = element->getAttribute(nameId))
+        {
+            unindexAttribute(element, nameId, old->value());
+        }
+        element->setAttribute(name, value);
+        indexAttribute(element, nameId, value);
+        attributeIndex[nameId].insert(element);
+        refreshCache({element}, {});
+        recordChange({element, name, nullptr}, {});
+    }
+
+    // 用单个文本节点替换元素的全部子节点
+    void setText(const std::shared_ptr<Element> &element, const std::string &text)
+    {
+        checkOwned(element);
+        std::vector<std::shared_ptr<Element>> removed;
+        for (Element *child = element->firstElementChild; child; child = child->nextElementSibling)
+        {
+            collectElements(child, removed);
+        }
+        for (const auto &descendant : removed)
+        {
+            unindexElement(descendant);
+        }
+        element->clearChildren();
+        if (!text.empty())
+        {
+            element->appendChild(createTextElement(text));
+        }
+        refreshCache({element}, removed);
+        recordChange({element, "", nullptr}, removed);
+    }
+
+    std::vector<std::shared_ptr<Element>> getElementById(const std::string &id) const
+    {
+        auto it = idIndex.find(id);
+        if (it == idIndex.end())
+        {
+            return {};
+        }
+        return std::vector<std::shared_ptr<Element>>(it->second.begin(), it->second.end());
+    }
+
+    std::vector<std::shared_ptr<Element>> getElementsByClassName(const std::string &className) const
+    {
+        auto it = classIndex.find(className);
+        if (it == classIndex.end())
+        {
+            return {};
+        }
+        return std::vector<std::shared_ptr<Element>>(it->second.begin(), it->second.end());
+    }
+
+    std::vector<std::shared_ptr<Element>> getElementsByTagName(const std::string &tagName) const
+    {
+        auto it = tagIndex.find(tagName);
+        if (it == tagIndex.end())
+        {
+            return {};
+        }
+        return std::vector<std::shared_ptr<Element>>(it->second.begin(), it->second.end());
+    }
+
+    // 开始一批修改，直到对应的 endBatch 之前订阅回调都不会触发；可以嵌套
+    void beginBatch()
+    {
+        ++batchDepth;
+    }
+
+    void endBatch()
+    {
+        if (batchDepth > 0 && --batchDepth == 0)
+        {
+            flushChanges();
+        }
+    }
+
+    // 注册实时选择器，当前的匹配结果会立即以 added 回调一次；返回用于取消订阅的编号
+    int subscribe(const std::string &selector, MatchCallback callback)
+    {
+        HasMemoScope hasMemo;
+        Subscription subscription{compileSelector(selector), std::move(callback), {}};
+        std::vector<std::shared_ptr<Element>> elements, initial;
+        collectElements(root, elements);
+        for (const auto &element : elements)
+        {
+            if (element != root && matchesSelector(element, subscription.selector))
+            {
+                subscription.matches.insert(element);
+                initial.push_back(element);
+            }
+        }
+        if (!initial.empty())
+        {
+            subscription.callback(initial, {});
+        }
+        int id = nextSubscriptionId++;
+        subscriptions.emplace(id, std::move(subscription));
+        return id;
+    }
+
+    void unsubscribe(int id)
+    {
+        subscriptions.erase(id);
+    }
+
+    // 带缓存的查询，结果按文档顺序返回。候选元素尽量从 id/属性/class/tag 索引中取得，再从右向左验证
+    std::vector<std::shared_ptr<Element>> querySelectorAll(const std::string &selector)
+    {
+        auto it = queryCache.find(selector);
+        if (it == queryCache.end())
+        {
+            HasMemoScope hasMemo;
+            CompiledSelector compiled = compileSelector(selector);
+            CachedQuery entry;
+            std::vector<const ElementSet *> seeds;
+            for (const auto &parts : compiled.alternatives)
+            {
+                seeds.push_back(seedCandidates(parts.back().selector));
+            }
+            bool fullScan = std::find(seeds.begin(), seeds.end(), nullptr) != seeds.end();
+            if (fullScan)
+            {
+                std::vector<std::shared_ptr<Element>> elements;
+                collectElements(root, elements);
+                seeds.clear();
+                for (const auto &element : elements)
+                {
+                    if (element != root && matchesSelector(element, compiled))
+                    {
+                        entry.results.insert(element);
+                    }
+                }
+            }
+            // 与全量扫描一样不含根元素（根元素也在索引中）
+            for (const ElementSet *candidates : seeds)
+            {
+                for (const auto &element : *candidates)
+                {
+                    if (element != root && matchesSelector(element, compiled))
+                    {
+                        entry.results.insert(element);
+                    }
+                }
+            }
+            // :has()、:is(div a) 等参数中的关系依赖无法逐节点维护
+            entry.incremental = tokenize(selector).size() == 1 && !compiled.dependsOnAncestors &&
+                                !compiled.dependsOnSiblings && !compiled.dependsOnDescendants;
+            it = queryCache.emplace(selector, std::move(entry)).first;
+        }
+        return std::vector<std::shared_ptr<Element>>(it->second.results.begin(), it->second.results.end());
+    }
+};
+
+#endif
@@ -7,6 +7,16 @@
 #include <vector>
 #include <memory>
 #include <sstream>
+#include <cctype>
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
+#include <algorithm>
+#include "arena.cpp"
+#include "tags.cpp"
 
 enum class NodeType
 {
@@ -14,26 +24,204 @@ enum class NodeType
     Text = 3,
 };
 
+// 节点不含虚函数，按 nodeType 标签区分具体类型后用 static_cast 转换。
+// 节点总是通过 make_shared 创建，shared_ptr<Node> 会以正确的类型析构。
 struct Node
 {
     NodeType nodeType;
-    virtual ~Node() {}
-    virtual void print(int depth = 0) const = 0;
+    void print(int depth = 0) const;
+};
+
+// 属性名驻留表：每个属性名只保存一次，元素中只存编号。常用属性名的编号固定，可直接比较
+class AttributeNames
+{
+public:
+    enum : uint32_t
+    {
+        Id = 0,
+        Class,
+        Lang,
+        Href,
+        Src,
+        Name,
+        Title,
+    };
+
+    // 线程安全：已驻留的名字只需共享锁
+    static uint32_t intern(std::string_view name)
+    {
+        auto &table = instance();
+        {
+            std::shared_lock<std::shared_mutex> lock(table.mutex);
+            auto it = table.ids.find(name);
+            if (it != table.ids.end())
+            {
+                return it->second;
+            }
+        }
+        std::unique_lock<std::shared_mutex> lock(table.mutex);
+        return table.add(name);
+    }
+
+    static std::string_view name(uint32_t id)
+    {
+        auto &table = instance();
+        std::shared_lock<std::shared_mutex> lock(table.mutex);
+        return table.names[id];
+    }
+
+private:
+    struct Table
+    {
+        std::shared_mutex mutex;
+        std::deque<std::string> names; // deque 保证已有元素地址不变，ids 的键指向这里
+        std::unordered_map<std::string_view, uint32_t> ids;
+
+        Table()
+        {
+            for (const char *name : {"id", "class", "lang", "href", "src", "name", "title"})
+            {
+                add(name);
+            }
+        }
+
+        uint32_t add(std::string_view name)
+        {
+            auto it = ids.find(name);
+            if (it != ids.end())
+            {
+                return it->second;
+            }
+            names.emplace_back(name);
+            uint32_t id = static_cast<uint32_t>(names.size() - 1);
+            ids.emplace(names.back(), id);
+            return id;
+        }
+    };
+
+    static Table &instance()
+    {
+        static Table table;
+        return table;
+    }
+};
+
+// 紧凑属性：名字编号 + 指向文档字符串区域的长度和指针，4 个属性正好占一个缓存行
+struct Attribute
+{
+    uint32_t nameId;
+    uint32_t length;
+    const char *data;
+
+    std::string_view name() const
+    {
+        return AttributeNames::name(nameId);
+    }
+
+    std::string_view value() const
+    {
+        return std::string_view(data, length);
+    }
+};
+
+// 属性列表：不超过 INLINE_CAPACITY 个属性时存放在元素内部，不做堆分配
+class AttributeList
+{
+public:
+    static constexpr uint32_t INLINE_CAPACITY = 4;
+
+    AttributeList() = default;
+    AttributeList(const AttributeList &) = delete;
+    AttributeList &operator=(const AttributeList &) = delete;
+
+    const Attribute *begin() const { return data(); }
+    const Attribute *end() const { return data() + count; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    const Attribute *find(uint32_t nameId) const
+    {
+        for (const Attribute &attribute : *this)
+        {
+            if (attribute.nameId == nameId)
+            {
+                return &attribute;
+            }
+        }
+        return nullptr;
+    }
+
+    // value 必须指向生命周期不短于元素的存储（通常是文档的 StringArena）
+    void set(uint32_t nameId, std::string_view value)
+    {
+        for (Attribute *attribute = data(); attribute != data() + count; ++attribute)
+        {
+            if (attribute->nameId == nameId)
+            {
+                attribute->length = static_cast<uint32_t>(value.size());
+                attribute->data = value.data();
+                return;
+            }
+        }
+        if (count == capacity)
+        {
+            capacity *= 2;
+            std::unique_ptr<Attribute[]> grown(new Attribute[capacity]);
+            std::copy(begin(), end(), grown.get());
+            heap = std::move(grown);
+        }
+        data()[count++] = Attribute{nameId, static_cast<uint32_t>(value.size()), value.data()};
+    }
+
+private:
+    Attribute *data() { return heap ? heap.get() : inlineItems; }
+    const Attribute *data() const { return heap ? heap.get() : inlineItems; }
+
+    Attribute inlineItems[INLINE_CAPACITY];
+    std::unique_ptr<Attribute[]> heap;
+    uint32_t count = 0;
+    uint32_t capacity = INLINE_CAPACITY;
 };
 
 struct Element : public Node, public std::enable_shared_from_this<Element>
 {
     std::string tagName;
-    std::vector<std::pair<std::string, std::string>> attributes;
+    AttributeList attributes;
+    std::string_view id;        // 缓存的 id 属性值
+    std::string_view className; // 缓存的 class 属性值
+    uint64_t classBloom = 0;    // 各个类名 classBit 的按位或，用于快速排除不含某个类的元素
+    std::shared_ptr<StringArena> arena; // 属性值所在的字符串区域，同一文档的元素共享
     std::weak_ptr<Element> parent;
     std::vector<std::shared_ptr<Node>> children;
+    // 只包含元素节点的链接，遍历时无需类型判断和引用计数；由 appendChild/removeChild 维护
+    Element *parentElement = nullptr;
+    Element *firstElementChild = nullptr;
+    Element *lastElementChild = nullptr;
+    Element *previousElementSibling = nullptr;
+    Element *nextElementSibling = nullptr;
+    // 在元素兄弟中的位置（从 0 开始）、在同名兄弟中的位置和元素子节点个数，用于结构伪类
+    uint32_t siblingIndex = 0;
+    uint32_t typeIndex = 0;
+    uint32_t childElementCount = 0;
+    // 先序编号（由 Document 维护，编号之间留有间隔以便增量插入）
+    uint64_t order = 0;
+    // 元素在文档源文本（arena->source()）中的字节范围 [sourceStart, sourceEnd)，由解析器记录；
+    // 没有对应源文本（解析器合成的元素、4GB 之后的位置）或元素及其后代被修改后为 NO_SOURCE
+    static constexpr uint32_t NO_SOURCE = UINT32_MAX;
+    uint32_t sourceStart = NO_SOURCE;
+    uint32_t sourceEnd = NO_SOURCE;
+    bool sourceClosed = false; // 源文本范围以元素自己的结束标签（或空元素的开始标签）结尾，而不是被隐式关闭
+    // 后代文本节点在文档文本表（arena->texts()）中的下标范围 [firstText, lastText)，由解析器记录；
+    // 子节点增删后为 NO_SOURCE
+    uint32_t firstText = NO_SOURCE;
+    uint32_t lastText = NO_SOURCE;
 
 private:
     void printAttributes(std::ostream &out) const
     {
-        for (const auto &[key, value] : attributes)
+        for (const auto &attribute : attributes)
         {
-            out << ' ' << key << "=\"" << value << '"';
+            out << ' ' << attribute.name() << "=\"" << attribute.value() << '"';
         }
     }
 
@@ -56,7 +244,93 @@ public:
         nodeType = NodeType::Element;
     }
 
-    void print(int depth = 0) const override
+    Element(const Element &) = delete;
+    Element &operator=(const Element &) = delete;
+
+    // 被外部持有的子元素可能比父元素活得久，析构时断开它们指向本元素的裸指针
+    ~Element()
+    {
+        for (Element *child = firstElementChild; child; child = child->nextElementSibling)
+        {
+            child->parentElement = nullptr;
+        }
+    }
+
+    // 追加子节点并维护 parent 和元素链接；child 不能已经属于其他元素
+    void appendChild(const std::shared_ptr<Node> &child)
+    {
+        invalidateSource();
+        invalidateText();
+        children.push_back(child);
+        if (child->nodeType != NodeType::Element)
+        {
+            return;
+        }
+        auto *element = static_cast<Element *>(child.get());
+        element->parent = weak_from_this();
+        element->parentElement = this;
+        element->previousElementSibling = lastElementChild;
+        element->nextElementSibling = nullptr;
+        element->siblingIndex = childElementCount++;
+        // 向前找到最近的同名兄弟即可得到 typeIndex，同构列表中只需一步
+        element->typeIndex = 0;
+        for (const Element *sibling = lastElementChild; sibling; sibling = sibling->previousElementSibling)
+        {
+            if (sibling->tagName == element->tagName)
+            {
+                element->typeIndex = sibling->typeIndex + 1;
+                break;
+            }
+        }
+        if (lastElementChild)
+        {
+            lastElementChild->nextElementSibling = element;
+        }
+        else
+        {
+            firstElementChild = element;
+        }
+        lastElementChild = element;
+    }
+
+    // 移除子节点，返回 child 是否确实是本元素的子节点
+    bool removeChild(const std::shared_ptr<Node> &child)
+    {
+        auto it = std::find(children.begin(), children.end(), child);
+        if (it == children.end())
+        {
+            return false;
+        }
+        invalidateSource();
+        invalidateText();
+        if (child->nodeType == NodeType::Element)
+        {
+            unlinkElement(static_cast<Element *>(child.get()));
+        }
+        children.erase(it);
+        return true;
+    }
+
+    void clearChildren()
+    {
+        invalidateSource();
+        invalidateText();
+        for (Element *child = firstElementChild; child;)
+        {
+            Element *next = child->nextElementSibling;
+            child->parent.reset();
+            child->parentElement = nullptr;
+            child->previousElementSibling = nullptr;
+            child->nextElementSibling = nullptr;
+            child = next;
+        }
+        firstElementChild = nullptr;
+        lastElementChild = nullptr;
+        childElementCount = 0;
+        children.clear();
+    }
+
+    void print(int depth = 0) const
     {
         const auto indent = getIndent(depth);
         std::cout << indent << '<' << tagName;
@@ -66,6 +340,229 @@ public:
         std::cout << indent << "</" << tagName << '>' << std::endl;
     }
 
+    // 元素及其后代被修改后，它和所有祖先的源文本范围不再对应当前内容。
+    // 有起点而没有终点的元素（已失效，或解析中尚未结束）的祖先必然也已失效或尚未结束，遇到即可停止，
+    // 解析过程中只需一步；从未记录范围的元素（重建的格式化元素、</br>、新建的元素）不能说明祖先的状态，需要越过
+    void invalidateSource()
+    {
+        for (Element *element = this; element; element = element->parentElement)
+        {
+            if (element->sourceStart != NO_SOURCE && element->sourceEnd == NO_SOURCE)
+            {
+                return;
+            }
+            element->sourceEnd = NO_SOURCE;
+        }
+    }
+
+    // 与 invalidateSource 相同，针对文本表范围；只有子节点增删会改变元素的文本
+    void invalidateText()
+    {
+        for (Element *element = this; element; element = element->parentElement)
+        {
+            if (element->firstText != NO_SOURCE && element->lastText == NO_SOURCE)
+            {
+                return;
+            }
+            element->lastText = NO_SOURCE;
+        }
+    }
+
+    // 文本表范围是否可用
+    bool hasTextRange() const
+    {
+        return firstText != NO_SOURCE && lastText != NO_SOURCE && arena;
+    }
+
+    // 文本表中 innerText 的零拷贝切片，O(1)；没有文本表范围（见 hasTextRange）时返回空
+    std::string_view innerTextView() const
+    {
+        return hasTextRange() ? arena->texts().slice(firstText, lastText) : std::string_view();
+    }
+
+    // 所有后代文本节点，每个之后跟一个换行；有文本表范围时是表中切片的一次连续复制，
+    // 只需读取时用 innerTextView
+    std::string innerText() const
+    {
+        if (hasTextRange())
+        {
+            return std::string(innerTextView());
+        }
+        std::string out;
+        appendText(out);
+        return out;
+    }
+
+    // 后代文本的总长度
+    size_t textLength() const
+    {
+        if (hasTextRange())
+        {
+            return arena->texts().length(firstText, lastText);
+        }
+        std::string out;
+        appendText(out);
+        return out.size() - countTextNodes();
+    }
+
+    // innerText() 的多项式哈希（与 TextTable::hash 一致），可用于快速比较或去重。
+    // 有文本表范围时直接取表中的哈希，否则逐个文本节点累加，都不构造文本
+    uint64_t textHash() const
+    {
+        if (hasTextRange())
+        {
+            return arena->texts().hash(firstText, lastText);
+        }
+        uint64_t hash = 0;
+        appendTextHash(hash);
+        return hash;
+    }
+
+    void appendText(std::string &out) const;
+    void appendTextHash(uint64_t &hash) const;
+    size_t countTextNodes() const;
+
+    // 原始标记的零拷贝视图，O(1)；没有可用的源文本范围时返回空
+    std::string_view outerHTMLView() const
+    {
+        if (sourceStart == NO_SOURCE || sourceEnd == NO_SOURCE || !arena)
+        {
+            return std::string_view();
+        }
+        return arena->source().substr(sourceStart, sourceEnd - sourceStart);
+    }
+
+    // 元素的 HTML：未修改的元素直接取源文本，修改过的元素按当前的树重新生成
+    std::string outerHTML() const
+    {
+        std::string_view view = outerHTMLView();
+        if (!view.empty())
+        {
+            return std::string(view);
+        }
+        std::string out;
+        serialize(out);
+        return out;
+    }
+
+    void serialize(std::string &out) const;
+
+    const Attribute *getAttribute(uint32_t nameId) const
+    {
+        return attributes.find(nameId);
+    }
+
+    const Attribute *getAttribute(std::string_view name) const
+    {
+        return attributes.find(AttributeNames::intern(name));
+    }
+
+    // 设置属性，值会复制到元素所在文档的字符串区域
+    void setAttribute(std::string_view name, std::string_view value)
+    {
+        if (!arena)
+        {
+            arena = std::make_shared<StringArena>();
+        }
+        invalidateSource();
+        uint32_t nameId = AttributeNames::intern(name);
+        std::string_view stored = arena->store(value);
+        attributes.set(nameId, stored);
+        if (nameId == AttributeNames::Id)
+        {
+            id = stored;
+        }
+        else if (nameId == AttributeNames::Class)
+        {
+            className = stored;
+            classBloom = 0;
+            forEachClass([this](std::string_view name)
+                         { classBloom |= classBit(name); });
+        }
+    }
+
+    // 类名在 64 位布隆掩码中对应的位
+    static constexpr uint64_t classBit(std::string_view name)
+    {
+        uint64_t hash = 1469598103934665603ull; // FNV-1a
+        for (char ch : name)
+        {
+            hash = (hash ^ static_cast<unsigned char>(ch)) * 1099511628211ull;
+        }
+        return 1ull << (hash >> 58);
+    }
+
+    template <typename Visitor>
+    void forEachClass(Visitor &&visit) const
+    {
+        size_t pos = 0;
+        while (pos < className.size())
+        {
+            while (pos < className.size() && std::isspace(static_cast<unsigned char>(className[pos])))
+            {
+                ++pos;
+            }
+            size_t start = pos;
+            while (pos < className.size() && !std::isspace(static_cast<unsigned char>(className[pos])))
+            {
+                ++pos;
+            }
+            if (pos > start)
+            {
+                visit(className.substr(start, pos - start));
+            }
+        }
+    }
+
+    // 按空白分隔的类名逐个比较
+    bool hasClass(std::string_view name) const
+    {
+        if (!(classBloom & classBit(name)))
+        {
+            return false;
+        }
+        bool found = false;
+        forEachClass([&](std::string_view candidate)
+                     { found = found || candidate == name; });
+        return found;
+    }
+
+private:
+    void unlinkElement(Element *element)
+    {
+        // 后面的兄弟位置前移
+        for (Element *sibling = element->nextElementSibling; sibling; sibling = sibling->nextElementSibling)
+        {
+            --sibling->siblingIndex;
+            if (sibling->tagName == element->tagName)
+            {
+                --sibling->typeIndex;
+            }
+        }
+        --childElementCount;
+        if (element->previousElementSibling)
+        {
+            element->previousElementSibling->nextElementSibling = element->nextElementSibling;
+        }
+        else
+        {
+            firstElementChild = element->nextElementSibling;
+        }
+        if (element->nextElementSibling)
+        {
+            element->nextElementSibling->previousElementSibling = element->previousElementSibling;
+        }
+        else
+        {
+            lastElementChild = element->previousElementSibling;
+        }
+        element->parent.reset();
+        element->parentElement = nullptr;
+        element->previousElementSibling = nullptr;
+        element->nextElementSibling = nullptr;
+    }
+
+public:
     std::string toString() const
     {
         std::ostringstream oss;
@@ -81,21 +578,217 @@ std::shared_ptr<Element> createElement(const std::string &tagName)
     return elem;
 }
 
+// 文本节点。解析得到的文本节点只保存原始文本（文档字符串区域中的视图），
+// 合并空白和解码字符引用推迟到第一次读取 nodeValue() 时进行并缓存；不需要规范化的文本直接使用原始文本。
 struct Text : public Node
 {
-    std::string nodeValue;
+private:
+    std::string_view raw;
+    bool normalize = false;
+    mutable std::once_flag normalizeOnce;
+    mutable std::string value; // 规范化后的文本，或由 setNodeValue 设置的文本
+
+public:
     Text() { nodeType = NodeType::Text; }
-    void print(int depth = 0) const override
+
+    // 规范化之后的文本，可以被多个线程同时读取
+    std::string_view nodeValue() const
     {
-        std::cout << std::string(depth * 2, ' ') << nodeValue << std::endl;
+        if (!normalize)
+        {
+            return raw;
+        }
+        std::call_once(normalizeOnce, [this]
+                       { value = whitespace::normalize(raw); });
+        return value;
+    }
+
+    // 解析时的原始文本（未合并空白、未解码），不需要任何处理
+    std::string_view rawValue() const
+    {
+        return raw;
+    }
+
+    // 设置原始文本；storage 必须在节点的生存期内有效
+    void setRawValue(std::string_view text, bool needsNormalization)
+    {
+        raw = text;
+        normalize = needsNormalization;
+    }
+
+    // 设置已经规范化的文本
+    void setNodeValue(std::string text)
+    {
+        value = std::move(text);
+        raw = value;
+        normalize = false;
+    }
+
+    void print(int depth = 0) const
+    {
+        std::cout << std::string(depth * 2, ' ') << nodeValue() << std::endl;
     }
 };
 
+void Node::print(int depth) const
+{
+    if (nodeType == NodeType::Element)
+    {
+        static_cast<const Element *>(this)->print(depth);
+    }
+    else
+    {
+        static_cast<const Text *>(this)->print(depth);
+    }
+}
+
+// 转义文本或属性值中的特殊字符
+inline void appendEscaped(std::string &out, std::string_view text, bool attribute)
+{
+    for (char ch : text)
+    {
+        switch (ch)
+        {
+        case '&':
+            out += "&amp;";
+            break;
+        case '<':
+            out += attribute ? "<" : "&lt;";
+            break;
+        case '>':
+            out += attribute ? ">" : "&gt;";
+            break;
+        case '"':
+            out += attribute ? "&quot;" : "\"";
+            break;
+        default:
+            out += ch;
+        }
+    }
+}
+
+// 按当前的树生成 HTML；未修改的子元素直接复制源文本
+void Element::serialize(std::string &out) const
+{
+    out += '<';
+    out += tagName;
+    for (const auto &attribute : attributes)
+    {
+        out += ' ';
+        out += attribute.name();
+        out += "=\"";
+        appendEscaped(out, attribute.value(), true);
+        out += '"';
+    }
+    out += '>';
+    if (isVoidTag(tagName))
+    {
+        return;
+    }
+    // script、style 等的内容按原样输出
+    bool rawText = isRawTextTag(tagName) && tagName != "textarea" && tagName != "title";
+    for (const auto &child : children)
+    {
+        if (child->nodeType == NodeType::Text)
+        {
+            std::string_view value = static_cast<const Text *>(child.get())->nodeValue();
+            if (rawText)
+            {
+                out += value;
+            }
+            else
+            {
+                appendEscaped(out, value, false);
+            }
+            continue;
+        }
+        // 被隐式关闭的子元素的源文本缺少结束标签，不能直接拼接
+        const auto *element = static_cast<const Element *>(child.get());
+        std::string_view view = element->sourceClosed ? element->outerHTMLView() : std::string_view();
+        if (view.empty())
+        {
+            element->serialize(out);
+        }
+        else
+        {
+            out.append(view.data(), view.size());
+        }
+    }
+    out += "</";
+    out += tagName;
+    out += '>';
+}
+
+// 没有文本表范围时遍历子树，顺序和格式与文本表相同
+void Element::appendText(std::string &out) const
+{
+    for (const auto &child : children)
+    {
+        if (child->nodeType == NodeType::Text)
+        {
+            out += static_cast<const Text *>(child.get())->nodeValue();
+            out += '\n';
+        }
+        else
+        {
+            const auto *element = static_cast<const Element *>(child.get());
+            if (element->hasTextRange())
+            {
+                out += element->arena->texts().slice(element->firstText, element->lastText);
+            }
+            else
+            {
+                element->appendText(out);
+            }
+        }
+    }
+}
+
+void Element::appendTextHash(uint64_t &hash) const
+{
+    for (const auto &child : children)
+    {
+        if (child->nodeType == NodeType::Text)
+        {
+            for (char ch : static_cast<const Text *>(child.get())->nodeValue())
+            {
+                hash = hash * TextTable::HASH_BASE + static_cast<unsigned char>(ch);
+            }
+            hash = hash * TextTable::HASH_BASE + '\n';
+        }
+        else
+        {
+            const auto *element = static_cast<const Element *>(child.get());
+            if (element->hasTextRange())
+            {
+                // 表中的切片含每个文本节点之后的换行
+                const TextTable &texts = element->arena->texts();
+                size_t length = texts.length(element->firstText, element->lastText) + (element->lastText - element->firstText);
+                hash = TextTable::concatHash(hash, texts.hash(element->firstText, element->lastText), length);
+            }
+            else
+            {
+                element->appendTextHash(hash);
+            }
+        }
+    }
+}
+
+size_t Element::countTextNodes() const
+{
+    size_t count = 0;
+    for (const auto &child : children)
+    {
+        count += child->nodeType == NodeType::Text ? 1 : static_cast<const Element *>(child.get())->countTextNodes();
+    }
+    return count;
+}
+
 template <typename StringType>
 std::shared_ptr<Text> createTextNode(StringType &&content)
 {
     auto node = std::make_shared<Text>();
-    node->nodeValue = std::forward<StringType>(content);
+    node->setNodeValue(std::string(std::forward<StringType>(content)));
     node->nodeType = NodeType::Text;
     return node;
 }
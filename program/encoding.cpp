@@ -0,0 +1,641 @@
+#ifndef ENCODING_CPP
+#define ENCODING_CPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include "entities.cpp"
+#if __has_include(<iconv.h>)
+#include <iconv.h>
+#define ENCODING_HAS_ICONV 1
+#endif
+
+// 文档的字符编码。GBK 和 GB2312 按 GB18030 解码（GB18030 是它们的超集，与浏览器一致）。
+enum class Charset
+{
+    Unknown, // 尚未确定，由 BOM 或 <meta charset> 判断
+    Utf8,
+    Utf16LE,
+    Utf16BE,
+    Gb18030,
+    Big5,
+    Windows1252, // 也用于 iso-8859-1、us-ascii
+};
+
+namespace encoding
+{
+    // 在前 SNIFF_LENGTH 字节中查找 <meta charset>
+    constexpr size_t SNIFF_LENGTH = 1024;
+
+    inline bool equalsIgnoreCase(std::string_view text, std::string_view lowerWord)
+    {
+        if (text.size() != lowerWord.size())
+        {
+            return false;
+        }
+        for (size_t i = 0; i < text.size(); ++i)
+        {
+            char ch = text[i];
+            if ((ch >= 'A' && ch <= 'Z' ? ch - 'A' + 'a' : ch) != lowerWord[i])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    inline size_t findIgnoreCase(std::string_view text, std::string_view lowerWord, size_t from)
+    {
+        for (size_t at = from; at + lowerWord.size() <= text.size(); ++at)
+        {
+            if (equalsIgnoreCase(text.substr(at, lowerWord.size()), lowerWord))
+            {
+                return at;
+            }
+        }
+        return std::string_view::npos;
+    }
+
+    // 按 WHATWG 编码标准把标签映射到编码，未知标签返回 Unknown
+    inline Charset charsetFromLabel(std::string_view label)
+    {
+        static const struct
+        {
+            const char *label;
+            Charset charset;
+        } LABELS[] = {
+            {"utf-8", Charset::Utf8}, {"utf8", Charset::Utf8}, {"unicode-1-1-utf-8", Charset::Utf8},
+            // <meta> 声明的 UTF-16 按 UTF-8 处理：能读到 ASCII 的 <meta> 说明文档不是 UTF-16
+            {"utf-16", Charset::Utf8}, {"utf-16le", Charset::Utf8}, {"utf-16be", Charset::Utf8},
+            {"gbk", Charset::Gb18030}, {"gb2312", Charset::Gb18030}, {"gb18030", Charset::Gb18030},
+            {"gb_2312", Charset::Gb18030}, {"gb_2312-80", Charset::Gb18030}, {"x-gbk", Charset::Gb18030},
+            {"chinese", Charset::Gb18030}, {"csgb2312", Charset::Gb18030}, {"iso-ir-58", Charset::Gb18030},
+            {"big5", Charset::Big5}, {"big5-hkscs", Charset::Big5}, {"cn-big5", Charset::Big5},
+            {"csbig5", Charset::Big5}, {"x-x-big5", Charset::Big5},
+            {"windows-1252", Charset::Windows1252}, {"iso-8859-1", Charset::Windows1252},
+            {"latin1", Charset::Windows1252}, {"l1", Charset::Windows1252}, {"cp1252", Charset::Windows1252},
+            {"us-ascii", Charset::Windows1252}, {"ascii", Charset::Windows1252}, {"iso8859-1", Charset::Windows1252},
+        };
+        while (!label.empty() && (label.front() == ' ' || label.front() == '\t' || label.front() == '\n' || label.front() == '\r'))
+        {
+            label.remove_prefix(1);
+        }
+        while (!label.empty() && (label.back() == ' ' || label.back() == '\t' || label.back() == '\n' || label.back() == '\r'))
+        {
+            label.remove_suffix(1);
+        }
+        for (const auto &entry : LABELS)
+        {
+            if (equalsIgnoreCase(label, entry.label))
+            {
+                return entry.charset;
+            }
+        }
+        return Charset::Unknown;
+    }
+
+    // 在 <meta> 标签中查找 charset=xxx（同时覆盖 <meta charset> 和 http-equiv 的 content 写法）
+    inline Charset sniffMeta(std::string_view head)
+    {
+        for (size_t meta = findIgnoreCase(head, "<meta", 0); meta != std::string_view::npos;
+             meta = findIgnoreCase(head, "<meta", meta + 5))
+        {
+            size_t close = head.find('>', meta);
+            std::string_view tag = head.substr(meta, close == std::string_view::npos ? std::string_view::npos : close - meta);
+            size_t at = findIgnoreCase(tag, "charset", 0);
+            if (at == std::string_view::npos)
+            {
+                continue;
+            }
+            at += 7;
+            while (at < tag.size() && (tag[at] == ' ' || tag[at] == '\t' || tag[at] == '\n' || tag[at] == '\r'))
+            {
+                ++at;
+            }
+            if (at >= tag.size() || tag[at] != '=')
+            {
+                continue;
+            }
+            ++at;
+            while (at < tag.size() && (tag[at] == ' ' || tag[at] == '"' || tag[at] == '\''))
+            {
+                ++at;
+            }
+            size_t end = at;
+            while (end < tag.size() && tag[end] != '"' && tag[end] != '\'' && tag[end] != ';' && tag[end] != ' ' && tag[end] != '/')
+            {
+                ++end;
+            }
+            Charset charset = charsetFromLabel(tag.substr(at, end - at));
+            if (charset != Charset::Unknown)
+            {
+                return charset;
+            }
+        }
+        return Charset::Unknown;
+    }
+
+    // 多字节序列的检查结果
+    enum class SequenceState
+    {
+        Valid,
+        Invalid,   // 非法，length 是应被替换为一个 U+FFFD 的最大子序列长度
+        Truncated, // 合法的前缀，但输入在序列中间结束
+    };
+
+    // 检查 data[at] 处的非 ASCII UTF-8 序列，length 返回序列（或需要替换的部分）的长度
+    inline SequenceState checkSequence(const unsigned char *data, size_t size, size_t at, size_t &length)
+    {
+        unsigned char lead = data[at];
+        size_t need;
+        unsigned char low = 0x80, high = 0xBF; // 第二个字节的取值范围，排除过长编码和代理项
+        if (lead >= 0xC2 && lead <= 0xDF)
+        {
+            need = 1;
+        }
+        else if (lead >= 0xE0 && lead <= 0xEF)
+        {
+            need = 2;
+            low = lead == 0xE0 ? 0xA0 : 0x80;
+            high = lead == 0xED ? 0x9F : 0xBF;
+        }
+        else if (lead >= 0xF0 && lead <= 0xF4)
+        {
+            need = 3;
+            low = lead == 0xF0 ? 0x90 : 0x80;
+            high = lead == 0xF4 ? 0x8F : 0xBF;
+        }
+        else
+        {
+            length = 1;
+            return SequenceState::Invalid;
+        }
+        for (size_t k = 1; k <= need; ++k)
+        {
+            if (at + k >= size)
+            {
+                length = k;
+                return SequenceState::Truncated;
+            }
+            unsigned char byte = data[at + k];
+            if (byte < (k == 1 ? low : 0x80) || byte > (k == 1 ? high : 0xBF))
+            {
+                length = k;
+                return SequenceState::Invalid;
+            }
+        }
+        length = need + 1;
+        return SequenceState::Valid;
+    }
+
+    // 合法 UTF-8 的最长前缀长度。ASCII 每次检查 8 个字节，中文文本中夹杂的标签和空白也能快速跳过
+    inline size_t validUtf8Prefix(std::string_view text)
+    {
+        const auto *data = reinterpret_cast<const unsigned char *>(text.data());
+        size_t size = text.size();
+        size_t at = 0;
+        while (at < size)
+        {
+            while (at + 8 <= size)
+            {
+                uint64_t word;
+                std::memcpy(&word, data + at, 8);
+                if (word & 0x8080808080808080ULL)
+                {
+                    break;
+                }
+                at += 8;
+            }
+            if (at >= size)
+            {
+                break;
+            }
+            if (data[at] < 0x80)
+            {
+                ++at;
+                continue;
+            }
+            size_t length;
+            if (checkSequence(data, size, at, length) != SequenceState::Valid)
+            {
+                return at;
+            }
+            at += length;
+        }
+        return size;
+    }
+
+    inline bool isValidUtf8(std::string_view text)
+    {
+        return validUtf8Prefix(text) == text.size();
+    }
+
+    // 合法 UTF-8 中以 lead 开头的字符占用的字节数
+    inline size_t utf8Length(unsigned char lead)
+    {
+        return lead < 0x80 ? 1 : lead < 0xE0 ? 2 : lead < 0xF0 ? 3 : 4;
+    }
+
+    // 双字节编码的码表：lead 0x81-0xFE，trail 0x40-0xFE，共 126 * 191 项，0 表示没有映射。
+    // 第一次使用时通过系统的 iconv 生成，之后解码只查表。
+    // 系统 iconv 不支持该编码时抛出 std::runtime_error，而不是把整篇文档解码成 U+FFFD。
+    class DoubleByteTable
+    {
+    private:
+        std::vector<uint32_t> codepoints;
+
+    public:
+        static constexpr size_t TRAILS = 0xFF - 0x40;
+
+        explicit DoubleByteTable(const char *iconvName) : codepoints(126 * TRAILS, 0)
+        {
+#ifdef ENCODING_HAS_ICONV
+            iconv_t converter = iconv_open("UTF-32LE", iconvName);
+            if (converter == reinterpret_cast<iconv_t>(-1))
+            {
+                throw std::runtime_error(std::string("系统 iconv 不支持 ") + iconvName + " 编码，无法解码文档");
+            }
+            size_t mapped = 0;
+            for (unsigned lead = 0x81; lead <= 0xFE; ++lead)
+            {
+                for (unsigned trail = 0x40; trail <= 0xFE; ++trail)
+                {
+                    char in[2] = {static_cast<char>(lead), static_cast<char>(trail)};
+                    char out[8];
+                    char *inPointer = in;
+                    char *outPointer = out;
+                    size_t inLeft = 2, outLeft = sizeof(out);
+                    iconv(converter, nullptr, nullptr, nullptr, nullptr);
+                    if (iconv(converter, &inPointer, &inLeft, &outPointer, &outLeft) != static_cast<size_t>(-1) &&
+                        inLeft == 0 && outLeft == sizeof(out) - 4)
+                    {
+                        uint32_t codepoint;
+                        std::memcpy(&codepoint, out, 4);
+                        codepoints[(lead - 0x81) * TRAILS + (trail - 0x40)] = codepoint;
+                        ++mapped;
+                    }
+                }
+            }
+            iconv_close(converter);
+            if (mapped == 0)
+            {
+                throw std::runtime_error(std::string("系统 iconv 无法转换 ") + iconvName + " 编码，无法解码文档");
+            }
+#else
+            throw std::runtime_error(std::string("编译时没有 iconv，无法解码 ") + iconvName + " 编码的文档");
+#endif
+        }
+
+        uint32_t lookup(unsigned char lead, unsigned char trail) const
+        {
+            return codepoints[(lead - 0x81) * TRAILS + (trail - 0x40)];
+        }
+    };
+
+    inline const DoubleByteTable &gb18030Table()
+    {
+        static const DoubleByteTable table("GB18030");
+        return table;
+    }
+
+    inline const DoubleByteTable &big5Table()
+    {
+        static const DoubleByteTable table("BIG5");
+        return table;
+    }
+
+    // GB18030 四字节序列（生僻字、emoji 等，在正文中很少见），逐个交给 iconv
+    inline uint32_t gb18030FourByte(const unsigned char *bytes)
+    {
+#ifdef ENCODING_HAS_ICONV
+        static std::mutex mutex;
+        static iconv_t converter = iconv_open("UTF-32LE", "GB18030");
+        if (converter == reinterpret_cast<iconv_t>(-1))
+        {
+            throw std::runtime_error("系统 iconv 不支持 GB18030 编码，无法解码文档");
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        char in[4];
+        std::memcpy(in, bytes, 4);
+        char out[8];
+        char *inPointer = in;
+        char *outPointer = out;
+        size_t inLeft = 4, outLeft = sizeof(out);
+        iconv(converter, nullptr, nullptr, nullptr, nullptr);
+        if (iconv(converter, &inPointer, &inLeft, &outPointer, &outLeft) == static_cast<size_t>(-1) || outLeft != sizeof(out) - 4)
+        {
+            return 0xFFFD;
+        }
+        uint32_t codepoint;
+        std::memcpy(&codepoint, out, 4);
+        return codepoint;
+#else
+        (void)bytes;
+        throw std::runtime_error("编译时没有 iconv，无法解码 GB18030 编码的文档");
+#endif
+    }
+
+    // 连续的 ASCII 整块复制，返回复制的字节数
+    inline size_t copyAscii(const unsigned char *data, size_t size, size_t at, std::string &out)
+    {
+        size_t start = at;
+        while (at + 8 <= size)
+        {
+            uint64_t word;
+            std::memcpy(&word, data + at, 8);
+            if (word & 0x8080808080808080ULL)
+            {
+                break;
+            }
+            at += 8;
+        }
+        while (at < size && data[at] < 0x80)
+        {
+            ++at;
+        }
+        out.append(reinterpret_cast<const char *>(data) + start, at - start);
+        return at - start;
+    }
+}
+
+// 输入解码阶段：把任意受支持编码的字节流转换为合法的 UTF-8，在分词之前进行。
+// 编码依次由 BOM、前 1024 字节中的 <meta charset>、调用者的提示决定，都没有时按 UTF-8 处理。
+// 已是合法 UTF-8 的输入原样返回、不复制；非法序列按 WHATWG 规则替换为 U+FFFD，
+// 因此文档树中的文本和属性值总是合法的 UTF-8，按码点处理时无需再检查。
+// 输入可以分块提供，块边界处不完整的多字节序列留到下一块。
+class InputDecoder
+{
+private:
+    Charset hint;
+    Charset detected = Charset::Unknown;
+    std::string pending; // 判断编码前的开头部分，或上一块末尾不完整的序列
+    std::string joined;  // pending 与新数据拼接后的输入
+    std::string output;
+
+    // 在 bytes 中跳过 BOM 并确定编码
+    size_t detect(std::string_view bytes)
+    {
+        if (bytes.size() >= 3 && std::memcmp(bytes.data(), "\xEF\xBB\xBF", 3) == 0)
+        {
+            detected = Charset::Utf8;
+            return 3;
+        }
+        if (bytes.size() >= 2 && std::memcmp(bytes.data(), "\xFF\xFE", 2) == 0)
+        {
+            detected = Charset::Utf16LE;
+            return 2;
+        }
+        if (bytes.size() >= 2 && std::memcmp(bytes.data(), "\xFE\xFF", 2) == 0)
+        {
+            detected = Charset::Utf16BE;
+            return 2;
+        }
+        detected = encoding::sniffMeta(bytes.substr(0, encoding::SNIFF_LENGTH));
+        if (detected == Charset::Unknown)
+        {
+            detected = hint == Charset::Unknown ? Charset::Utf8 : hint;
+        }
+        return 0;
+    }
+
+    std::string_view decodeUtf8(std::string_view input, bool final)
+    {
+        size_t valid = encoding::validUtf8Prefix(input);
+        const auto *data = reinterpret_cast<const unsigned char *>(input.data());
+        size_t length;
+        if (valid == input.size() ||
+            (!final && encoding::checkSequence(data, input.size(), valid, length) == encoding::SequenceState::Truncated))
+        {
+            pending.assign(input.substr(valid));
+            return input.substr(0, valid);
+        }
+        output.assign(input.substr(0, valid));
+        size_t at = valid;
+        while (at < input.size())
+        {
+            if (data[at] < 0x80)
+            {
+                at += encoding::copyAscii(data, input.size(), at, output);
+                continue;
+            }
+            encoding::SequenceState state = encoding::checkSequence(data, input.size(), at, length);
+            if (state == encoding::SequenceState::Valid)
+            {
+                output.append(input.substr(at, length));
+            }
+            else if (state == encoding::SequenceState::Truncated && !final)
+            {
+                pending.assign(input.substr(at));
+                break;
+            }
+            else
+            {
+                output += "\xEF\xBF\xBD";
+            }
+            at += length;
+        }
+        return output;
+    }
+
+    std::string_view decodeUtf16(std::string_view input, bool final, bool bigEndian)
+    {
+        output.clear();
+        const auto *data = reinterpret_cast<const unsigned char *>(input.data());
+        auto unitAt = [&](size_t at)
+        {
+            return bigEndian ? static_cast<uint32_t>(data[at] << 8 | data[at + 1]) : static_cast<uint32_t>(data[at + 1] << 8 | data[at]);
+        };
+        size_t at = 0;
+        while (at + 2 <= input.size())
+        {
+            uint32_t unit = unitAt(at);
+            if (unit >= 0xD800 && unit <= 0xDBFF)
+            {
+                if (at + 4 > input.size() && !final)
+                {
+                    break;
+                }
+                uint32_t next = at + 4 <= input.size() ? unitAt(at + 2) : 0;
+                if (next >= 0xDC00 && next <= 0xDFFF)
+                {
+                    entities::appendUtf8(output, 0x10000 + ((unit - 0xD800) << 10) + (next - 0xDC00));
+                    at += 4;
+                    continue;
+                }
+                unit = 0xFFFD;
+            }
+            else if (unit >= 0xDC00 && unit <= 0xDFFF)
+            {
+                unit = 0xFFFD;
+            }
+            entities::appendUtf8(output, unit);
+            at += 2;
+        }
+        if (!final)
+        {
+            pending.assign(input.substr(at));
+        }
+        else if (at < input.size())
+        {
+            output += "\xEF\xBF\xBD";
+        }
+        return output;
+    }
+
+    // GB18030 与 Big5 共用的双字节解码循环
+    std::string_view decodeDoubleByte(std::string_view input, bool final, bool gb18030)
+    {
+        output.clear();
+        output.reserve(input.size() + input.size() / 2);
+        const auto *data = reinterpret_cast<const unsigned char *>(input.data());
+        const encoding::DoubleByteTable &table = gb18030 ? encoding::gb18030Table() : encoding::big5Table();
+        size_t size = input.size();
+        size_t at = 0;
+        while (at < size)
+        {
+            unsigned char lead = data[at];
+            if (lead < 0x80)
+            {
+                at += encoding::copyAscii(data, size, at, output);
+                continue;
+            }
+            if (gb18030 && lead == 0x80)
+            {
+                output += "\xE2\x82\xAC"; // 0x80 在 GB18030 中表示欧元符号
+                ++at;
+                continue;
+            }
+            if (lead == 0x80 || lead == 0xFF)
+            {
+                output += "\xEF\xBF\xBD";
+                ++at;
+                continue;
+            }
+            if (at + 1 >= size)
+            {
+                if (!final)
+                {
+                    break;
+                }
+                output += "\xEF\xBF\xBD";
+                ++at;
+                continue;
+            }
+            unsigned char trail = data[at + 1];
+            if (gb18030 && trail >= 0x30 && trail <= 0x39)
+            {
+                if (at + 3 >= size && !final)
+                {
+                    break;
+                }
+                if (at + 3 < size &&
+                    data[at + 2] >= 0x81 && data[at + 2] <= 0xFE && data[at + 3] >= 0x30 && data[at + 3] <= 0x39)
+                {
+                    entities::appendUtf8(output, encoding::gb18030FourByte(data + at));
+                    at += 4;
+                    continue;
+                }
+                output += "\xEF\xBF\xBD";
+                ++at; // 第二个字节是 ASCII 数字，留给下一轮按 ASCII 处理
+                continue;
+            }
+            uint32_t codepoint = trail >= 0x40 && trail <= 0xFE ? table.lookup(lead, trail) : 0;
+            if (codepoint == 0)
+            {
+                output += "\xEF\xBF\xBD";
+                at += trail < 0x80 ? 1 : 2; // 不吞掉 ASCII 字节，避免 "<" 等标记字符被错误消耗
+                continue;
+            }
+            entities::appendUtf8(output, codepoint);
+            at += 2;
+        }
+        if (at < size)
+        {
+            pending.assign(input.substr(at));
+        }
+        return output;
+    }
+
+    std::string_view decodeWindows1252(std::string_view input)
+    {
+        output.clear();
+        output.reserve(input.size());
+        const auto *data = reinterpret_cast<const unsigned char *>(input.data());
+        size_t at = 0;
+        while (at < input.size())
+        {
+            if (data[at] < 0x80)
+            {
+                at += encoding::copyAscii(data, input.size(), at, output);
+                continue;
+            }
+            // 0x80-0x9F 的映射与数字字符引用的修正相同
+            entities::appendUtf8(output, entities::fixNumeric(data[at]));
+            ++at;
+        }
+        return output;
+    }
+
+    std::string_view convert(std::string_view input, bool final)
+    {
+        switch (detected)
+        {
+        case Charset::Utf16LE:
+        case Charset::Utf16BE:
+            return decodeUtf16(input, final, detected == Charset::Utf16BE);
+        case Charset::Gb18030:
+        case Charset::Big5:
+            return decodeDoubleByte(input, final, detected == Charset::Gb18030);
+        case Charset::Windows1252:
+            return decodeWindows1252(input);
+        default:
+            return decodeUtf8(input, final);
+        }
+    }
+
+public:
+    explicit InputDecoder(Charset charsetHint = Charset::Unknown) : hint(charsetHint)
+    {
+    }
+
+    // 解码一块输入；返回的 UTF-8 可能指向 data 本身，在下一次调用前有效。
+    // 开头的 SNIFF_LENGTH 字节在编码确定之前会被暂存，此时返回空。
+    std::string_view decode(const char *data, size_t length, bool final)
+    {
+        std::string_view input(data, length);
+        if (detected == Charset::Unknown && pending.empty() && (length >= encoding::SNIFF_LENGTH || final))
+        {
+            input.remove_prefix(detect(input));
+        }
+        else if (detected == Charset::Unknown)
+        {
+            pending.append(data, length);
+            if (pending.size() < encoding::SNIFF_LENGTH && !final)
+            {
+                return std::string_view();
+            }
+            joined = std::move(pending);
+            pending.clear();
+            input = std::string_view(joined).substr(detect(joined));
+        }
+        else if (!pending.empty())
+        {
+            joined = std::move(pending);
+            pending.clear();
+            joined.append(data, length);
+            input = joined;
+        }
+        return convert(input, final);
+    }
+
+    Charset charset() const
+    {
+        return detected;
+    }
+};
+
+#endif
@@ -0,0 +1,332 @@
+#ifndef ENTITIES_CPP
+#define ENTITIES_CPP
+
+#include <string>
+#include <string_view>
+#include <cstring>
+#include <cstdint>
+
+// HTML 字符引用解码：&amp;、&#39;、&#x27;、&nbsp; 等。
+// 快速路径：用 memchr（libc 中是向量化实现）查找 '&'，没有字符引用的文本原样返回，不复制。
+namespace entities
+{
+    struct NamedEntity
+    {
+        const char *name;
+        uint32_t codepoint;
+    };
+
+    // HTML 4 的全部命名实体（Latin-1、特殊字符、符号和希腊字母）以及 HTML5 的 &apos;
+    constexpr NamedEntity NAMED[] = {
+        {"quot", 34}, {"amp", 38}, {"apos", 39}, {"lt", 60}, {"gt", 62},
+        {"nbsp", 160}, {"iexcl", 161}, {"cent", 162}, {"pound", 163}, {"curren", 164}, {"yen", 165},
+        {"brvbar", 166}, {"sect", 167}, {"uml", 168}, {"copy", 169}, {"ordf", 170}, {"laquo", 171},
+        {"not", 172}, {"shy", 173}, {"reg", 174}, {"macr", 175}, {"deg", 176}, {"plusmn", 177},
+        {"sup2", 178}, {"sup3", 179}, {"acute", 180}, {"micro", 181}, {"para", 182}, {"middot", 183},
+        {"cedil", 184}, {"sup1", 185}, {"ordm", 186}, {"raquo", 187}, {"frac14", 188}, {"frac12", 189},
+        {"frac34", 190}, {"iquest", 191}, {"Agrave", 192}, {"Aacute", 193}, {"Acirc", 194}, {"Atilde", 195},
+        {"Auml", 196}, {"Aring", 197}, {"AElig", 198}, {"Ccedil", 199}, {"Egrave", 200}, {"Eacute", 201},
+        {"Ecirc", 202}, {"Euml", 203}, {"Igrave", 204}, {"Iacute", 205}, {"Icirc", 206}, {"Iuml", 207},
+        {"ETH", 208}, {"Ntilde", 209}, {"Ograve", 210}, {"Oacute", 211}, {"Ocirc", 212}, {"Otilde", 213},
+        {"Ouml", 214}, {"times", 215}, {"Oslash", 216}, {"Ugrave", 217}, {"Uacute", 218}, {"Ucirc", 219},
+        {"Uuml", 220}, {"Yacute", 221}, {"THORN", 222}, {"szlig", 223}, {"agrave", 224}, {"aacute", 225},
+        {"acirc", 226}, {"atilde", 227}, {"auml", 228}, {"aring", 229}, {"aelig", 230}, {"ccedil", 231},
+        {"egrave", 232}, {"eacute", 233}, {"ecirc", 234}, {"euml", 235}, {"igrave", 236}, {"iacute", 237},
+        {"icirc", 238}, {"iuml", 239}, {"eth", 240}, {"ntilde", 241}, {"ograve", 242}, {"oacute", 243},
+        {"ocirc", 244}, {"otilde", 245}, {"ouml", 246}, {"divide", 247}, {"oslash", 248}, {"ugrave", 249},
+        {"uacute", 250}, {"ucirc", 251}, {"uuml", 252}, {"yacute", 253}, {"thorn", 254}, {"yuml", 255},
+        {"OElig", 338}, {"oelig", 339}, {"Scaron", 352}, {"scaron", 353}, {"Yuml", 376}, {"fnof", 402},
+        {"circ", 710}, {"tilde", 732}, {"Alpha", 913}, {"Beta", 914}, {"Gamma", 915}, {"Delta", 916},
+        {"Epsilon", 917}, {"Zeta", 918}, {"Eta", 919}, {"Theta", 920}, {"Iota", 921}, {"Kappa", 922},
+        {"Lambda", 923}, {"Mu", 924}, {"Nu", 925}, {"Xi", 926}, {"Omicron", 927}, {"Pi", 928},
+        {"Rho", 929}, {"Sigma", 931}, {"Tau", 932}, {"Upsilon", 933}, {"Phi", 934}, {"Chi", 935},
+        {"Psi", 936}, {"Omega", 937}, {"alpha", 945}, {"beta", 946}, {"gamma", 947}, {"delta", 948},
+        {"epsilon", 949}, {"zeta", 950}, {"eta", 951}, {"theta", 952}, {"iota", 953}, {"kappa", 954},
+        {"lambda", 955}, {"mu", 956}, {"nu", 957}, {"xi", 958}, {"omicron", 959}, {"pi", 960},
+        {"rho", 961}, {"sigmaf", 962}, {"sigma", 963}, {"tau", 964}, {"upsilon", 965}, {"phi", 966},
+        {"chi", 967}, {"psi", 968}, {"omega", 969}, {"thetasym", 977}, {"upsih", 978}, {"piv", 982},
+        {"ensp", 8194}, {"emsp", 8195}, {"thinsp", 8201}, {"zwnj", 8204}, {"zwj", 8205}, {"lrm", 8206},
+        {"rlm", 8207}, {"ndash", 8211}, {"mdash", 8212}, {"lsquo", 8216}, {"rsquo", 8217}, {"sbquo", 8218},
+        {"ldquo", 8220}, {"rdquo", 8221}, {"bdquo", 8222}, {"dagger", 8224}, {"Dagger", 8225}, {"bull", 8226},
+        {"hellip", 8230}, {"permil", 8240}, {"prime", 8242}, {"Prime", 8243}, {"lsaquo", 8249}, {"rsaquo", 8250},
+        {"oline", 8254}, {"frasl", 8260}, {"euro", 8364}, {"image", 8465}, {"weierp", 8472}, {"real", 8476},
+        {"trade", 8482}, {"alefsym", 8501}, {"larr", 8592}, {"uarr", 8593}, {"rarr", 8594}, {"darr", 8595},
+        {"harr", 8596}, {"crarr", 8629}, {"lArr", 8656}, {"uArr", 8657}, {"rArr", 8658}, {"dArr", 8659},
+        {"hArr", 8660}, {"forall", 8704}, {"part", 8706}, {"exist", 8707}, {"empty", 8709}, {"nabla", 8711},
+        {"isin", 8712}, {"notin", 8713}, {"ni", 8715}, {"prod", 8719}, {"sum", 8721}, {"minus", 8722},
+        {"lowast", 8727}, {"radic", 8730}, {"prop", 8733}, {"infin", 8734}, {"ang", 8736}, {"and", 8743},
+        {"or", 8744}, {"cap", 8745}, {"cup", 8746}, {"int", 8747}, {"there4", 8756}, {"sim", 8764},
+        {"cong", 8773}, {"asymp", 8776}, {"ne", 8800}, {"equiv", 8801}, {"le", 8804}, {"ge", 8805},
+        {"sub", 8834}, {"sup", 8835}, {"nsub", 8836}, {"sube", 8838}, {"supe", 8839}, {"oplus", 8853},
+        {"otimes", 8855}, {"perp", 8869}, {"sdot", 8901}, {"lceil", 8968}, {"rceil", 8969}, {"lfloor", 8970},
+        {"rfloor", 8971}, {"lang", 9001}, {"rang", 9002}, {"loz", 9674}, {"spades", 9824}, {"clubs", 9827},
+        {"hearts", 9829}, {"diams", 9830},
+    };
+    constexpr size_t NAMED_COUNT = sizeof(NAMED) / sizeof(NAMED[0]);
+    constexpr size_t MAX_NAME_LENGTH = 8;
+
+    // 完美哈希（CHD 算法）：名字先按种子 0 的哈希分到桶中，编译期为每个桶搜索一个位移种子，
+    // 使所有名字在第二次哈希后落在互不相同的槽中。查找只需两次哈希和一次比较。
+    constexpr size_t BUCKETS = 128;
+    constexpr size_t TABLE_SIZE = 512;
+
+    constexpr uint32_t hashName(const char *name, size_t length, uint32_t seed)
+    {
+        uint32_t hash = 2166136261u ^ (seed * 0x9E3779B9u);
+        for (size_t i = 0; i < length; ++i)
+        {
+            hash = (hash ^ static_cast<unsigned char>(name[i])) * 16777619u;
+        }
+        return hash ^ (hash >> 15);
+    }
+
+    constexpr size_t nameLength(const char *name)
+    {
+        size_t length = 0;
+        while (name[length])
+        {
+            ++length;
+        }
+        return length;
+    }
+
+    struct PerfectTable
+    {
+        uint16_t displacement[BUCKETS]{}; // 每个桶的第二次哈希种子，0 表示空桶
+        uint16_t slots[TABLE_SIZE]{};     // NAMED 下标 + 1，0 表示空槽
+    };
+
+    constexpr PerfectTable buildTable()
+    {
+        PerfectTable table;
+        size_t bucketOf[NAMED_COUNT]{};
+        size_t bucketSize[BUCKETS]{};
+        size_t largest = 0;
+        for (size_t i = 0; i < NAMED_COUNT; ++i)
+        {
+            bucketOf[i] = hashName(NAMED[i].name, nameLength(NAMED[i].name), 0) % BUCKETS;
+            largest = ++bucketSize[bucketOf[i]] > largest ? bucketSize[bucketOf[i]] : largest;
+        }
+        // 先放置较大的桶，它们最难找到空位
+        for (size_t size = largest; size > 0; --size)
+        {
+            for (size_t bucket = 0; bucket < BUCKETS; ++bucket)
+            {
+                if (bucketSize[bucket] != size)
+                {
+                    continue;
+                }
+                for (uint16_t seed = 1;; ++seed)
+                {
+                    size_t placed[NAMED_COUNT]{};
+                    size_t placedCount = 0;
+                    bool fits = true;
+                    for (size_t i = 0; i < NAMED_COUNT && fits; ++i)
+                    {
+                        if (bucketOf[i] != bucket)
+                        {
+                            continue;
+                        }
+                        size_t slot = hashName(NAMED[i].name, nameLength(NAMED[i].name), seed) % TABLE_SIZE;
+                        fits = table.slots[slot] == 0;
+                        if (fits)
+                        {
+                            table.slots[slot] = static_cast<uint16_t>(i + 1);
+                            placed[placedCount++] = slot;
+                        }
+                    }
+                    if (fits)
+                    {
+                        table.displacement[bucket] = seed;
+                        break;
+                    }
+                    for (size_t j = 0; j < placedCount; ++j)
+                    {
+                        table.slots[placed[j]] = 0;
+                    }
+                }
+            }
+        }
+        return table;
+    }
+
+    constexpr PerfectTable TABLE = buildTable();
+
+    // 查找命名实体，不存在时返回 0
+    inline uint32_t lookupNamed(std::string_view name)
+    {
+        if (name.empty() || name.size() > MAX_NAME_LENGTH)
+        {
+            return 0;
+        }
+        uint16_t seed = TABLE.displacement[hashName(name.data(), name.size(), 0) % BUCKETS];
+        if (seed == 0)
+        {
+            return 0;
+        }
+        uint16_t slot = TABLE.slots[hashName(name.data(), name.size(), seed) % TABLE_SIZE];
+        if (slot == 0)
+        {
+            return 0;
+        }
+        const NamedEntity &entity = NAMED[slot - 1];
+        return name == entity.name ? entity.codepoint : 0;
+    }
+
+    inline void appendUtf8(std::string &out, uint32_t codepoint)
+    {
+        if (codepoint < 0x80)
+        {
+            out += static_cast<char>(codepoint);
+        }
+        else if (codepoint < 0x800)
+        {
+            out += static_cast<char>(0xC0 | (codepoint >> 6));
+            out += static_cast<char>(0x80 | (codepoint & 0x3F));
+        }
+        else if (codepoint < 0x10000)
+        {
+            out += static_cast<char>(0xE0 | (codepoint >> 12));
+            out += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (codepoint & 0x3F));
+        }
+        else
+        {
+            out += static_cast<char>(0xF0 | (codepoint >> 18));
+            out += static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (codepoint & 0x3F));
+        }
+    }
+
+    // 数字引用按 HTML 规范修正：0x80-0x9F 按 Windows-1252 解释，非法码点替换为 U+FFFD
+    inline uint32_t fixNumeric(uint32_t codepoint)
+    {
+        static const uint16_t WINDOWS_1252[32] = {
+            0x20AC, 0x81, 0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021, 0x02C6, 0x2030, 0x0160, 0x2039, 0x0152, 0x8D, 0x017D, 0x8F,
+            0x90, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014, 0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0x9D, 0x017E, 0x0178};
+        if (codepoint >= 0x80 && codepoint <= 0x9F)
+        {
+            return WINDOWS_1252[codepoint - 0x80];
+        }
+        if (codepoint == 0 || codepoint > 0x10FFFF || (codepoint >= 0xD800 && codepoint <= 0xDFFF))
+        {
+            return 0xFFFD;
+        }
+        return codepoint;
+    }
+
+    // 解析 text[pos] == '&' 处的字符引用；成功时返回码点并把 length 设为引用的长度
+    inline uint32_t parseReference(std::string_view text, size_t pos, size_t &length)
+    {
+        size_t cursor = pos + 1;
+        if (cursor < text.size() && text[cursor] == '#')
+        {
+            ++cursor;
+            bool hex = cursor < text.size() && (text[cursor] == 'x' || text[cursor] == 'X');
+            if (hex)
+            {
+                ++cursor;
+            }
+            size_t digitsStart = cursor;
+            uint32_t value = 0;
+            while (cursor < text.size())
+            {
+                char ch = text[cursor];
+                int digit = ch >= '0' && ch <= '9'           ? ch - '0'
+                            : hex && ch >= 'a' && ch <= 'f' ? ch - 'a' + 10
+                            : hex && ch >= 'A' && ch <= 'F' ? ch - 'A' + 10
+                                                            : -1;
+                if (digit < 0)
+                {
+                    break;
+                }
+                // 超出范围后保持在非法值，避免溢出
+                value = value > 0x10FFFF ? value : value * (hex ? 16 : 10) + static_cast<uint32_t>(digit);
+                ++cursor;
+            }
+            if (cursor == digitsStart)
+            {
+                return 0;
+            }
+            // 数字引用的分号可以省略
+            if (cursor < text.size() && text[cursor] == ';')
+            {
+                ++cursor;
+            }
+            length = cursor - pos;
+            return fixNumeric(value);
+        }
+
+        // 命名引用必须以分号结束
+        size_t nameEnd = cursor;
+        while (nameEnd < text.size() && nameEnd - cursor <= MAX_NAME_LENGTH &&
+               ((text[nameEnd] >= 'a' && text[nameEnd] <= 'z') || (text[nameEnd] >= 'A' && text[nameEnd] <= 'Z') ||
+                (text[nameEnd] >= '0' && text[nameEnd] <= '9')))
+        {
+            ++nameEnd;
+        }
+        if (nameEnd >= text.size() || text[nameEnd] != ';')
+        {
+            return 0;
+        }
+        uint32_t codepoint = lookupNamed(text.substr(cursor, nameEnd - cursor));
+        if (codepoint)
+        {
+            length = nameEnd + 1 - pos;
+        }
+        return codepoint;
+    }
+}
+
+// 解码 text 中的字符引用。没有 '&' 时直接返回 text（零复制）；
+// 否则把结果写入 scratch 并返回指向它的视图。无法识别的引用原样保留。
+std::string_view decodeEntities(std::string_view text, std::string &scratch)
+{
+    const char *amp = static_cast<const char *>(std::memchr(text.data(), '&', text.size()));
+    if (!amp)
+    {
+        return text;
+    }
+    scratch.clear();
+    scratch.reserve(text.size());
+    size_t copied = 0;
+    size_t pos = static_cast<size_t>(amp - text.data());
+    while (pos < text.size())
+    {
+        size_t length = 0;
+        uint32_t codepoint = entities::parseReference(text, pos, length);
+        if (codepoint)
+        {
+            scratch.append(text.data() + copied, pos - copied);
+            entities::appendUtf8(scratch, codepoint);
+            copied = pos + length;
+            pos = copied;
+        }
+        else
+        {
+            ++pos;
+        }
+        amp = pos < text.size() ? static_cast<const char *>(std::memchr(text.data() + pos, '&', text.size() - pos)) : nullptr;
+        if (!amp)
+        {
+            break;
+        }
+        pos = static_cast<size_t>(amp - text.data());
+    }
+    scratch.append(text.data() + copied, text.size() - copied);
+    return scratch;
+}
+
+// 便于直接修改 std::string 的版本：没有字符引用时不做任何复制
+void decodeEntitiesInPlace(std::string &text)
+{
+    std::string scratch;
+    std::string_view decoded = decodeEntities(text, scratch);
+    if (decoded.data() == scratch.data())
+    {
+        text.swap(scratch);
+    }
+}
+
+#endif
@@ -0,0 +1,488 @@
+#ifndef EXTRACTION_CPP
+#define EXTRACTION_CPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cctype>
+#include <stdexcept>
+#include "element.cpp"
+#include "selectormatcher.cpp"
+#include "selectorvm.cpp"
+
+// 声明式提取模板：一次编译，在一次先序遍历中同时求值所有记录和字段。
+// 模板语法：
+//
+//     div.product {
+//         title: h2;                // 默认取文本
+//         link: a @href;            // @属性名 取属性值
+//         price: .price @text;
+//         image: img @src;
+//         body: .desc @html;        // @html 取元素的 HTML
+//         id: @data-id;             // 省略选择器时取记录元素自身
+//         tags[]: .tag;             // 名称后加 [] 取全部匹配，否则只取第一个匹配
+//         variants[]: .variant {    // 嵌套记录
+//             name: .name;
+//         }
+//     }
+//
+// 字段选择器与 element.querySelector 的语义相同：在记录元素的后代中匹配，但选择器的祖先部分可以在记录之外。
+// 文本是后代文本节点以空格连接的结果。/* */ 注释被忽略。
+enum class ExtractKind
+{
+    Text,
+    Html,
+    Attribute,
+    Record, // 嵌套记录
+};
+
+struct ExtractionField
+{
+    std::string name;
+    std::string selector; // 为空表示记录元素自身
+    std::shared_ptr<const SelectorProgram> program;
+    ExtractKind kind = ExtractKind::Text;
+    uint32_t attribute = 0; // Attribute 的属性名编号
+    bool list = false;
+    size_t nested = 0; // Record 对应的记录模板下标
+};
+
+struct ExtractionRecord
+{
+    std::string selector;
+    std::shared_ptr<const SelectorProgram> program;
+    std::vector<ExtractionField> fields;
+};
+
+struct ExtractedRecord;
+
+// 一个字段的结果：非列表字段最多有一个值；缺少属性的匹配不产生值
+struct ExtractedField
+{
+    std::vector<std::string> values;
+    std::vector<ExtractedRecord> records; // 嵌套记录
+};
+
+struct ExtractedRecord
+{
+    const Element *element = nullptr;
+    std::vector<ExtractedField> fields; // 与模板的字段一一对应
+};
+
+class ExtractionTemplate
+{
+private:
+    std::vector<ExtractionRecord> records; // records[0] 是顶层记录模板
+
+    // 模板文本的递归下降解析
+    class Reader
+    {
+    private:
+        std::string_view text;
+        size_t pos = 0;
+
+    public:
+        explicit Reader(std::string_view source) : text(source) {}
+
+        [[noreturn]] void fail(const std::string &message) const
+        {
+            throw std::invalid_argument("提取模板格式错误（位置 " + std::to_string(pos) + "）: " + message);
+        }
+
+        void skipSpace()
+        {
+            while (pos < text.size())
+            {
+                if (whitespace::isSpace(text[pos]))
+                {
+                    ++pos;
+                }
+                else if (text.compare(pos, 2, "/*") == 0)
+                {
+                    size_t end = text.find("*/", pos + 2);
+                    if (end == std::string_view::npos)
+                    {
+                        fail("注释没有结束");
+                    }
+                    pos = end + 2;
+                }
+                else
+                {
+                    break;
+                }
+            }
+        }
+
+        bool atEnd()
+        {
+            skipSpace();
+            return pos >= text.size();
+        }
+
+        bool consume(char ch)
+        {
+            skipSpace();
+            if (pos < text.size() && text[pos] == ch)
+            {
+                ++pos;
+                return true;
+            }
+            return false;
+        }
+
+        void expect(char ch)
+        {
+            if (!consume(ch))
+            {
+                fail(std::string("缺少 '") + ch + "'");
+            }
+        }
+
+        bool peek(char ch)
+        {
+            skipSpace();
+            return pos < text.size() && text[pos] == ch;
+        }
+
+        // 字段名或属性名；属性名可以含 ':'（如 xlink:href）
+        std::string name(bool allowColon = false)
+        {
+            skipSpace();
+            size_t start = pos;
+            while (pos < text.size() && (std::isalnum(static_cast<unsigned char>(text[pos])) || text[pos] == '_' ||
+                                         text[pos] == '-' || (allowColon && text[pos] == ':')))
+            {
+                ++pos;
+            }
+            if (pos == start)
+            {
+                fail("缺少名称");
+            }
+            return std::string(text.substr(start, pos - start));
+        }
+
+        // 选择器读到 '@'、';'、'{'、'}' 为止（引号内的除外），去掉首尾空白
+        std::string selector()
+        {
+            skipSpace();
+            size_t start = pos;
+            char quote = 0;
+            for (; pos < text.size(); ++pos)
+            {
+                char ch = text[pos];
+                if (quote)
+                {
+                    quote = ch == quote ? 0 : quote;
+                }
+                else if (ch == '"' || ch == '\'')
+                {
+                    quote = ch;
+                }
+                else if (ch == '@' || ch == ';' || ch == '{' || ch == '}')
+                {
+                    break;
+                }
+            }
+            if (quote)
+            {
+                fail("引号不匹配");
+            }
+            size_t end = pos;
+            while (end > start && whitespace::isSpace(text[end - 1]))
+            {
+                --end;
+            }
+            return std::string(text.substr(start, end - start));
+        }
+    };
+
+    // 解析 '{' 之后的字段列表直到 '}'，返回记录模板的下标
+    size_t parseRecord(Reader &reader, std::string selector)
+    {
+        size_t index = records.size();
+        records.push_back({selector, getSelectorProgram(selector), {}});
+        std::vector<ExtractionField> fields;
+        while (!reader.consume('}'))
+        {
+            if (reader.atEnd())
+            {
+                reader.fail("缺少 '}'");
+            }
+            ExtractionField field;
+            field.name = reader.name();
+            if (reader.consume('['))
+            {
+                reader.expect(']');
+                field.list = true;
+            }
+            reader.expect(':');
+            field.selector = reader.selector();
+            if (!field.selector.empty())
+            {
+                field.program = getSelectorProgram(field.selector);
+            }
+            if (reader.consume('{'))
+            {
+                if (field.selector.empty())
+                {
+                    reader.fail("嵌套记录 " + field.name + " 缺少选择器");
+                }
+                field.kind = ExtractKind::Record;
+                field.nested = parseRecord(reader, field.selector);
+                reader.consume(';');
+            }
+            else
+            {
+                if (reader.consume('@'))
+                {
+                    std::string extractor = reader.name(true);
+                    if (extractor == "text")
+                    {
+                        field.kind = ExtractKind::Text;
+                    }
+                    else if (extractor == "html")
+                    {
+                        field.kind = ExtractKind::Html;
+                    }
+                    else
+                    {
+                        for (char &ch : extractor)
+                        {
+                            ch = static_cast<char>(std::tolower(static_cast<unsigned char>(ch)));
+                        }
+                        field.kind = ExtractKind::Attribute;
+                        field.attribute = AttributeNames::intern(extractor);
+                    }
+                }
+                if (!reader.consume(';') && !reader.peek('}'))
+                {
+                    reader.fail("字段 " + field.name + " 之后缺少 ';'");
+                }
+            }
+            fields.push_back(std::move(field));
+        }
+        records[index].fields = std::move(fields);
+        return index;
+    }
+
+    // 求值过程中的记录，平铺存放，最后组装成树
+    struct PendingRecord
+    {
+        size_t templateIndex;
+        const Element *element;
+        std::vector<std::vector<std::string>> values;
+        std::vector<std::vector<size_t>> children; // 嵌套记录在 pending 中的下标
+        std::vector<bool> done;                    // 非列表字段已取到第一个匹配
+        size_t remaining;                          // 尚未完成的字段数，为 0 时不再检查
+    };
+
+    static std::string extractText(const Element *element)
+    {
+        std::string text = element->innerText();
+        for (char &ch : text)
+        {
+            if (ch == '\n')
+            {
+                ch = ' ';
+            }
+        }
+        if (!text.empty())
+        {
+            text.pop_back();
+        }
+        return text;
+    }
+
+    // 把 element 的值写入字段；属性不存在时不产生值
+    static void extractValue(const ExtractionField &field, const Element *element, std::vector<std::string> &values)
+    {
+        switch (field.kind)
+        {
+        case ExtractKind::Text:
+            values.push_back(extractText(element));
+            break;
+        case ExtractKind::Html:
+            values.push_back(element->outerHTML());
+            break;
+        case ExtractKind::Attribute:
+            if (const Attribute *attribute = element->getAttribute(field.attribute))
+            {
+                values.emplace_back(attribute->value());
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    // 字段在 element 上取到一个结果
+    static void complete(PendingRecord &record, size_t fieldIndex, const ExtractionField &field)
+    {
+        if (!field.list)
+        {
+            record.done[fieldIndex] = true;
+            --record.remaining;
+        }
+    }
+
+    // 新建记录，并立即求值取记录元素自身的字段
+    size_t openRecord(std::vector<PendingRecord> &pending, size_t templateIndex, const Element *element) const
+    {
+        const ExtractionRecord &shape = records[templateIndex];
+        size_t count = shape.fields.size();
+        PendingRecord record{templateIndex, element, std::vector<std::vector<std::string>>(count),
+                             std::vector<std::vector<size_t>>(count), std::vector<bool>(count, false), count};
+        for (size_t i = 0; i < count; ++i)
+        {
+            const ExtractionField &field = shape.fields[i];
+            if (field.selector.empty())
+            {
+                extractValue(field, element, record.values[i]);
+                record.done[i] = true;
+                --record.remaining;
+            }
+        }
+        pending.push_back(std::move(record));
+        return pending.size() - 1;
+    }
+
+    ExtractedRecord assemble(std::vector<PendingRecord> &pending, size_t index) const
+    {
+        PendingRecord &record = pending[index];
+        ExtractedRecord result;
+        result.element = record.element;
+        result.fields.resize(record.values.size());
+        for (size_t i = 0; i < record.values.size(); ++i)
+        {
+            result.fields[i].values = std::move(record.values[i]);
+            for (size_t child : record.children[i])
+            {
+                result.fields[i].records.push_back(assemble(pending, child));
+            }
+        }
+        return result;
+    }
+
+public:
+    // 编译模板；格式错误时抛出 std::invalid_argument
+    static ExtractionTemplate parse(std::string_view text)
+    {
+        ExtractionTemplate compiled;
+        Reader reader(text);
+        std::string selector = reader.selector();
+        if (selector.empty())
+        {
+            reader.fail("缺少记录选择器");
+        }
+        reader.expect('{');
+        compiled.parseRecord(reader, selector);
+        if (!reader.atEnd())
+        {
+            reader.fail("模板结束之后还有多余的内容");
+        }
+        return compiled;
+    }
+
+    const ExtractionRecord &record(size_t index = 0) const
+    {
+        return records[index];
+    }
+
+    // 记录模板个数（顶层记录和各级嵌套记录）
+    size_t recordCount() const
+    {
+        return records.size();
+    }
+
+    // 对 root 的后代求值模板，按文档顺序返回顶层记录。
+    // 只遍历一次子树：每个元素依次检查所有打开的记录中尚未完成的字段和顶层记录选择器，
+    // 而不是对每条记录的每个字段各做一次查询。
+    std::vector<ExtractedRecord> extract(const Element *root) const
+    {
+        HasMemoScope hasMemo;
+        std::vector<PendingRecord> pending;
+        std::vector<size_t> topLevel;
+        std::vector<size_t> active; // 记录元素是当前元素祖先的记录，外层在前
+        std::vector<size_t> opened;
+        const Element *cursor = root ? root->firstElementChild : nullptr;
+        while (cursor)
+        {
+            opened.clear();
+            for (size_t id : active)
+            {
+                if (pending[id].remaining == 0)
+                {
+                    continue;
+                }
+                const auto &fields = records[pending[id].templateIndex].fields;
+                for (size_t i = 0; i < fields.size(); ++i)
+                {
+                    const ExtractionField &field = fields[i];
+                    if (pending[id].done[i] || !field.program || !field.program->matches(cursor))
+                    {
+                        continue;
+                    }
+                    if (field.kind == ExtractKind::Record)
+                    {
+                        size_t child = openRecord(pending, field.nested, cursor);
+                        pending[id].children[i].push_back(child);
+                        opened.push_back(child);
+                    }
+                    else
+                    {
+                        extractValue(field, cursor, pending[id].values[i]);
+                    }
+                    complete(pending[id], i, field);
+                }
+            }
+            if (records[0].program->matches(cursor))
+            {
+                size_t id = openRecord(pending, 0, cursor);
+                topLevel.push_back(id);
+                opened.push_back(id);
+            }
+            active.insert(active.end(), opened.begin(), opened.end());
+
+            // 先序遍历的下一个元素；离开元素时关闭以它为记录元素的记录
+            if (cursor->firstElementChild)
+            {
+                cursor = cursor->firstElementChild;
+                continue;
+            }
+            while (cursor != root)
+            {
+                while (!active.empty() && pending[active.back()].element == cursor)
+                {
+                    active.pop_back();
+                }
+                if (cursor->nextElementSibling)
+                {
+                    cursor = cursor->nextElementSibling;
+                    break;
+                }
+                cursor = cursor->parentElement;
+            }
+            if (cursor == root)
+            {
+                break;
+            }
+        }
+
+        std::vector<ExtractedRecord> results;
+        results.reserve(topLevel.size());
+        for (size_t id : topLevel)
+        {
+            results.push_back(assemble(pending, id));
+        }
+        return results;
+    }
+
+    std::vector<ExtractedRecord> extract(const std::shared_ptr<Element> &root) const
+    {
+        return extract(root.get());
+    }
+};
+
+#endif
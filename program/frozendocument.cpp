@@ -0,0 +1,232 @@
+#ifndef FROZENDOCUMENT_CPP
+#define FROZENDOCUMENT_CPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <algorithm>
+#include "element.cpp"
+#include "selectormatcher.cpp"
+#include "threadpool.cpp"
+
+// 冻结的只读文档，由 Document::freeze() 创建。
+//
+// 线程安全约定：
+// - 冻结之后树不再修改（原 Document 的修改接口会抛出异常，也不得绕过 Document 直接修改元素），
+//   因此 FrozenDocument 的所有 const 成员函数可以被任意多个线程同时调用，不需要加锁。
+// - 匹配只沿元素的裸指针链接移动，结果以 const Element * 返回，查询过程中没有 shared_ptr 引用计数的原子操作。
+// - 编译后的选择器、属性选择器和 :has() 备忘录都按线程缓存，属性名驻留表自带读写锁。
+// - 返回的指针在 FrozenDocument 存活期间有效（它持有整棵树）。
+class FrozenDocument
+{
+public:
+    using ElementList = std::vector<const Element *>;
+
+private:
+    std::shared_ptr<const Element> root;
+    ElementList elements; // 除根以外的全部元素，按文档顺序
+    std::unordered_map<std::string, ElementList> idIndex;
+    std::unordered_map<std::string, ElementList> classIndex;
+    std::unordered_map<std::string, ElementList> tagIndex;
+    std::unordered_map<uint32_t, ElementList> attributeIndex;
+
+    explicit FrozenDocument(const std::shared_ptr<const Element> &rootElement) : root(rootElement)
+    {
+        collect(root.get());
+    }
+
+    // 先序遍历建立索引，索引中的列表天然按文档顺序排列
+    void collect(const Element *parent)
+    {
+        for (const Element *element = parent->firstElementChild; element; element = element->nextElementSibling)
+        {
+            elements.push_back(element);
+            if (!element->id.empty())
+            {
+                idIndex[std::string(element->id)].push_back(element);
+            }
+            element->forEachClass([&](std::string_view name)
+                                  {
+                auto &list = classIndex[std::string(name)];
+                if (list.empty() || list.back() != element)
+                {
+                    list.push_back(element);
+                } });
+            tagIndex[element->tagName].push_back(element);
+            for (const auto &attribute : element->attributes)
+            {
+                attributeIndex[attribute.nameId].push_back(element);
+            }
+            collect(element);
+        }
+    }
+
+    template <typename Index, typename Key>
+    static const ElementList &lookup(const Index &index, const Key &key)
+    {
+        static const ElementList empty;
+        auto it = index.find(key);
+        return it == index.end() ? empty : it->second;
+    }
+
+    // 与 Document::seedCandidates 相同的规则：按 id、属性、class、tag 的顺序选择候选列表
+    const ElementList &seedCandidates(const std::string &compound) const
+    {
+        auto atoms = splitCompound(compound);
+        for (const auto &atom : atoms)
+        {
+            if (atom[0] == '#')
+            {
+                return lookup(idIndex, atom.substr(1));
+            }
+        }
+        for (const auto &atom : atoms)
+        {
+            if (atom[0] == '[')
+            {
+                return lookup(attributeIndex, AttributeSelector::get(atom).nameId);
+            }
+        }
+        for (const auto &atom : atoms)
+        {
+            if (atom[0] == '.')
+            {
+                return lookup(classIndex, atom.substr(1));
+            }
+        }
+        for (const auto &atom : atoms)
+        {
+            if (atom[0] != ':' && atom != "*")
+            {
+                return lookup(tagIndex, atom);
+            }
+        }
+        return elements;
+    }
+
+    friend class Document;
+
+public:
+    FrozenDocument(const FrozenDocument &) = delete;
+    FrozenDocument &operator=(const FrozenDocument &) = delete;
+
+    const Element *getRoot() const
+    {
+        return root.get();
+    }
+
+    const ElementList &getElementById(const std::string &id) const
+    {
+        return lookup(idIndex, id);
+    }
+
+    const ElementList &getElementsByClassName(const std::string &className) const
+    {
+        return lookup(classIndex, className);
+    }
+
+    const ElementList &getElementsByTagName(const std::string &tagName) const
+    {
+        return lookup(tagIndex, tagName);
+    }
+
+    bool matches(const Element *element, const std::string &selector) const
+    {
+        HasMemoScope hasMemo;
+        return matchesSelector(element, getCompiledSelector(selector));
+    }
+
+    // 结果按文档顺序返回，不含根元素
+    ElementList querySelectorAll(const std::string &selector) const
+    {
+        HasMemoScope hasMemo;
+        const CompiledSelector &compiled = getCompiledSelector(selector);
+        ElementList results;
+        for (const auto &parts : compiled.alternatives)
+        {
+            for (const Element *element : seedCandidates(parts.back().selector))
+            {
+                if (matchesSelector(element, compiled))
+                {
+                    results.push_back(element);
+                }
+            }
+        }
+        // 逗号分隔的选择器从多个候选列表收集，合并后去重
+        if (compiled.alternatives.size() > 1)
+        {
+            std::sort(results.begin(), results.end(), [](const Element *a, const Element *b)
+                      { return a->order < b->order; });
+            results.erase(std::unique(results.begin(), results.end()), results.end());
+        }
+        return results;
+    }
+
+    // 在线程池中并行验证候选元素，结果与单线程版本相同
+    ElementList querySelectorAll(const std::string &selector, ThreadPool &pool) const
+    {
+        static constexpr size_t CHUNK = 1024;
+        const CompiledSelector &compiled = getCompiledSelector(selector);
+        std::vector<const ElementList *> seeds;
+        for (const auto &parts : compiled.alternatives)
+        {
+            seeds.push_back(&seedCandidates(parts.back().selector));
+        }
+        ElementList results;
+        for (const ElementList *candidates : seeds)
+        {
+            std::vector<ElementList> chunks((candidates->size() + CHUNK - 1) / CHUNK);
+            pool.parallelFor(candidates->size(), CHUNK, [&](size_t begin, size_t end)
+                             {
+                // 编译缓存和 :has() 备忘录都是线程局部的，每个任务在自己的线程上重新取得
+                HasMemoScope hasMemo;
+                const CompiledSelector &local = getCompiledSelector(selector);
+                ElementList &chunk = chunks[begin / CHUNK];
+                for (size_t i = begin; i < end; ++i)
+                {
+                    if (matchesSelector((*candidates)[i], local))
+                    {
+                        chunk.push_back((*candidates)[i]);
+                    }
+                } });
+            for (const auto &chunk : chunks)
+            {
+                results.insert(results.end(), chunk.begin(), chunk.end());
+            }
+        }
+        if (seeds.size() > 1)
+        {
+            std::sort(results.begin(), results.end(), [](const Element *a, const Element *b)
+                      { return a->order < b->order; });
+            results.erase(std::unique(results.begin(), results.end()), results.end());
+        }
+        return results;
+    }
+
+    // 第一个匹配的元素，没有则返回空指针
+    const Element *querySelector(const std::string &selector) const
+    {
+        HasMemoScope hasMemo;
+        const CompiledSelector &compiled = getCompiledSelector(selector);
+        const Element *first = nullptr;
+        for (const auto &parts : compiled.alternatives)
+        {
+            for (const Element *element : seedCandidates(parts.back().selector))
+            {
+                if (first && element->order >= first->order)
+                {
+                    break;
+                }
+                if (matchesSelector(element, compiled))
+                {
+                    first = element;
+                    break;
+                }
+            }
+        }
+        return first;
+    }
+};
+
+#endif
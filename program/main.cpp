@@ -10,85 +10,66 @@
 #include <regex>
 #include <stdexcept>
 #include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
 #include "element.cpp"
 #include "parser.cpp"
 #include "selectormatcher.cpp"
+#include "document.cpp"
+#include "staticselector.cpp"
+#include "selectorvm.cpp"
+#include "pipeline.cpp"
+#include "compression.cpp"
+#include "extraction.cpp"
+#include "output.cpp"
+#include "server.cpp"
+#include "selftest.cpp"
 
-char *readFile(const std::string &filePath)
+// 读入整个文件到 content；gzip/zstd 压缩的文件边读边解压，不需要先解压到临时文件。
+// 按字节长度保存，UTF-16 等含 NUL 字节的文档不会被截断
+bool readFile(const std::string &filePath, std::string &content)
 {
-    std::ifstream fileStream(filePath, std::ios::binary | std::ios::ate);
-    if (!fileStream.is_open())
+    try
     {
-        std::cerr << "无法打开文件: " << std::endl;
-        return nullptr;
+        streamFile(filePath, [&content](const char *data, size_t length)
+                   { content.append(data, length); });
     }
-
-    std::streamsize size = fileStream.tellg();
-    fileStream.seekg(0, std::ios::beg);
-
-    char *buffer = new char[size + 1];
-    if (fileStream.read(buffer, size))
-    {
-        buffer[size] = '\0'; // 添加结束符
-        return buffer;
-    }
-    else
-    {
-        delete[] buffer;
-        return nullptr;
-    }
-}
-
-void removeBlock(char *content, const char *startTag, const char *endTag)
-{
-    char *star = strstr(content, startTag);
-    while (star)
+    catch (const std::exception &e)
     {
-        char *end = strstr(star, endTag);
-        if (!end)
-        {
-            break;
-        }
-
-        end += strlen(endTag);
-        memmove(star, end, strlen(end) + 1); // 删除
-
-        star = strstr(star, startTag); // 寻找下一个开始标签
+        std::cerr << "无法读取文件: " << e.what() << std::endl;
+        return false;
     }
+    return true;
 }
 
-// 简化html
-void simplify(char *c)
-{
-    removeBlock(c, "<!--", "-->"); // 删注释
-    removeBlock(c, "<!DOCTYPE", "html>");
-    removeBlock(c, "<!doctype", "html>");
-    removeBlock(c, "<script", "</script>");
-    removeBlock(c, "<style", "</style>");
-}
-
-void InnerText(const std::shared_ptr<Node> &node)
+void InnerText(const Node *node)
 {
     if (node->nodeType == NodeType::Text)
     {
-        // 转换到 Text 类型以访问 nodeValue
-        auto textNode = std::dynamic_pointer_cast<Text>(node);
-        std::cout << textNode->nodeValue << std::endl;
+        // 按 nodeType 转换到 Text 类型以访问 nodeValue
+        std::cout << static_cast<const Text *>(node)->nodeValue() << std::endl;
     }
     else if (node->nodeType == NodeType::Element)
     {
-        // 转换到 Element 类型以访问子节点
-        auto element = std::dynamic_pointer_cast<Element>(node);
-        for (const auto &child : element->children)
+        // 解析得到的元素直接输出文档文本表中的一段，每个文本节点占一行
+        const auto *element = static_cast<const Element *>(node);
+        if (element->hasTextRange())
+        {
+            std::cout << element->innerTextView() << std::flush;
+        }
+        else
         {
-            InnerText(child); // 递归调用打印子节点的文本
+            std::cout << element->innerText() << std::flush;
         }
     }
 }
 
 void OuterHtml(const std::shared_ptr<Element> &element)
 {
-    element->print(0);
+    // 未修改的元素直接输出源文本中的原始标记
+    std::cout << element->outerHTML() << std::endl;
 }
 
 // 使用
@@ -98,7 +79,7 @@ std::vector<std::shared_ptr<Element>> useSelector(const std::string &selector, c
     return matcher.match(selector);
 }
 
-void Hrefs(const std::shared_ptr<Element> &element)
+void Hrefs(const Element *element)
 {
     if (!element)
     {
@@ -108,22 +89,16 @@ void Hrefs(const std::shared_ptr<Element> &element)
     // 检查当前元素是否为 a 标签
     if (element->tagName == "a")
     {
-        for (const auto &[key, value] : element->attributes)
+        if (const Attribute *href = element->getAttribute(AttributeNames::Href))
         {
-            if (key == "href")
-            {
-                std::cout << "找到href: " << value << std::endl;
-            }
+            std::cout << "找到href: " << href->value() << '\n';
         }
     }
 
     // 递归处理子元素
-    for (const auto &child : element->children)
+    for (const Element *child = element->firstElementChild; child; child = child->nextElementSibling)
     {
-        if (auto childElement = std::dynamic_pointer_cast<Element>(child))
-        {
-            Hrefs(childElement);
-        }
+        Hrefs(child);
     }
 }
 
@@ -140,153 +115,449 @@ bool downloadWithWget(const std::string &url)
 }
 void run();
 
-void Selection(const std::shared_ptr<Element> &root)
+// 打印元素的标签、class 和 id，如 div.card#main
+void printElementSummary(const Element *elem)
 {
-    std::string cssSelector;
-    std::cout << "please input cssSelector: " << std::endl;
-    std::getline(std::cin, cssSelector);
+    std::cout << elem->tagName;
+    // 检查并打印 class 和 id 属性
+    std::istringstream classStream{std::string(elem->className)};
+    std::string className;
+    while (std::getline(classStream, className, ' '))
+    {
+        std::cout << "." << className;
+    }
+    if (!elem->id.empty())
+    {
+        std::cout << "#" << elem->id;
+    }
+    std::cout << std::endl;
+}
 
-    auto matchedElements = useSelector(cssSelector, root);
-    int num = 0;
-    std::cout << "matched elements:" << std::endl;
-    for (const auto &elem : matchedElements)
+// 交互式查询循环：root 是当前的查询范围（选择 4. query 后缩小到选中的元素）。
+// 用户选择更换 HTML 路径时返回 true，退出时返回 false
+bool Selection(std::shared_ptr<Element> root)
+{
+    while (true)
     {
-        if (elem)
+        std::string cssSelector;
+        std::cout << "please input cssSelector: " << std::endl;
+        if (!std::getline(std::cin, cssSelector))
         {
-            if (elem->tagName == "root")
-            {
-                continue;
-            }
-            num++;
-            std::cout << elem->tagName;
-            // 检查并打印 class 和 id 属性
-            for (const auto &[key, value] : elem->attributes)
+            return false;
+        }
+
+        std::vector<std::shared_ptr<Element>> matchedElements;
+        try
+        {
+            matchedElements = useSelector(cssSelector, root);
+        }
+        catch (const std::invalid_argument &e)
+        {
+            // 选择器格式错误时提示后重新输入
+            std::cerr << "选择器错误: " << e.what() << std::endl;
+            continue;
+        }
+        int num = 0;
+        std::cout << "matched elements:" << std::endl;
+        for (const auto &elem : matchedElements)
+        {
+            if (elem)
             {
-                if (key == "class")
+                if (elem->tagName == "root")
                 {
-                    std::istringstream classStream(value);
-                    std::string className;
-                    while (std::getline(classStream, className, ' '))
-                    {
-                        std::cout << "." << className;
-                    }
+                    continue;
                 }
-                else if (key == "id")
+                num++;
+                printElementSummary(elem.get());
+            }
+        }
+        std::cout << "NodeList contains " << num << " elements" << std::endl;
+        std::cout << "choose operation:\n1. innerText\n2. outerHTML\n3. href\n4. query\n5. quit\n6. change path\n7. change cssSelector\n";
+        int option;
+        if (!(std::cin >> option))
+        {
+            return false;
+        }
+        switch (option)
+        {
+        case 1:
+            std::cout << "choose node index (from 0): ";
+            size_t nodeIndex1;
+            std::cin >> nodeIndex1;
+
+            if (nodeIndex1 < matchedElements.size())
+            {
+                auto selected = matchedElements[nodeIndex1];
+                InnerText(selected.get());
+            }
+            else
+            {
+                std::cout << "Invalid node index." << std::endl;
+            }
+            std::cin.ignore(); // 忽略之前的换行符
+            continue;          // 更换 CSS 选择器
+        case 2:
+            std::cout << "choose node index (from 0): ";
+            size_t nodeIndex2;
+            std::cin >> nodeIndex2;
+
+            if (nodeIndex2 < matchedElements.size())
+            {
+                auto selected = matchedElements[nodeIndex2];
+                OuterHtml(selected);
+            }
+            else
+            {
+                std::cout << "Invalid node index." << std::endl;
+            }
+            std::cin.ignore(); // 忽略之前的换行符
+            continue;          // 更换 CSS 选择器
+        case 3:
+            std::cout << "choose node index (from 0): ";
+            size_t nodeIndex3;
+            std::cin >> nodeIndex3;
+
+            if (nodeIndex3 < matchedElements.size())
+            {
+                auto selected = matchedElements[nodeIndex3];
+                if (selected)
                 {
-                    std::cout << "#" << value;
+                    std::cout << "Searching for hrefs..." << std::endl;
+                    Hrefs(selected.get());
                 }
             }
-            std::cout << std::endl;
+            else
+            {
+                std::cout << "Invalid node index." << std::endl;
+            }
+            std::cin.ignore(); // 忽略之前的换行符
+            continue;          // 更换 CSS 选择器
+        case 4:
+            std::cout << "choose node index (from 0): ";
+            size_t nodeIndex4;
+            std::cin >> nodeIndex4;
+
+            if (nodeIndex4 < matchedElements.size())
+            {
+                auto selectedElement = matchedElements[nodeIndex4];
+                std::cin.ignore(); // 忽略之前的换行符
+                root = selectedElement;
+                continue;
+            }
+            std::cout << "Invalid node index." << std::endl;
+            return false;
+        case 5:
+            std::cin.ignore(); // 忽略之前的换行符
+            return false;
+        case 6:
+            std::cin.ignore(); // 忽略之前的换行符
+            return true;       // 由 run 更换 HTML 路径
+        case 7:
+            std::cin.ignore(); // 忽略之前的换行符
+            continue;          // 更换 CSS 选择器
+        default:
+            std::cout << "Invalid option." << std::endl;
+            std::cin.ignore(); // 忽略之前的换行符
+            continue;          // 更换 CSS 选择器
         }
     }
-    std::cout << "NodeList contains " << num << " elements" << std::endl;
-    std::cout << "choose operation:\n1. innerText\n2. outerHTML\n3. href\n4. query\n5. quit\n6. change path\n7. change cssSelector\n";
-    int option;
-    std::cin >> option;
-    switch (option)
+}
+
+void printQueueStats(const char *name, const BoundedQueue<BatchDocument>::Stats &stats)
+{
+    double average = stats.pushes ? static_cast<double>(stats.depthSum) / stats.pushes : 0;
+    std::cerr << name << ": capacity " << stats.capacity << ", max depth " << stats.maxDepth
+              << ", avg depth " << average << ", blocked push " << stats.blockedPushes
+              << ", blocked pop " << stats.blockedPops << std::endl;
+}
+
+// 批处理、提取和服务模式的公共选项
+struct CommandOptions
+{
+    OutputFormat format = OutputFormat::Text;
+    DocumentLimits limits;
+};
+
+// 解析字节数或个数，可带 k/m/g 后缀（按 1024 进位）；格式错误时返回 false
+bool parseSize(const std::string &text, size_t &value)
+{
+    char *end = nullptr;
+    unsigned long long number = std::strtoull(text.c_str(), &end, 10);
+    if (end == text.c_str() || text[0] == '-')
+    {
+        return false;
+    }
+    std::string suffix(end);
+    int shift = suffix.empty() ? 0 : suffix == "k" || suffix == "K" ? 10 : suffix == "m" || suffix == "M" ? 20 : suffix == "g" || suffix == "G" ? 30 : -1;
+    if (shift < 0 || number > (SIZE_MAX >> shift))
     {
-    case 1:
-        std::cout << "choose node index (from 0): ";
-        size_t nodeIndex1;
-        std::cin >> nodeIndex1;
+        return false;
+    }
+    value = static_cast<size_t>(number) << shift;
+    return true;
+}
 
-        if (nodeIndex1 < matchedElements.size())
+// 读取模式参数之后的选项 --format text|jsonl|columnar、--max-bytes N、--max-nodes N，
+// 返回其后第一个参数的下标；选项错误时返回 0
+int parseOptions(int argc, char *argv[], CommandOptions &options)
+{
+    int i = 2;
+    for (; i < argc && std::string(argv[i]).rfind("--", 0) == 0; i += 2)
+    {
+        std::string option = argv[i];
+        if (i + 1 >= argc)
         {
-            auto selected = matchedElements[nodeIndex1];
-            InnerText(selected);
+            std::cerr << "选项缺少参数: " << option << std::endl;
+            return 0;
         }
-        else
+        std::string value = argv[i + 1];
+        if (option == "--format")
         {
-            std::cout << "Invalid node index." << std::endl;
+            if (value == "jsonl")
+            {
+                options.format = OutputFormat::JsonLines;
+            }
+            else if (value == "columnar")
+            {
+                options.format = OutputFormat::Columnar;
+            }
+            else if (value != "text")
+            {
+                std::cerr << "未知的输出格式: " << value << "（可用 text、jsonl、columnar）" << std::endl;
+                return 0;
+            }
         }
-        std::cin.ignore(); // 忽略之前的换行符
-        Selection(root);   // 重新调用 handleUserSelection 以更换 CSS 选择器
-        return;
-    case 2:
-        std::cout << "choose node index (from 0): ";
-        size_t nodeIndex2;
-        std::cin >> nodeIndex2;
-
-        if (nodeIndex2 < matchedElements.size())
+        else if (option == "--max-bytes" || option == "--max-nodes")
         {
-            auto selected = matchedElements[nodeIndex2];
-            OuterHtml(selected);
+            size_t &limit = option == "--max-bytes" ? options.limits.maxBytes : options.limits.maxNodes;
+            if (!parseSize(value, limit) || limit == 0)
+            {
+                std::cerr << "无效的预算: " << option << " " << value << std::endl;
+                return 0;
+            }
         }
         else
         {
-            std::cout << "Invalid node index." << std::endl;
+            std::cerr << "未知的选项: " << option << std::endl;
+            return 0;
         }
-        std::cin.ignore(); // 忽略之前的换行符
-        Selection(root);   // 重新调用 handleUserSelection 以更换 CSS 选择器
-        return;
-    case 3:
-        std::cout << "choose node index (from 0): ";
-        size_t nodeIndex3;
-        std::cin >> nodeIndex3;
+    }
+    return i;
+}
+
+// 报告文档的读取错误和内存占用，返回文档是否可用。设置了预算时输出每个文档的占用；
+// 超出预算的文档（结果是截断的树上的结果）总是报告
+bool reportDocument(const BatchDocument &document, const CommandOptions &options)
+{
+    if (!document.error.empty())
+    {
+        std::cerr << document.path << ": " << document.error << std::endl;
+        return false;
+    }
+    if (document.status != BudgetStatus::Ok)
+    {
+        std::cerr << document.path << ": 超出预算，结果不完整 " << formatUsage(document.status, document.usage) << std::endl;
+    }
+    else if (options.limits.maxBytes || options.limits.maxNodes)
+    {
+        std::cerr << document.path << ": " << formatUsage(document.status, document.usage) << std::endl;
+    }
+    return true;
+}
+
+// 批处理模式：main --batch [选项] <cssSelector> <file>...，按输入顺序输出每个文件的匹配结果，
+// 各阶段队列统计输出到标准错误
+int runBatch(int argc, char *argv[])
+{
+    CommandOptions command;
+    int first = parseOptions(argc, argv, command);
+    if (first == 0 || argc < first + 2)
+    {
+        std::cerr << "用法: " << argv[0] << " --batch [--format text|jsonl|columnar] [--max-bytes N] [--max-nodes N] <cssSelector> <file>..." << std::endl;
+        return 1;
+    }
+    BatchOptions options;
+    options.selector = argv[first];
+    options.limits = command.limits;
+    std::vector<std::string> paths(argv + first + 1, argv + argc);
 
-        if (nodeIndex3 < matchedElements.size())
+    OutputBuffer out(STDOUT_FILENO);
+    auto writer = createResultWriter(command.format, out, nullptr);
+    BatchPipeline pipeline(options);
+    pipeline.run(paths, [&writer, &command](const BatchDocument &document)
+                 {
+        if (!reportDocument(document, command))
+        {
+            return;
+        }
+        if (writer)
         {
-            auto selected = matchedElements[nodeIndex3];
-            if (selected)
+            for (const auto &elem : document.matches)
             {
-                std::cout << "Searching for hrefs..." << std::endl;
-                Hrefs(selected);
+                writer->writeMatch(document.path, elem.get());
             }
+            return;
         }
-        else
+        std::cout << "== " << document.path << " (" << document.matches.size() << ")" << std::endl;
+        for (const auto &elem : document.matches)
         {
-            std::cout << "Invalid node index." << std::endl;
+            printElementSummary(elem.get());
+        } });
+    if (writer)
+    {
+        writer->finish();
+    }
+
+    const auto &metrics = pipeline.metrics();
+    printQueueStats("read queue", metrics.readQueue);
+    printQueueStats("parse queue", metrics.parseQueue);
+    printQueueStats("match queue", metrics.matchQueue);
+    std::cerr << "max reorder buffer: " << metrics.maxReorderBuffer << std::endl;
+    return 0;
+}
+
+// 逐行输出一条记录的字段，嵌套记录的字段名带上路径前缀，如 variants[0].name
+void printRecord(const ExtractedRecord &record, const ExtractionTemplate &extraction, size_t shape, const std::string &prefix)
+{
+    const auto &fields = extraction.record(shape).fields;
+    for (size_t i = 0; i < fields.size(); ++i)
+    {
+        const auto &field = fields[i];
+        for (const auto &value : record.fields[i].values)
+        {
+            std::cout << prefix << field.name << (field.list ? "[]" : "") << ": " << value << '\n';
         }
-        std::cin.ignore(); // 忽略之前的换行符
-        Selection(root);   // 重新调用 handleUserSelection 以更换 CSS 选择器
-        return;
-    case 4:
-        std::cout << "choose node index (from 0): ";
-        size_t nodeIndex4;
-        std::cin >> nodeIndex4;
+        const auto &nested = record.fields[i].records;
+        for (size_t j = 0; j < nested.size(); ++j)
+        {
+            printRecord(nested[j], extraction, field.nested, prefix + field.name + "[" + std::to_string(j) + "].");
+        }
+    }
+}
 
-        if (nodeIndex4 < matchedElements.size())
+// 提取模式：main --extract [选项] <模板文件> <file>...，按模板从每个文件中提取记录，记录之间以 "--" 分隔
+int runExtract(int argc, char *argv[])
+{
+    CommandOptions command;
+    int first = parseOptions(argc, argv, command);
+    if (first == 0 || argc < first + 2)
+    {
+        std::cerr << "用法: " << argv[0] << " --extract [--format text|jsonl|columnar] [--max-bytes N] [--max-nodes N] <templateFile> <file>..." << std::endl;
+        return 1;
+    }
+    std::ifstream templateFile(argv[first], std::ios::binary);
+    if (!templateFile.is_open())
+    {
+        std::cerr << "无法打开模板文件: " << argv[first] << std::endl;
+        return 1;
+    }
+    std::stringstream templateText;
+    templateText << templateFile.rdbuf();
+    BatchOptions options;
+    options.limits = command.limits;
+    try
+    {
+        options.extraction = std::make_shared<const ExtractionTemplate>(ExtractionTemplate::parse(templateText.str()));
+    }
+    catch (const std::invalid_argument &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    std::vector<std::string> paths(argv + first + 1, argv + argc);
+
+    const ExtractionTemplate &extraction = *options.extraction;
+    OutputBuffer out(STDOUT_FILENO);
+    auto writer = createResultWriter(command.format, out, &extraction);
+    BatchPipeline pipeline(options);
+    pipeline.run(paths, [&extraction, &writer, &command](const BatchDocument &document)
+                 {
+        if (!reportDocument(document, command))
         {
-            auto selectedElement = matchedElements[nodeIndex4];
-            std::cin.ignore(); // 忽略之前的换行符
-            Selection(selectedElement);
+            return;
         }
-        else
+        if (writer)
         {
-            std::cout << "Invalid node index." << std::endl;
+            for (const auto &record : document.records)
+            {
+                writer->writeRecord(document.path, record);
+            }
+            return;
         }
-        break;
-    case 5:
-        std::cin.ignore(); // 忽略之前的换行符
-        break;
-    case 6:
-        std::cin.ignore(); // 忽略之前的换行符
-        run();             // 调用 run 函数以更换 HTML 路径
-        return;
-    case 7:
-        std::cin.ignore(); // 忽略之前的换行符
-        Selection(root);   // 重新调用 handleUserSelection 以更换 CSS 选择器
-        return;
-    default:
-        std::cout << "Invalid option." << std::endl;
-        std::cin.ignore(); // 忽略之前的换行符
-        Selection(root);   // 重新调用 handleUserSelection 以更换 CSS 选择器
-        return;
+        std::cout << "== " << document.path << " (" << document.records.size() << ")" << '\n';
+        for (const auto &record : document.records)
+        {
+            printRecord(record, extraction, 0, "");
+            std::cout << "--" << '\n';
+        } });
+    if (writer)
+    {
+        writer->finish();
+    }
+    std::cout.flush();
+    return 0;
+}
+
+// 服务模式：main --serve [--max-bytes N] [--max-nodes N] <socketPath>，或以 - 代替路径在标准输入/输出上服务
+// （协议见 server.cpp）。标准输入模式在输入结束后把延迟统计输出到标准错误
+int runServer(int argc, char *argv[])
+{
+    CommandOptions command;
+    int first = parseOptions(argc, argv, command);
+    if (first == 0 || argc != first + 1 || command.format != OutputFormat::Text)
+    {
+        std::cerr << "用法: " << argv[0] << " --serve [--max-bytes N] [--max-nodes N] <socketPath>|-" << std::endl;
+        return 1;
+    }
+    QueryServer server(defaultThreadPool(), command.limits);
+    try
+    {
+        if (std::string(argv[first]) == "-")
+        {
+            server.serveStdio();
+            std::cerr << server.statistics();
+            return 0;
+        }
+        server.serveSocket(argv[first]);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << std::endl;
     }
+    return 1;
 }
 
-int main()
+int main(int argc, char *argv[])
 {
+    if (argc > 1 && std::string(argv[1]) == "--batch")
+    {
+        return runBatch(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]) == "--extract")
+    {
+        return runExtract(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]) == "--serve")
+    {
+        return runServer(argc, argv);
+    }
+    // 自检：main --self-test [用例名前缀]，见 selftest.cpp
+    if (argc > 1 && std::string(argv[1]) == "--self-test")
+    {
+        return selftest::run(argc > 2 ? argv[2] : "") == 0 ? 0 : 1;
+    }
     run();
     return 0;
 }
 
-void run()
+// 读入一个 HTML 文件并进入查询循环；用户选择更换路径时返回 true
+bool loadAndQuery()
 {
     std::string input;
     std::cout << "请输入HTML文件路径或URL (以http://或https://开头): ";
     std::getline(std::cin, input);
-    char *html = nullptr;
+    std::string html;
+    bool loaded = false;
     std::string tempFile;
     // 添加输入长度检查
     if (input.length() >= 7 && // 确保字符串长度足够检查前缀
@@ -301,29 +572,41 @@ void run()
         if (!downloadWithWget(input))
         {
             std::cerr << "无法下载网页内容" << std::endl;
-            return;
+            return false;
         }
 
         // 读取下载的文件
-        html = readFile(tempFile);
+        loaded = readFile(tempFile, html);
     }
     else
     {
         // 处理本地文件
-        html = readFile(input);
+        loaded = readFile(input, html);
     }
 
-    if (html != nullptr)
+    if (loaded)
     {
-        simplify(html);
         Parser parser;
         auto rootNode = createElement("root");
-        parser.parse(html, rootNode);
-        Selection(rootNode);
-        delete[] html;
+        try
+        {
+            parser.parse(html, rootNode);
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "无法解析文档: " << e.what() << std::endl;
+            return false;
+        }
+        html = std::string();
+        return Selection(rootNode);
     }
-    else
+    std::cerr << "无法读取内容" << std::endl;
+    return false;
+}
+
+void run()
+{
+    while (loadAndQuery())
     {
-        std::cerr << "无法读取内容" << std::endl;
     }
 }
\ No newline at end of file
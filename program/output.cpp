@@ -0,0 +1,610 @@
+#ifndef OUTPUT_CPP
+#define OUTPUT_CPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <stdexcept>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/uio.h>
+#include "element.cpp"
+#include "extraction.cpp"
+
+// 输出缓冲区：小块写入先拷贝到一个大缓冲区，满了才调用一次 writev；
+// 比缓冲区一半还大的块不再拷贝，与缓冲区中的内容一起由同一次 writev 写出。
+// 也可以写到一个字符串中（如服务模式下组装响应）。
+// 不是线程安全的；析构时写出剩余内容（失败时忽略，需要检查错误的调用者应先调用 flush）。
+class OutputBuffer
+{
+public:
+    static constexpr size_t DEFAULT_CAPACITY = 1 << 20;
+
+private:
+    int fd = -1;
+    std::string *target = nullptr; // 非空时写到该字符串而不是 fd
+    std::vector<char> buffer;
+    size_t used = 0;
+
+    // 写出全部 iovec，处理部分写入和 EINTR
+    void writeAll(iovec *parts, int count)
+    {
+        if (target)
+        {
+            for (int i = 0; i < count; ++i)
+            {
+                target->append(static_cast<const char *>(parts[i].iov_base), parts[i].iov_len);
+            }
+            return;
+        }
+        while (count > 0)
+        {
+            ssize_t written = ::writev(fd, parts, count);
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                throw std::runtime_error(std::string("写入输出失败: ") + std::strerror(errno));
+            }
+            size_t remaining = static_cast<size_t>(written);
+            while (count > 0 && remaining >= parts->iov_len)
+            {
+                remaining -= parts->iov_len;
+                ++parts;
+                --count;
+            }
+            if (count > 0)
+            {
+                parts->iov_base = static_cast<char *>(parts->iov_base) + remaining;
+                parts->iov_len -= remaining;
+            }
+        }
+    }
+
+public:
+    explicit OutputBuffer(int descriptor, size_t capacity = DEFAULT_CAPACITY) : fd(descriptor), buffer(capacity) {}
+
+    explicit OutputBuffer(std::string &destination, size_t capacity = 64 * 1024)
+        : target(&destination), buffer(capacity)
+    {
+    }
+
+    OutputBuffer(const OutputBuffer &) = delete;
+    OutputBuffer &operator=(const OutputBuffer &) = delete;
+
+    ~OutputBuffer()
+    {
+        try
+        {
+            flush();
+        }
+        catch (const std::exception &)
+        {
+        }
+    }
+
+    void append(const char *data, size_t length)
+    {
+        if (length <= buffer.size() - used)
+        {
+            std::memcpy(buffer.data() + used, data, length);
+            used += length;
+            return;
+        }
+        if (length < buffer.size() / 2)
+        {
+            flush();
+            std::memcpy(buffer.data(), data, length);
+            used = length;
+            return;
+        }
+        iovec parts[2] = {{buffer.data(), used}, {const_cast<char *>(data), length}};
+        writeAll(used ? parts : parts + 1, used ? 2 : 1);
+        used = 0;
+    }
+
+    void append(std::string_view text)
+    {
+        append(text.data(), text.size());
+    }
+
+    void append(char ch)
+    {
+        if (used == buffer.size())
+        {
+            flush();
+        }
+        buffer[used++] = ch;
+    }
+
+    // 小端 32 位整数
+    void appendU32(uint32_t value)
+    {
+        char bytes[4] = {static_cast<char>(value), static_cast<char>(value >> 8), static_cast<char>(value >> 16),
+                         static_cast<char>(value >> 24)};
+        append(bytes, 4);
+    }
+
+    // 小端 32 位整数数组；小端平台上整块写出
+    void appendU32Array(const std::vector<uint32_t> &values)
+    {
+        const uint32_t probe = 1;
+        if (*reinterpret_cast<const unsigned char *>(&probe) == 1)
+        {
+            append(reinterpret_cast<const char *>(values.data()), values.size() * sizeof(uint32_t));
+            return;
+        }
+        for (uint32_t value : values)
+        {
+            appendU32(value);
+        }
+    }
+
+    void flush()
+    {
+        if (used > 0)
+        {
+            iovec part{buffer.data(), used};
+            used = 0;
+            writeAll(&part, 1);
+        }
+    }
+};
+
+enum class OutputFormat
+{
+    Text,      // 人读的文本（原来的输出方式）
+    JsonLines, // 每个结果一行 JSON
+    Columnar,  // 字典编码的列式二进制格式
+};
+
+// 结果写入器：提取的记录（按模板）或选择器匹配的元素（tag、id、class 三列），
+// 每个结果都带上来源文档 _source
+class ResultWriter
+{
+public:
+    virtual ~ResultWriter() = default;
+    virtual void writeRecord(std::string_view source, const ExtractedRecord &record) = 0;
+    virtual void writeMatch(std::string_view source, const Element *element) = 0;
+    // 写出缓冲的内容；之后不能再写入
+    virtual void finish() = 0;
+};
+
+// JSON Lines：每条记录一个对象，如
+// {"_source":"a.html","title":"Phone","tags":["t1","t2"],"variants":[{"name":"red"}]}
+// 非列表字段没有值时为 null。字符串按 RFC 8259 转义，非 ASCII 字符原样输出（输入已是合法 UTF-8）。
+class JsonLinesWriter : public ResultWriter
+{
+private:
+    OutputBuffer &out;
+    const ExtractionTemplate *extraction;
+
+    // 按连续的无需转义的片段整段写出
+    void writeString(std::string_view text)
+    {
+        static const char HEX[] = "0123456789abcdef";
+        out.append('"');
+        size_t start = 0;
+        for (size_t i = 0; i < text.size(); ++i)
+        {
+            unsigned char ch = static_cast<unsigned char>(text[i]);
+            if (ch >= 0x20 && ch != '"' && ch != '\\')
+            {
+                continue;
+            }
+            out.append(text.data() + start, i - start);
+            start = i + 1;
+            switch (ch)
+            {
+            case '"':
+                out.append("\\\"", 2);
+                break;
+            case '\\':
+                out.append("\\\\", 2);
+                break;
+            case '\n':
+                out.append("\\n", 2);
+                break;
+            case '\r':
+                out.append("\\r", 2);
+                break;
+            case '\t':
+                out.append("\\t", 2);
+                break;
+            default:
+            {
+                char escaped[6] = {'\\', 'u', '0', '0', HEX[ch >> 4], HEX[ch & 0xF]};
+                out.append(escaped, 6);
+                break;
+            }
+            }
+        }
+        out.append(text.data() + start, text.size() - start);
+        out.append('"');
+    }
+
+    void writeKey(std::string_view key, bool first)
+    {
+        if (!first)
+        {
+            out.append(',');
+        }
+        writeString(key);
+        out.append(':');
+    }
+
+    void writeFields(const ExtractedRecord &record, size_t shape, bool first)
+    {
+        const auto &fields = extraction->record(shape).fields;
+        for (size_t i = 0; i < fields.size(); ++i)
+        {
+            const auto &field = fields[i];
+            const auto &result = record.fields[i];
+            writeKey(field.name, first && i == 0);
+            if (field.kind == ExtractKind::Record)
+            {
+                if (!field.list)
+                {
+                    if (result.records.empty())
+                    {
+                        out.append("null", 4);
+                    }
+                    else
+                    {
+                        out.append('{');
+                        writeFields(result.records[0], field.nested, true);
+                        out.append('}');
+                    }
+                    continue;
+                }
+                out.append('[');
+                for (size_t j = 0; j < result.records.size(); ++j)
+                {
+                    out.append(j ? ",{" : "{", j ? 2 : 1);
+                    writeFields(result.records[j], field.nested, true);
+                    out.append('}');
+                }
+                out.append(']');
+            }
+            else if (field.list)
+            {
+                out.append('[');
+                for (size_t j = 0; j < result.values.size(); ++j)
+                {
+                    if (j)
+                    {
+                        out.append(',');
+                    }
+                    writeString(result.values[j]);
+                }
+                out.append(']');
+            }
+            else if (result.values.empty())
+            {
+                out.append("null", 4);
+            }
+            else
+            {
+                writeString(result.values[0]);
+            }
+        }
+    }
+
+    void writeOptional(std::string_view key, std::string_view value)
+    {
+        writeKey(key, false);
+        if (value.empty())
+        {
+            out.append("null", 4);
+        }
+        else
+        {
+            writeString(value);
+        }
+    }
+
+public:
+    // extraction 为空时只能写匹配的元素
+    JsonLinesWriter(OutputBuffer &buffer, const ExtractionTemplate *extractionTemplate)
+        : out(buffer), extraction(extractionTemplate)
+    {
+    }
+
+    void writeRecord(std::string_view source, const ExtractedRecord &record) override
+    {
+        out.append("{\"_source\":", 11);
+        writeString(source);
+        writeFields(record, 0, false);
+        out.append("}\n", 2);
+    }
+
+    void writeMatch(std::string_view source, const Element *element) override
+    {
+        out.append("{\"_source\":", 11);
+        writeString(source);
+        writeKey("tag", false);
+        writeString(element->tagName);
+        writeOptional("id", element->id);
+        writeOptional("class", element->className);
+        out.append("}\n", 2);
+    }
+
+    void finish() override
+    {
+        out.flush();
+    }
+};
+
+// 列式二进制格式（与 Arrow IPC 的字典编码列类似，但更简单）。所有整数都是小端 uint32。
+//
+//     文件   := "CSC1" 列数 列定义* 批* 0
+//     列定义 := 是否列表(1 字节) 名称长度 名称
+//     批     := 行数(>0) 列数据*（按列定义的顺序）
+//     列数据 := 标志(1 字节，1 表示先清空字典) 新增字典项数 (长度 字节)* [偏移 * (行数+1)] 下标数 下标*
+//
+// 每列的字符串存放在跨批累积的字典中，每批只写出新增的字典项，值以字典下标表示，0xFFFFFFFF 表示 null。
+// 列表列额外写出行偏移：第 r 行的值是下标 [偏移[r], 偏移[r+1])。
+// 嵌套记录展开为以 "字段.子字段" 命名的列表列，每个子记录的非列表字段恰好占一项（缺失为 null），
+// 因此同一嵌套记录的各列逐项对齐；子记录中的列表字段直接拼接，不再对齐。
+// 字典超过 MAX_DICTIONARY_BYTES 时在下一批开头清空，内存占用有上界。
+class ColumnarWriter : public ResultWriter
+{
+public:
+    static constexpr uint32_t NULL_INDEX = 0xFFFFFFFFu;
+    static constexpr size_t BATCH_ROWS = 64 * 1024;
+    static constexpr size_t MAX_DICTIONARY_BYTES = 16 << 20;
+
+private:
+    struct Column
+    {
+        std::string name;
+        bool list = false;
+        std::deque<std::string> strings; // 字典项，deque 保证元素地址不变
+        std::unordered_map<std::string_view, uint32_t> dictionary;
+        size_t dictionaryBytes = 0;
+        size_t written = 0; // 已写出的字典项数
+        bool reset = false; // 下一批开头清空字典
+        std::vector<uint32_t> indices;
+        std::vector<uint32_t> offsets{0};
+        bool filled = false; // 非列表列：当前行已有值
+    };
+
+    OutputBuffer &out;
+    const ExtractionTemplate *extraction;
+    std::vector<Column> columns;
+    std::vector<std::vector<size_t>> fieldColumns; // [记录模板][字段] 对应的列
+    size_t rows = 0;
+    bool headerWritten = false;
+
+    void addColumns(size_t shape, const std::string &prefix, bool nested)
+    {
+        const auto &fields = extraction->record(shape).fields;
+        fieldColumns[shape].resize(fields.size());
+        for (size_t i = 0; i < fields.size(); ++i)
+        {
+            const auto &field = fields[i];
+            if (field.kind == ExtractKind::Record)
+            {
+                addColumns(field.nested, prefix + field.name + ".", true);
+                continue;
+            }
+            fieldColumns[shape][i] = columns.size();
+            columns.push_back(Column());
+            columns.back().name = prefix + field.name;
+            columns.back().list = nested || field.list;
+        }
+    }
+
+    uint32_t lookup(Column &column, std::string_view value)
+    {
+        auto it = column.dictionary.find(value);
+        if (it != column.dictionary.end())
+        {
+            return it->second;
+        }
+        uint32_t index = static_cast<uint32_t>(column.strings.size());
+        column.strings.emplace_back(value);
+        column.dictionary.emplace(column.strings.back(), index);
+        column.dictionaryBytes += value.size();
+        return index;
+    }
+
+    // 非列表列取第一个值，列表列追加
+    void add(size_t index, std::string_view value)
+    {
+        Column &column = columns[index];
+        if (!column.list)
+        {
+            if (column.filled)
+            {
+                return;
+            }
+            column.filled = true;
+        }
+        column.indices.push_back(lookup(column, value));
+    }
+
+    void addNull(size_t index)
+    {
+        Column &column = columns[index];
+        if (column.list)
+        {
+            column.indices.push_back(NULL_INDEX);
+        }
+    }
+
+    void fillRecord(const ExtractedRecord &record, size_t shape, bool nested)
+    {
+        const auto &fields = extraction->record(shape).fields;
+        for (size_t i = 0; i < fields.size(); ++i)
+        {
+            const auto &field = fields[i];
+            const auto &result = record.fields[i];
+            if (field.kind == ExtractKind::Record)
+            {
+                for (const auto &child : result.records)
+                {
+                    fillRecord(child, field.nested, true);
+                }
+                continue;
+            }
+            size_t column = fieldColumns[shape][i];
+            if (nested && !field.list && result.values.empty())
+            {
+                addNull(column);
+            }
+            for (const auto &value : result.values)
+            {
+                add(column, value);
+            }
+        }
+    }
+
+    void writeHeader()
+    {
+        out.append("CSC1", 4);
+        out.appendU32(static_cast<uint32_t>(columns.size()));
+        for (const auto &column : columns)
+        {
+            out.append(static_cast<char>(column.list));
+            out.appendU32(static_cast<uint32_t>(column.name.size()));
+            out.append(column.name);
+        }
+        headerWritten = true;
+    }
+
+    void endRow()
+    {
+        for (auto &column : columns)
+        {
+            if (column.list)
+            {
+                column.offsets.push_back(static_cast<uint32_t>(column.indices.size()));
+            }
+            else if (!column.filled)
+            {
+                column.indices.push_back(NULL_INDEX);
+            }
+            column.filled = false;
+        }
+        if (++rows == BATCH_ROWS)
+        {
+            writeBatch();
+        }
+    }
+
+    void writeBatch()
+    {
+        if (!headerWritten)
+        {
+            writeHeader();
+        }
+        if (rows == 0)
+        {
+            return;
+        }
+        out.appendU32(static_cast<uint32_t>(rows));
+        for (auto &column : columns)
+        {
+            out.append(static_cast<char>(column.reset));
+            out.appendU32(static_cast<uint32_t>(column.strings.size() - column.written));
+            for (size_t i = column.written; i < column.strings.size(); ++i)
+            {
+                out.appendU32(static_cast<uint32_t>(column.strings[i].size()));
+                out.append(column.strings[i]);
+            }
+            column.written = column.strings.size();
+            if (column.list)
+            {
+                out.appendU32Array(column.offsets);
+                column.offsets.assign(1, 0);
+            }
+            out.appendU32(static_cast<uint32_t>(column.indices.size()));
+            out.appendU32Array(column.indices);
+            column.indices.clear();
+            column.reset = column.dictionaryBytes > MAX_DICTIONARY_BYTES;
+            if (column.reset)
+            {
+                column.dictionary.clear();
+                column.strings.clear();
+                column.dictionaryBytes = 0;
+                column.written = 0;
+            }
+        }
+        rows = 0;
+    }
+
+public:
+    // extraction 为空时写匹配的元素：_source、tag、id、class 四列
+    ColumnarWriter(OutputBuffer &buffer, const ExtractionTemplate *extractionTemplate)
+        : out(buffer), extraction(extractionTemplate)
+    {
+        columns.push_back(Column());
+        columns.back().name = "_source";
+        if (extraction)
+        {
+            fieldColumns.resize(extraction->recordCount());
+            addColumns(0, "", false);
+        }
+        else
+        {
+            for (const char *name : {"tag", "id", "class"})
+            {
+                columns.push_back(Column());
+                columns.back().name = name;
+            }
+        }
+    }
+
+    void writeRecord(std::string_view source, const ExtractedRecord &record) override
+    {
+        add(0, source);
+        fillRecord(record, 0, false);
+        endRow();
+    }
+
+    void writeMatch(std::string_view source, const Element *element) override
+    {
+        add(0, source);
+        add(1, element->tagName);
+        if (!element->id.empty())
+        {
+            add(2, element->id);
+        }
+        if (!element->className.empty())
+        {
+            add(3, element->className);
+        }
+        endRow();
+    }
+
+    void finish() override
+    {
+        writeBatch();
+        out.appendU32(0);
+        out.flush();
+    }
+};
+
+inline std::unique_ptr<ResultWriter> createResultWriter(OutputFormat format, OutputBuffer &out,
+                                                        const ExtractionTemplate *extraction)
+{
+    switch (format)
+    {
+    case OutputFormat::JsonLines:
+        return std::make_unique<JsonLinesWriter>(out, extraction);
+    case OutputFormat::Columnar:
+        return std::make_unique<ColumnarWriter>(out, extraction);
+    default:
+        return nullptr;
+    }
+}
+
+#endif
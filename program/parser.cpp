@@ -2,565 +2,601 @@
 #define PARSER_CPP
 
 #include "element.cpp"
-#include <stack>
-#include <fstream>
-#include <sstream>
-#include <set>
-#include <regex>
+#include "entities.cpp"
+#include "encoding.cpp"
+#include "tags.cpp"
+#include "treebuilder.cpp"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
 #include <stdexcept>
-#include <cctype>
-
+#include <cstring>
+#include <algorithm>
+
+// HTML 解析器：分词器按位置扫描输入（不再反复截取剩余文本），
+// 把开始标签、结束标签和文本交给 TreeBuilder，由它处理省略的结束标签和错误嵌套。
+// 标签名和属性名不区分大小写，统一转为小写；注释、DOCTYPE 和处理指令被跳过。
+// script 和 style 元素保留在树中，但内容不产生文本节点，不计入 innerText（outerHTMLView 仍能取到原始内容）。
+//
+// 输入可以分块提供：begin(root) 之后多次调用 feed(data, length)，最后调用 finish()。
+// 分块可以在任意位置切开（标签、属性值、字符引用中间都可以），不完整的记号留在内部缓冲区中，
+// 等后续数据到达后继续；打开元素栈、原始文本状态和已扫描的位置在两次 feed 之间保留。
+// parse(text, root) 等价于一次性 feed 整个文档。
+// 字节先经过 InputDecoder 按 BOM 或 <meta charset> 转换为 UTF-8（支持 GBK/GB18030、Big5、UTF-16 等），
+// 文档树中的文本和属性值因此总是合法的 UTF-8。
+// 解码后的源文本保存在文档的 StringArena 中，每个元素记录自己的源文本范围，outerHTMLView 无需重新生成标记。
+// setLimits 设置文档的字节和节点预算：超出预算时解析在当前记号之后停止，之后的输入被丢弃，
+// finish() 照常关闭打开的元素，得到一棵完整但被截断的树；status() 报告停止的原因，usage() 报告占用和峰值。
 class Parser
 {
 private:
-    std::string rawText;
-    size_t index;
-    size_t len;
-    std::vector<std::string> stack;
-    std::shared_ptr<Element> root;
+    enum class MarkupState
+    {
+        Markup,  // '<' 开始一个标签、注释或声明
+        Text,    // '<' 是普通文本
+        Unknown, // 需要更多输入才能判断
+    };
 
-    void removeSpaces()
+    std::string buffer;     // 上次 feed 留下的不完整记号
+    std::string_view input; // 当前正在扫描的输入
+    size_t pos = 0;
+    size_t scanned = 0;      // 当前不完整记号已扫描到的位置，续扫时不必从头开始
+    bool final = false;      // finish() 之后输入不会再增加
+    std::string rawTextTag;  // 正在读取内容的原始文本元素，空表示不在原始文本中
+    InputDecoder decoder;    // 分词之前把输入转换为合法的 UTF-8
+    size_t base = 0;         // input[0] 在文档源文本中的位置
+    bool keepSource = true;  // 保留源文本并记录元素的源文本范围
+    DocumentLimits limits;   // 为 0 的项不限制
+    bool stopped = false;    // 超出预算，不再处理输入
+    std::shared_ptr<StringArena> arena; // 文档的字符串区域，负责内存记账
+    std::unique_ptr<TreeBuilder> builder;
+
+    static bool isSpace(char ch)
     {
-        // 实现移除空格和换行符的逻辑
-        while (index < len && (std::isspace(static_cast<unsigned char>(rawText[index])) || rawText[index] == '\n'))
-        {
-            ++index;
-        }
+        return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r' || ch == '\f';
+    }
 
-        // 更新 rawText 和 len
-        rawText = rawText.substr(index);
-        len = rawText.length();
-        index = 0;
+    static bool isAlpha(char ch)
+    {
+        return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z');
     }
 
-    void sliceText()
+    static char lower(char ch)
     {
-        rawText = rawText.substr(index);
-        len = rawText.length();
-        index = 0;
+        return ch >= 'A' && ch <= 'Z' ? static_cast<char>(ch - 'A' + 'a') : ch;
     }
 
-    std::string parseTag()
+    // 文本节点只保存复制到文档字符串区域的原始文本，合并空白和解码推迟到第一次读取时进行
+    void emitText(std::string_view raw)
     {
-        std::string tag;
-        try
+        bool normalize = whitespace::needsNormalization(raw);
+        if (normalize && whitespace::isBlank(raw))
         {
-            while (index < len && !isspace(rawText[index]) && rawText[index] != '>' && rawText[index] != '/')
-            {
-                tag += rawText[index++];
-            }
+            return;
+        }
+        builder->text(builder->getRoot()->arena->store(raw), normalize);
+    }
+
+    // '<' 之后是否开始一个标签、注释或声明；否则 '<' 按普通文本处理
+    MarkupState markupState(size_t at) const
+    {
+        size_t available = input.size() - at;
+        if (available < 2 || (available < 3 && input[at + 1] == '/'))
+        {
+            return final ? MarkupState::Text : MarkupState::Unknown;
         }
-        catch (const std::out_of_range &e)
+        char next = input[at + 1];
+        if (next == '/')
         {
-            std::cerr << "parseTag错误：" << e.what() << std::endl;
-            throw;
+            return isAlpha(input[at + 2]) ? MarkupState::Markup : MarkupState::Text;
         }
-        return tag;
+        return isAlpha(next) || next == '!' || next == '?' ? MarkupState::Markup : MarkupState::Text;
     }
 
-    std::string removeExtraSpaces(const std::string &input)
+    // 文本一直延续到下一个标记；输入未结束时，文本必须看到其后的标记才算完整
+    bool parseText()
     {
-        std::string result;
-        bool spaceFlag = false;
-        for (char character : input)
+        size_t at = std::max(pos, scanned);
+        while (at < input.size())
         {
-            if (std::isspace(static_cast<unsigned char>(character)))
+            const void *lt = std::memchr(input.data() + at, '<', input.size() - at);
+            if (!lt)
             {
-                if (!spaceFlag)
-                {
-                    result += ' ';
-                    spaceFlag = true;
-                }
+                at = input.size();
+                break;
             }
-            else
+            at = static_cast<size_t>(static_cast<const char *>(lt) - input.data());
+            MarkupState state = markupState(at);
+            if (state == MarkupState::Markup)
             {
-                result += character;
-                spaceFlag = false;
+                break;
+            }
+            if (state == MarkupState::Unknown)
+            {
+                scanned = at;
+                return false;
             }
+            ++at;
         }
-        return result;
-    }
-
-    void parseAttr(std::shared_ptr<Element> ele)
-    {
-        std::string a, b;
-        while (index < len && rawText[index] != '=' && rawText[index] != '>')
+        if (at == input.size() && !final)
         {
-            a += rawText[index++];
+            scanned = at;
+            return false;
         }
+        emitText(input.substr(pos, at - pos));
+        pos = at;
+        scanned = 0;
+        return true;
+    }
 
-        sliceText();
-        if (a.empty())
-            return;
-
-        ++index; // 跳过等号 '='
-        char s = 0;
-        if (rawText[index] == '\'' || rawText[index] == '\"')
+    std::string readName(std::string_view stops)
+    {
+        std::string name;
+        while (pos < input.size() && !isSpace(input[pos]) && stops.find(input[pos]) == std::string_view::npos)
         {
-            s = rawText[index++];
+            name += lower(input[pos++]);
         }
+        return name;
+    }
 
-        while (index < len && rawText[index] != s)
+    void skipSpaces()
+    {
+        while (pos < input.size() && isSpace(input[pos]))
         {
-            b += rawText[index++];
+            ++pos;
         }
-
-        ++index;
-        ele->attributes.emplace_back(a, b);
-        sliceText();
     }
 
-    void parseAttrs(std::shared_ptr<Element> targetElement)
+    // 跳过到 terminator 之后；输入未结束且找不到时返回 false
+    bool skipPast(std::string_view terminator)
     {
-        struct AttrInfo
+        size_t from = std::max(pos, scanned);
+        size_t end = input.find(terminator, from);
+        if (end == std::string_view::npos)
         {
-            std::string name;
-            std::string content;
-        };
-
-        auto skipWhitespace = [&]()
-        {
-            const char whitespaces[] = " \t\n\r";
-            while (index < len && strchr(whitespaces, rawText[index]))
-                index++;
-        };
-
-        auto extractAttrName = [&]() -> AttrInfo
-        {
-            AttrInfo result;
-            std::vector<char> nameBuffer;
-
-            while (index < len)
+            if (!final)
             {
-                char current = rawText[index];
-                if (current == '=' || isspace(current) || current == '>')
-                    break;
-                nameBuffer.push_back(current);
-                ++index;
+                // terminator 可能跨越两次 feed，保留末尾的几个字符重新检查
+                scanned = std::max(pos, input.size() - std::min(input.size(), terminator.size() - 1));
+                return false;
             }
-
-            result.name = std::string(nameBuffer.begin(), nameBuffer.end());
-            return result;
-        };
-
-        auto parseAttrValue = [&](AttrInfo &attr) -> bool
+            pos = input.size();
+        }
+        else
         {
-            if (index >= len || rawText[index] != '=')
-                return false;
-
-            ++index;
-            skipWhitespace();
-
-            if (index >= len)
-                return false;
+            pos = end + terminator.size();
+        }
+        scanned = 0;
+        return true;
+    }
 
-            if (rawText[index] == '\'' || rawText[index] == '\"')
+    // 开始标签是否已经完整（遇到引号外的 '>'），与 parseStartTag 的属性值规则一致
+    bool startTagComplete() const
+    {
+        bool afterEquals = false;
+        for (size_t at = pos + 1; at < input.size(); ++at)
+        {
+            char ch = input[at];
+            if (afterEquals && (ch == '"' || ch == '\''))
             {
-                const char delimiter = rawText[index++];
-                std::stringstream valueStream;
-
-                while (index < len && rawText[index] != delimiter)
+                const void *close = std::memchr(input.data() + at + 1, ch, input.size() - at - 1);
+                if (!close)
                 {
-                    valueStream << rawText[index++];
+                    return false;
                 }
-
-                if (index < len)
-                    ++index;
-                attr.content = valueStream.str();
+                at = static_cast<size_t>(static_cast<const char *>(close) - input.data());
+                afterEquals = false;
+            }
+            else if (ch == '>')
+            {
                 return true;
             }
-            return false;
-        };
-
-        while (index < len && rawText[index] != '>')
-        {
-            skipWhitespace();
-            if (index >= len || rawText[index] == '>')
-                break;
-
-            AttrInfo currentAttr = extractAttrName();
-            if (parseAttrValue(currentAttr) && !currentAttr.name.empty())
+            else if (ch == '=')
+            {
+                afterEquals = true;
+            }
+            else if (!isSpace(ch))
             {
-                targetElement->attributes.emplace_back(currentAttr.name, currentAttr.content);
+                afterEquals = false;
             }
         }
+        return false;
     }
-    const std::set<std::string> selfClosingTags =
-        {"area", "base", "br", "col", "command", "embed", "hr", "img",
-         "input", "keygen", "link", "meta", "param", "source", "track", "wbr",
-         "basefont", "frame", "isindex"};
-    // 判断是否是自闭合标签
-    // 改进后的 isVoidElement 函数
-    bool isVoidElement(const std::string &tag)
-    {
-        static const std::vector<std::string> voidElements = {
-            "area", "base", "br", "col", "command", "embed", "hr", "img",
-            "input", "keygen", "link", "meta", "param", "source", "track", "wbr",
-            "basefont", "frame", "isindex"};
 
-        // 移除前后空白
-        std::string cleanTag = tag;
-        cleanTag.erase(0, cleanTag.find_first_not_of(" \n\r\t"));
-        cleanTag.erase(cleanTag.find_last_not_of(" \n\r\t") + 1);
-
-        return std::find(voidElements.begin(), voidElements.end(), cleanTag) != voidElements.end();
-    }
-
-    void parseElement(std::shared_ptr<Element> parent)
+    // 原始文本元素（script、style、textarea 等）的内容一直延续到对应的结束标签
+    bool parseRawText()
     {
-        try
+        const std::string &tag = rawTextTag;
+        size_t end = std::string_view::npos;
+        size_t undecided = std::string_view::npos;
+        for (size_t at = std::max(pos, scanned); (at = input.find('<', at)) != std::string_view::npos; ++at)
         {
-            if (!parent || index >= len)
+            size_t nameEnd = at + 2 + tag.size();
+            if (nameEnd >= input.size() && !final)
             {
-                return;
+                // 可能是跨越两次 feed 的结束标签
+                undecided = at;
+                break;
             }
-
-            removeSpaces();
-            if (index >= len)
-                return;
-
-            // 解析标签名并添加安全检查
-            std::string tag;
-            while (index < len && rawText[index] != ' ' && rawText[index] != '>' && rawText[index] != '/')
+            if (nameEnd > input.size() || input[at + 1] != '/')
             {
-                tag += rawText[index];
-                ++index;
+                continue;
             }
-
-            // 将标签名中的换行符替换为空格
-            std::replace(tag.begin(), tag.end(), '\n', ' ');
-
-            // 解析标签名并添加安全检查
-            while (index < len && rawText[index] != ' ' && rawText[index] != '>' && rawText[index] != '/')
+            bool same = true;
+            for (size_t i = 0; i < tag.size() && same; ++i)
             {
-                tag += rawText[index];
-                ++index;
+                same = lower(input[at + 2 + i]) == tag[i];
             }
-
-            if (tag.empty())
+            if (same && (nameEnd == input.size() || isSpace(input[nameEnd]) || input[nameEnd] == '>' || input[nameEnd] == '/'))
             {
-                throw std::runtime_error("空标签名");
+                end = at;
+                break;
             }
-
-            auto ele = createElement(tag);
-            ele->parent = parent;
-
-            // 解析属性
-            if (index < len && rawText[index] == ' ')
+        }
+        if (end == std::string_view::npos)
+        {
+            if (!final)
             {
-                parseAttrs(ele);
+                scanned = undecided != std::string_view::npos ? undecided : input.size();
+                return false;
             }
+            end = input.size();
+        }
 
-            // 跳过可能的空格
-            removeSpaces();
-            // 检查是否是自闭合标签
-            bool isVoid = false;
-            if (index < len)
-            {
-                // 获取标签名
-                std::string tagName = ele->tagName;
-                isVoid = isVoidElement(tagName.c_str());
-
-                // 处理显式的自闭合符号 />
-                if (rawText[index] == '/')
-                {
-                    ++index;
-                    removeSpaces();
+        std::string_view content = input.substr(pos, end - pos);
+        if (tag == "textarea" || tag == "title")
+        {
+            emitText(content);
+        }
+        else if (tag != "script" && tag != "style" && !whitespace::isBlank(content))
+        {
+            builder->text(builder->getRoot()->arena->store(content), false);
+        }
+        pos = end;
+        scanned = 0;
+        rawTextTag.clear();
+        return true;
+    }
 
-                    while (index < len && (rawText[index] == ' ' || rawText[index] == '\n'))
-                    {
-                        ++index;
-                    }
+    // 告知树构建器从 start 到当前位置的记号在源文本中的范围
+    void markToken(size_t start)
+    {
+        if (keepSource)
+        {
+            builder->setSourcePosition(base + start, base + pos);
+        }
+    }
 
-                    if (index < len && rawText[index] == '>')
-                    {
-                        ++index;
-                        parent->children.push_back(ele);
-                        return;
-                    }
-                }
-                // 如果是 void element,即使没有 /> 也认为是自闭合的
-                else if (isVoid && rawText[index] == '>')
-                {
-                    ++index;
-                    parent->children.push_back(ele);
-                    return;
-                }
+    bool parseStartTag()
+    {
+        if (!final && !startTagComplete())
+        {
+            return false;
+        }
+        size_t start = pos;
+        ++pos; // 跳过 '<'
+        auto element = createElement(readName("/>"));
+        element->arena = builder->getRoot()->arena;
+        bool selfClosing = false;
+        std::string scratch;
+        while (true)
+        {
+            skipSpaces();
+            if (pos >= input.size())
+            {
+                // 输入在标签中间结束，丢弃这个不完整的标签
+                return true;
             }
-            // 检查普通标签结束
-            if (index < len && rawText[index] == '>')
+            if (input[pos] == '>')
             {
-                ++index;
+                ++pos;
+                break;
             }
-            else
+            if (input[pos] == '/')
             {
-                throw std::runtime_error("标签格式错误");
+                ++pos;
+                if (pos < input.size() && input[pos] == '>')
+                {
+                    ++pos;
+                    selfClosing = true;
+                    break;
+                }
+                continue;
             }
 
-            // 如果是自闭合标签则直接返回
-            if (selfClosingTags.find(tag) != selfClosingTags.end())
+            std::string name;
+            if (input[pos] == '=')
             {
-                parent->children.push_back(ele);
-                return;
+                name += input[pos++];
             }
-
-            // 处理普通标签
-            parent->children.push_back(ele);
-            stack.push_back(tag);
-
-            // 解析子元素
-            while (index < len)
+            name += readName("/>=");
+            skipSpaces();
+            std::string_view value;
+            if (pos < input.size() && input[pos] == '=')
             {
-                removeSpaces();
-                if (index >= len)
-                    break;
-
-                if (rawText[index] == '<')
+                ++pos;
+                skipSpaces();
+                if (pos < input.size() && (input[pos] == '"' || input[pos] == '\''))
                 {
-                    if (index + 1 >= len)
-                        break;
-
-                    ++index;
-                    removeSpaces();
-
-                    if (index < len && rawText[index] == '/')
-                    {
-                        ++index;
-                        removeSpaces();
-
-                        if (stack.empty())
-                        {
-                            throw std::runtime_error("未匹配的结束标签");
-                        }
-
-                        std::string startTag = stack.back();
-                        std::string endTag;
-
-                        // 解析结束标签
-                        while (index < len && rawText[index] != '>' && !isspace(rawText[index]))
-                        {
-                            endTag += rawText[index];
-                            ++index;
-                        }
-                        // 如果结束标签是P，将其转换为小写
-                        if (endTag == "P")
-                        {
-                            std::transform(endTag.begin(), endTag.end(), endTag.begin(), ::tolower);
-                        }
-
-                        // 去除 startTag 和 endTag 中的空格
-                        startTag.erase(std::remove_if(startTag.begin(), startTag.end(), ::isspace), startTag.end());
-                        endTag.erase(std::remove_if(endTag.begin(), endTag.end(), ::isspace), endTag.end());
-
-                        // 打印调试信息
-                        std::cout << "startTag: " << startTag << ", endTag: " << endTag << std::endl;
-                        if (startTag != endTag)
-                        {
-                            throw std::runtime_error("标签不匹配: 期望 </" + startTag + ">, 实际 </" + endTag + ">");
-                        }
-
-                        stack.pop_back();
-                        // 跳过结束标签的 >
-                        while (index < len && rawText[index] != '>')
-                        {
-                            ++index;
-                        }
-                        if (index < len)
-                            ++index;
-                        break;
-                        if (index < len && rawText[index] == '>')
-                        {
-                            ++index;
-                        }
-                        else
-                        {
-                            throw std::runtime_error("标签格式错误");
-                        }
-                    }
-                    else
+                    char delimiter = input[pos++];
+                    size_t start = pos;
+                    const void *end = std::memchr(input.data() + pos, delimiter, input.size() - pos);
+                    pos = end ? static_cast<size_t>(static_cast<const char *>(end) - input.data()) : input.size();
+                    value = input.substr(start, pos - start);
+                    if (pos < input.size())
                     {
-                        parseElement(ele);
+                        ++pos;
                     }
                 }
                 else
                 {
-                    parseText(ele);
+                    size_t start = pos;
+                    while (pos < input.size() && !isSpace(input[pos]) && input[pos] != '>')
+                    {
+                        ++pos;
+                    }
+                    value = input.substr(start, pos - start);
                 }
             }
+            // 重复的属性以第一次出现的为准；没有字符引用的值直接从输入复制到文档的字符串区域
+            if (!name.empty() && !element->getAttribute(name))
+            {
+                element->setAttribute(name, decodeEntities(value, scratch));
+            }
         }
-        catch (const std::out_of_range &e)
+
+        markToken(start);
+        builder->startTag(element, selfClosing);
+        if (isRawTextTag(element->tagName) && !selfClosing)
         {
-            std::cerr << "解析元素越界错误：" << e.what() << std::endl;
-            // throw;
+            rawTextTag = element->tagName;
         }
-        catch (const std::exception &e)
+        return true;
+    }
+
+    bool parseEndTag()
+    {
+        size_t start = pos;
+        pos += 2; // 跳过 "</"
+        std::string tag = readName("/>");
+        if (!skipPast(">"))
         {
-            std::cerr << "解析元素错误：" << e.what() << std::endl;
-            // throw;
+            pos = start;
+            return false;
         }
+        markToken(start);
+        builder->endTag(tag);
+        return true;
     }
 
-    class TextParser
+    bool parseMarkup()
     {
-    private:
-        struct TextAccumulator
+        std::string_view rest = input.substr(pos);
+        if (rest.size() < 4 && !final && std::string_view("<!--").compare(0, rest.size(), rest) == 0)
+        {
+            return false;
+        }
+        size_t start = pos;
+        bool done;
+        if (rest.compare(0, 4, "<!--") == 0)
         {
-            std::string content;
-            void append(char c) { content += c; }
-            bool isEmpty() const { return content.empty(); }
-            void clear() { content.clear(); }
-            std::string get() const { return content; }
-        };
+            pos += 4;
+            done = skipPast("-->");
+        }
+        else if (rest[1] == '!' || rest[1] == '?')
+        {
+            done = skipPast(">");
+        }
+        else if (rest[1] == '/')
+        {
+            return parseEndTag();
+        }
+        else
+        {
+            return parseStartTag();
+        }
+        if (!done)
+        {
+            pos = start;
+        }
+        return done;
+    }
 
-        class TextValidator
+    // 处理 input 中所有完整的记号，pos 停在第一个不完整记号的开头
+    void run()
+    {
+        pos = 0;
+        while (true)
         {
-        public:
-            static bool isTagStart(char curr, char next)
+            // 已扫描的输入在 run 结束后才计入源文本，这里提前把它算进预算
+            if (arena->budgetStatus() != BudgetStatus::Ok || (keepSource && pos > arena->remainingBytes()))
             {
-                return curr == '<' && (std::isalnum(next) || next == '/');
+                arena->exceed(BudgetStatus::ByteLimitExceeded);
+                stopped = true;
+                break;
             }
-
-            static bool shouldContinue(const std::string &text, size_t pos, size_t len)
+            bool done;
+            if (!rawTextTag.empty())
             {
-                if (pos >= len)
-                    return false;
-                if (text[pos] != '<')
-                    return true;
-                return pos + 1 >= len || (!std::isalnum(text[pos + 1]) && text[pos + 1] != '/');
+                done = parseRawText();
             }
-        };
-
-        class TextCleaner
-        {
-        public:
-            static std::string process(const std::string &input)
+            else if (pos >= input.size())
             {
-                std::string result;
-                bool prevSpace = true;
-
-                for (char c : input)
-                {
-                    if (std::isspace(c))
-                    {
-                        if (!prevSpace)
-                        {
-                            result += ' ';
-                            prevSpace = true;
-                        }
-                    }
-                    else
-                    {
-                        result += c;
-                        prevSpace = false;
-                    }
-                }
-
-                if (!result.empty() && result.back() == ' ')
-                {
-                    result.pop_back();
-                }
-
-                return result;
+                break;
             }
-        };
-
-    public:
-        static void parse(const std::string &rawText,
-                          size_t &index,
-                          size_t len,
-                          std::shared_ptr<Element> parent)
-        {
-            if (!parent || index >= len)
+            else if (input[pos] == '<')
             {
-                return;
+                MarkupState state = markupState(pos);
+                done = state == MarkupState::Markup ? parseMarkup()
+                       : state == MarkupState::Text ? parseText()
+                                                    : false;
             }
-
-            try
+            else
             {
-                TextAccumulator accumulator;
-
-                while (TextValidator::shouldContinue(rawText, index, len))
-                {
-                    accumulator.append(rawText[index++]);
-                }
-
-                if (!accumulator.isEmpty())
-                {
-                    std::string cleanedText = TextCleaner::process(accumulator.get());
-                    if (!cleanedText.empty())
-                    {
-                        parent->children.push_back(createTextElement(cleanedText));
-                    }
-                }
+                done = parseText();
             }
-            catch (const std::exception &e)
+            if (!done)
             {
-                std::cerr << "文本解析错误: " << e.what() << std::endl;
-                throw;
+                break;
             }
         }
-    };
+    }
+
+    void checkStarted() const
+    {
+        if (!builder)
+        {
+            throw std::logic_error("解析器尚未开始，请先调用 begin()");
+        }
+    }
 
-    void parseText(std::shared_ptr<Element> parent)
+    // 已处理的输入 [0, pos) 追加到文档的源文本，同时记录内存峰值
+    void commitSource()
     {
-        TextParser::parse(rawText, index, len, parent);
+        arena->notePeak(buffer.capacity());
+        if (keepSource)
+        {
+            arena->appendSource(input.substr(0, pos));
+        }
     }
 
-public:
-    void parse(char *text, std::shared_ptr<Element> rootNode)
+    // 处理一块已解码的 UTF-8
+    void feedUtf8(std::string_view text)
     {
-        if (!text || !rootNode)
+        if (stopped)
         {
             return;
         }
+        if (buffer.empty())
+        {
+            // 没有遗留数据时直接扫描这块数据，只复制末尾不完整的部分
+            input = text;
+            run();
+            commitSource();
+            buffer.assign(input.substr(pos));
+        }
+        else
+        {
+            buffer.append(text);
+            input = buffer;
+            run();
+            commitSource();
+            buffer.erase(0, pos);
+        }
+        if (!stopped && buffer.size() > arena->remainingBytes())
+        {
+            // 不完整的记号已经超出预算（如被分块传入的超长属性值），不必等它结束
+            arena->exceed(BudgetStatus::ByteLimitExceeded);
+            stopped = true;
+        }
+        if (stopped)
+        {
+            // 超出预算之后的输入不再处理
+            std::string().swap(buffer);
+        }
+        base += pos;
+        scanned = scanned > pos ? scanned - pos : 0;
+        pos = 0;
+        input = std::string_view();
+    }
 
-        try
+public:
+    // 开始解析一个新文档，元素追加到 rootNode 之下；charset 是文档没有声明编码时使用的编码
+    void begin(const std::shared_ptr<Element> &rootNode, Charset charset = Charset::Unknown)
+    {
+        if (!rootNode)
         {
-            rawText = std::string(text);
-            // 移除前后空格
-            if (!rawText.empty())
-            {
-                size_t start = rawText.find_first_not_of(" \n\r\t\f\v");
-                if (start != std::string::npos)
-                {
-                    size_t end = rawText.find_last_not_of(" \n\r\t\f\v");
-                    rawText = rawText.substr(start, end - start + 1);
-                }
-            }
+            throw std::invalid_argument("空节点");
+        }
+        // 整个文档的属性值共用根节点的字符串区域
+        if (!rootNode->arena)
+        {
+            rootNode->arena = std::make_shared<StringArena>();
+        }
+        arena = rootNode->arena;
+        if (limits.maxBytes != 0 || limits.maxNodes != 0)
+        {
+            arena->setLimits(limits);
+        }
+        buffer.clear();
+        base = rootNode->arena->source().size();
+        scanned = 0;
+        final = false;
+        stopped = false;
+        rawTextTag.clear();
+        decoder = InputDecoder(charset);
+        builder = std::make_unique<TreeBuilder>(rootNode);
+    }
 
-            len = rawText.length();
-            index = 0;
-            stack.clear();
+    // 是否保留源文本以支持 Element::outerHTMLView，默认保留；在 begin 之前设置
+    void setKeepSource(bool keep)
+    {
+        keepSource = keep;
+    }
 
-            while (index < len)
-            {
-                removeSpaces();
-                if (index < len)
-                { // 添加边界检查
-                    if (rawText[index] == '<')
-                    {
-                        index++;
-                        if (index < len)
-                        { // 添加边界检查
-                            parseElement(rootNode);
-                        }
-                    }
-                    else
-                    {
-                        parseText(rootNode);
-                    }
-                }
-            }
-        }
-        catch (const std::out_of_range &e)
+    // 文档的字节和节点预算；在 begin 之前设置，begin 时应用到文档的 StringArena
+    void setLimits(const DocumentLimits &documentLimits)
+    {
+        limits = documentLimits;
+    }
+
+    // 追加一块任意编码的输入；完整的记号立即进入文档树
+    void feed(const char *data, size_t length)
+    {
+        checkStarted();
+        feedUtf8(decoder.decode(data, length, false));
+    }
+
+    // 输入结束：处理剩余数据，仍然打开的元素在此隐式关闭
+    void finish()
+    {
+        checkStarted();
+        if (!stopped)
         {
-            std::cerr << "解析错误：字符串访问越界 - " << e.what() << std::endl;
+            feedUtf8(decoder.decode(nullptr, 0, true));
+            final = true;
+            input = buffer;
+            run();
+            commitSource();
         }
-        catch (const std::exception &e)
+        markToken(pos);
+        builder->finish();
+        builder.reset();
+        buffer.clear();
+        input = std::string_view();
+    }
+
+    // 解析是否因超出预算而提前停止
+    BudgetStatus status() const
+    {
+        return arena ? arena->budgetStatus() : BudgetStatus::Ok;
+    }
+
+    // 最近一个文档的内存占用和峰值
+    DocumentUsage usage() const
+    {
+        return arena ? arena->usage() : DocumentUsage();
+    }
+
+    // 识别出的文档编码；读到足够的输入之前为 Charset::Unknown
+    Charset getCharset() const
+    {
+        return decoder.charset();
+    }
+
+    // 文本按给定长度解析，可以包含 NUL 字节（UTF-16 输入）
+    void parse(std::string_view text, std::shared_ptr<Element> rootNode)
+    {
+        if (!rootNode)
         {
-            std::cerr << "解析错误：" << e.what() << std::endl;
+            return;
         }
+        begin(rootNode);
+        feed(text.data(), text.size());
+        finish();
     }
+
     void printParsedTree(std::shared_ptr<Element> root) const
     {
         if (root)
@@ -570,4 +606,4 @@ public:
     }
 };
 
-#endif
\ No newline at end of file
+#endif
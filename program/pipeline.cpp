@@ -0,0 +1,405 @@
+#ifndef PIPELINE_CPP
+#define PIPELINE_CPP
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <fstream>
+#include <filesystem>
+#include <cstdint>
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#include "element.cpp"
+#include "parser.cpp"
+#include "compression.cpp"
+#include "selectormatcher.cpp"
+#include "extraction.cpp"
+
+// 有界阻塞队列：队列满时生产者等待（反压），close() 之后消费者取完剩余元素即结束。
+// 每次入队时记录队列深度，用于调节各阶段的队列容量和线程数。
+template <typename T>
+class BoundedQueue
+{
+public:
+    struct Stats
+    {
+        size_t capacity = 0;
+        size_t maxDepth = 0;
+        uint64_t pushes = 0;
+        uint64_t depthSum = 0;      // 每次入队后的深度之和，除以 pushes 得到平均深度
+        uint64_t blockedPushes = 0; // 因队列已满而等待的入队次数
+        uint64_t blockedPops = 0;   // 因队列为空而等待的出队次数
+    };
+
+private:
+    std::deque<T> items;
+    mutable std::mutex mutex;
+    std::condition_variable notFull;
+    std::condition_variable notEmpty;
+    bool closed = false;
+    Stats statistics;
+
+public:
+    explicit BoundedQueue(size_t capacity)
+    {
+        statistics.capacity = capacity == 0 ? 1 : capacity;
+    }
+
+    void push(T item)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (items.size() >= statistics.capacity)
+        {
+            ++statistics.blockedPushes;
+            notFull.wait(lock, [this]
+                         { return items.size() < statistics.capacity; });
+        }
+        items.push_back(std::move(item));
+        ++statistics.pushes;
+        statistics.depthSum += items.size();
+        statistics.maxDepth = std::max(statistics.maxDepth, items.size());
+        notEmpty.notify_one();
+    }
+
+    // 取出一个元素；队列已关闭且为空时返回 false
+    bool pop(T &item)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (items.empty() && !closed)
+        {
+            ++statistics.blockedPops;
+            notEmpty.wait(lock, [this]
+                          { return !items.empty() || closed; });
+        }
+        if (items.empty())
+        {
+            return false;
+        }
+        item = std::move(items.front());
+        items.pop_front();
+        notFull.notify_one();
+        return true;
+    }
+
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        notEmpty.notify_all();
+    }
+
+    Stats stats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return statistics;
+    }
+};
+
+// 批处理中的一个文档，依次流经各阶段
+struct BatchDocument
+{
+    size_t index = 0; // 在输入列表中的位置，输出按它排序
+    std::string path;
+    std::vector<char> content; // 文件内容（可能是 gzip/zstd 压缩的），解析后释放
+    std::shared_ptr<Element> root;
+    std::vector<std::shared_ptr<Element>> matches;
+    std::vector<ExtractedRecord> records; // 设置了提取模板时的提取结果
+    BudgetStatus status = BudgetStatus::Ok; // 解析是否因超出预算而提前停止（此时 root 是截断的树）
+    DocumentUsage usage;                    // 文档的内存占用，峰值包括解析期间持有的文件内容
+    std::string error; // 非空表示读取或解析失败，后续阶段直接传递
+};
+
+struct BatchOptions
+{
+    std::string selector;
+    std::shared_ptr<const ExtractionTemplate> extraction; // 非空时匹配阶段按模板提取记录，而不是匹配 selector
+    DocumentLimits limits;    // 每个文档的字节和节点预算
+    size_t readers = 2;       // 预读线程数
+    size_t parsers = 2;       // 解压 + 解析线程数
+    size_t matchers = 1;      // 匹配线程数
+    size_t queueCapacity = 4; // 每个阶段之间最多排队的文档数
+};
+
+// 一行文档占用报告，如 "status=ok nodes=120 bytes=52000 peak_bytes=81000"
+inline std::string formatUsage(BudgetStatus status, const DocumentUsage &usage)
+{
+    const char *name = status == BudgetStatus::NodeLimitExceeded   ? "node-limit"
+                       : status == BudgetStatus::ByteLimitExceeded ? "byte-limit"
+                                                                   : "ok";
+    return std::string("status=") + name + " nodes=" + std::to_string(usage.nodes) +
+           " bytes=" + std::to_string(usage.bytes) + " peak_bytes=" + std::to_string(usage.peakBytes);
+}
+
+// 批处理流水线：读取 → 解压 + 解析 → 匹配 → 按输入顺序输出。
+// 阶段之间是有界队列，同时在途的文档数不超过各队列容量与线程数之和，内存占用有上界；
+// 读取线程提前读入后面的文件，使磁盘 I/O 与解析、匹配重叠。
+// 输出阶段需要按输入顺序等待较慢的文档，读取线程因此最多领先已输出的文档一个固定窗口。
+// 各阶段线程在队列上阻塞等待，因此使用独立线程而不是线程池任务。
+class BatchPipeline
+{
+public:
+    using Emit = std::function<void(const BatchDocument &)>;
+
+    struct Metrics
+    {
+        BoundedQueue<BatchDocument>::Stats readQueue;
+        BoundedQueue<BatchDocument>::Stats parseQueue;
+        BoundedQueue<BatchDocument>::Stats matchQueue;
+        size_t maxReorderBuffer = 0; // 输出阶段等待前序文档时暂存的最大文档数
+    };
+
+private:
+    BatchOptions options;
+    Metrics lastMetrics;
+
+    // 解析超出预算后中止读取和解压
+    struct BudgetStop
+    {
+    };
+
+    // source(sink) 把（解压后的）文档分块交给 sink，各块边到达边解析
+    template <typename Source>
+    static void parseStream(BatchDocument &document, const DocumentLimits &limits, Source source)
+    {
+        Parser parser;
+        parser.setLimits(limits);
+        document.root = createElement("root");
+        parser.begin(document.root);
+        try
+        {
+            source([&parser](const char *data, size_t length)
+                   {
+                parser.feed(data, length);
+                if (parser.status() != BudgetStatus::Ok)
+                {
+                    throw BudgetStop();
+                } });
+        }
+        catch (const BudgetStop &)
+        {
+        }
+        parser.finish();
+        document.status = parser.status();
+        document.usage = parser.usage();
+        document.usage.peakBytes += document.content.capacity();
+    }
+
+    template <typename Work>
+    static void runStage(std::vector<std::thread> &threads, size_t count, BoundedQueue<BatchDocument> &input,
+                         BoundedQueue<BatchDocument> &output, Work work)
+    {
+        auto remaining = std::make_shared<std::atomic<size_t>>(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            threads.emplace_back([&input, &output, work, remaining]
+                                 {
+                BatchDocument document;
+                while (input.pop(document))
+                {
+                    if (document.error.empty())
+                    {
+                        try
+                        {
+                            work(document);
+                        }
+                        catch (const std::exception &e)
+                        {
+                            document.error = e.what();
+                        }
+                    }
+                    output.push(std::move(document));
+                }
+                // 最后一个线程退出时关闭下游队列
+                if (--*remaining == 0)
+                {
+                    output.close();
+                } });
+        }
+    }
+
+public:
+    // 把 document.path 的内容读入 document.content，失败时设置 document.error，不抛出异常。
+    // 按块读到文件结束，管道等不能预先取得大小的文件同样可用；能取得大小时预先分配。
+    // 压缩文件按压缩数据读入，解压推迟到解析阶段边解压边解析
+    static void readDocument(BatchDocument &document)
+    {
+        static constexpr size_t CHUNK = 64 * 1024;
+        try
+        {
+            std::error_code error;
+            if (std::filesystem::is_directory(document.path, error))
+            {
+                document.error = "是目录，不是文件";
+                return;
+            }
+            std::ifstream fileStream(document.path, std::ios::binary);
+            if (!fileStream.is_open())
+            {
+                document.error = "无法打开文件";
+                return;
+            }
+            std::uintmax_t size = std::filesystem::file_size(document.path, error);
+            if (!error)
+            {
+                document.content.reserve(static_cast<size_t>(size) + CHUNK);
+            }
+            size_t used = 0;
+            while (fileStream)
+            {
+                document.content.resize(used + CHUNK);
+                fileStream.read(document.content.data() + used, static_cast<std::streamsize>(CHUNK));
+                used += static_cast<size_t>(fileStream.gcount());
+            }
+            document.content.resize(used);
+            if (fileStream.bad())
+            {
+                document.error = "读取文件失败";
+            }
+        }
+        catch (const std::exception &e)
+        {
+            document.error = std::string("读取文件失败: ") + e.what();
+        }
+        if (!document.error.empty())
+        {
+            std::vector<char>().swap(document.content);
+        }
+    }
+
+    // 解析 document.content（可能是 gzip/zstd 压缩的），边解压边解析，只多占用一个解压块；
+    // 结果放入 document.root，之后释放 content。超出 limits 时得到截断的树，document.status 报告原因
+    static void parseDocument(BatchDocument &document, const DocumentLimits &limits = DocumentLimits())
+    {
+        std::string_view raw(document.content.data(), document.content.size());
+        parseStream(document, limits, [raw](const Decompressor::Sink &sink)
+                    { decompressTo(raw, sink); });
+        std::vector<char>().swap(document.content);
+    }
+
+    // 直接从 document.path 分块读取、解压并解析，文件内容不整体进入内存；读取失败时抛出 std::runtime_error
+    static void parseFile(BatchDocument &document, const DocumentLimits &limits = DocumentLimits())
+    {
+        parseStream(document, limits, [&document](const Decompressor::Sink &sink)
+                    { streamFile(document.path, sink); });
+    }
+
+    explicit BatchPipeline(BatchOptions batchOptions)
+        : options(std::move(batchOptions))
+    {
+    }
+
+    // 处理 paths 中的全部文件，在调用线程上按输入顺序对每个文档调用 emit
+    void run(const std::vector<std::string> &paths, const Emit &emit)
+    {
+        BoundedQueue<BatchDocument> readQueue(options.queueCapacity);
+        BoundedQueue<BatchDocument> parseQueue(options.queueCapacity);
+        BoundedQueue<BatchDocument> matchQueue(options.queueCapacity);
+        std::vector<std::thread> threads;
+
+        // 同时在途（已开始读取但尚未输出）的文档数上限
+        size_t window = 3 * options.queueCapacity + options.readers + options.parsers + options.matchers;
+        std::mutex windowMutex;
+        std::condition_variable windowMoved;
+        size_t emitted = 0;
+
+        std::atomic<size_t> nextPath{0};
+        auto readersLeft = std::make_shared<std::atomic<size_t>>(std::max<size_t>(options.readers, 1));
+        for (size_t i = 0; i < std::max<size_t>(options.readers, 1); ++i)
+        {
+            threads.emplace_back([&, readersLeft]
+                                 {
+                for (size_t index = nextPath++; index < paths.size(); index = nextPath++)
+                {
+                    {
+                        std::unique_lock<std::mutex> lock(windowMutex);
+                        windowMoved.wait(lock, [&]
+                                         { return index < emitted + window; });
+                    }
+                    BatchDocument document;
+                    document.index = index;
+                    document.path = paths[index];
+                    readDocument(document);
+                    readQueue.push(std::move(document));
+                }
+                if (--*readersLeft == 0)
+                {
+                    readQueue.close();
+                } });
+        }
+
+        runStage(threads, std::max<size_t>(options.parsers, 1), readQueue, parseQueue, [this](BatchDocument &document)
+                 { parseDocument(document, options.limits); });
+
+        const std::string &selector = options.selector;
+        const auto &extraction = options.extraction;
+        runStage(threads, std::max<size_t>(options.matchers, 1), parseQueue, matchQueue, [&selector, &extraction](BatchDocument &document)
+                 {
+            if (extraction)
+            {
+                document.records = extraction->extract(document.root);
+                return;
+            }
+            CssSelectorMatcher matcher(document.root);
+            document.matches = matcher.match(selector); });
+
+        // 输出阶段：匹配线程可能乱序完成，暂存到前序文档输出为止
+        std::map<size_t, BatchDocument> reorder;
+        size_t nextIndex = 0;
+        size_t maxReorder = 0;
+        BatchDocument document;
+        std::exception_ptr error;
+        while (matchQueue.pop(document))
+        {
+            reorder.emplace(document.index, std::move(document));
+            maxReorder = std::max(maxReorder, reorder.size());
+            for (auto it = reorder.find(nextIndex); it != reorder.end(); it = reorder.find(++nextIndex))
+            {
+                if (!error)
+                {
+                    try
+                    {
+                        emit(it->second);
+                    }
+                    catch (...)
+                    {
+                        // 继续排空队列，让上游线程正常结束后再抛出
+                        error = std::current_exception();
+                    }
+                }
+                reorder.erase(it);
+                std::lock_guard<std::mutex> lock(windowMutex);
+                emitted = nextIndex + 1;
+                windowMoved.notify_all();
+            }
+        }
+        for (auto &thread : threads)
+        {
+            thread.join();
+        }
+
+        lastMetrics.readQueue = readQueue.stats();
+        lastMetrics.parseQueue = parseQueue.stats();
+        lastMetrics.matchQueue = matchQueue.stats();
+        lastMetrics.maxReorderBuffer = maxReorder;
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+    }
+
+    // 最近一次 run 的各阶段队列统计
+    const Metrics &metrics() const
+    {
+        return lastMetrics;
+    }
+};
+
+#endif
@@ -1,33 +1,118 @@
 #ifndef SELECOTRMATCHER_CPP
 #define SELECOTRMATCHER_CPP
 
-#include <iostream>
 #include <string>
 #include <vector>
 #include <memory>
 #include <set>
 #include <stdexcept>
 #include <cctype>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <functional>
 #include "element.cpp"
 #include "parser.cpp"
+#include "attributeselector.cpp"
 
-bool isChineseCharacter(char ch)
+// 跟踪括号、方括号和引号的嵌套，用于判断某个字符是否处于选择器的顶层
+struct SelectorNesting
 {
-    // 检查字符是否是中文字符
-    return (ch & 0x80) != 0;
+    int depth = 0;
+    char quote = 0;
+
+    // 处理一个字符，返回该字符是否位于顶层（不在任何括号或引号内）
+    bool step(char ch)
+    {
+        if (quote)
+        {
+            if (ch == quote)
+            {
+                quote = 0;
+            }
+            return false;
+        }
+        if (depth > 0 && (ch == '"' || ch == '\''))
+        {
+            quote = ch;
+            return false;
+        }
+        if (ch == '(' || ch == '[')
+        {
+            return depth++ == 0;
+        }
+        if ((ch == ')' || ch == ']') && depth > 0)
+        {
+            --depth;
+            return false;
+        }
+        return depth == 0;
+    }
+};
+
+// 查找位于顶层的字符，如 a[href^="https:"]:first-child 中伪类的冒号
+size_t findOutsideBrackets(const std::string &text, char target)
+{
+    SelectorNesting nesting;
+    for (size_t i = 0; i < text.size(); ++i)
+    {
+        if (nesting.step(text[i]) && text[i] == target)
+        {
+            return i;
+        }
+    }
+    return std::string::npos;
+}
+
+// 将复合选择器拆分为标签、.类、#ID、[属性] 和 :伪类 原子
+std::vector<std::string> splitCompound(const std::string &compound)
+{
+    std::vector<std::string> atoms;
+    std::string current;
+    SelectorNesting nesting;
+    for (char ch : compound)
+    {
+        bool topLevel = nesting.step(ch);
+        bool pseudoStart = ch == ':' && current != ":"; // :: 伪元素的两个冒号属于同一个原子
+        if (topLevel && (ch == '.' || ch == '#' || ch == '[' || pseudoStart) && !current.empty())
+        {
+            atoms.push_back(current);
+            current.clear();
+        }
+        if (topLevel && ch == ' ')
+        {
+            continue;
+        }
+        current += ch;
+    }
+    if (!current.empty())
+    {
+        atoms.push_back(current);
+    }
+    // 解析器把标签名转为小写，类型选择器同样转为小写，匹配时不区分大小写
+    if (!atoms.empty() && !std::strchr(".#[:", atoms.front()[0]))
+    {
+        std::transform(atoms.front().begin(), atoms.front().end(), atoms.front().begin(),
+                       [](unsigned char ch)
+                       { return static_cast<char>(std::tolower(ch)); });
+    }
+    return atoms;
 }
 
 // 将CSS选择器字符串分解为标记tokens，处理特殊字符：'>', '+', '~', ',', ' '用于后续的选择器匹配
+// 括号、方括号和引号内的字符（如 :nth-child(2n+1)、[title="a b"]）不作为组合符处理。
 // text - 输入的CSS选择器字符串，返回包含所有标记的字符串向量。
 std::vector<std::string> tokenize(const std::string &text)
 {
     std::vector<std::string> tokens;
     std::string current;
+    SelectorNesting nesting;
     // 遍历选择器字符串的每个字符
     for (char ch : text)
     {
+        bool topLevel = nesting.step(ch);
         // 检查是否是特殊字符（选择器组合符）
-        if (ch == '>' || ch == '+' || ch == '~' || ch == ',' || ch == ' ')
+        if (topLevel && (ch == '>' || ch == '+' || ch == '~' || ch == ',' || ch == ' '))
         {
             // 如果当前标记不为空，先保存它
             if (!current.empty())
@@ -50,148 +135,267 @@ std::vector<std::string> tokenize(const std::string &text)
     return tokens;
 }
 
-bool MatchSelector(const std::shared_ptr<Element> &element, const std::string &selector)
+// 解析 an+b 表达式（包括 odd、even），成功返回 true
+bool parseNth(std::string expression, int &a, int &b)
 {
-    // 实现五个选择器，分别是:root,:empty,::first-letter,:lang(language),:not(),
-    if (selector == "*")
+    expression.erase(std::remove_if(expression.begin(), expression.end(), ::isspace), expression.end());
+    std::transform(expression.begin(), expression.end(), expression.begin(), ::tolower);
+    if (expression == "odd")
     {
+        a = 2;
+        b = 1;
         return true;
     }
-    else if (selector == ":root")
+    if (expression == "even")
     {
-        // 打印 parent 是否为空，并输出该元素的 tagName
-        return element->tagName == "html";
+        a = 2;
+        b = 0;
+        return true;
     }
 
-    // 处理:empty伪类
-    size_t colonPos = selector.find(':');
-    if (colonPos != std::string::npos)
+    size_t nPos = expression.find('n');
+    try
     {
-        std::string baseSelector = selector.substr(0, colonPos);
-        std::string pseudoClass = selector.substr(colonPos + 1);
-
-        // 处理双冒号伪元素选择器
-        if (pseudoClass.find(':') == 0)
+        size_t used = 0;
+        if (nPos == std::string::npos)
         {
-            pseudoClass = pseudoClass.substr(1);
+            a = 0;
+            b = std::stoi(expression, &used);
+            return used == expression.size();
         }
-
-        if (pseudoClass == "empty")
+        std::string coefficient = expression.substr(0, nPos);
+        if (coefficient.empty() || coefficient == "+")
         {
-            if (!baseSelector.empty() && baseSelector != element->tagName)
-            {
-                return false;
-            }
-            return element->children.empty();
+            a = 1;
         }
-        else if (pseudoClass.find("lang(") == 0)
+        else if (coefficient == "-")
         {
-            size_t openParenPos = pseudoClass.find('(');
-            size_t closeParenPos = pseudoClass.find(')');
-            if (openParenPos != std::string::npos && closeParenPos != std::string::npos)
-            {
-                std::string langValue = pseudoClass.substr(openParenPos + 1, closeParenPos - openParenPos - 1);
-                if (!baseSelector.empty() && baseSelector != element->tagName)
-                {
-                    return false;
-                }
-                bool langFound = false;
-                for (const auto &[key, value] : element->attributes)
-                {
-                    if (key == "lang" && value == langValue)
-                    {
-                        langFound = true;
-                        break;
-                    }
-                }
-                return langFound;
-            }
+            a = -1;
         }
-        else if (pseudoClass == "first-letter")
+        else
         {
-            if (!baseSelector.empty() && baseSelector != element->tagName)
+            a = std::stoi(coefficient, &used);
+            if (used != coefficient.size())
             {
                 return false;
             }
-            // 检查第一个子节点是否是文本节点，并且文本节点的第一个字符是否存在
-            if (!element->children.empty())
-            {
-                auto firstChild = std::dynamic_pointer_cast<Text>(element->children.front());
-                if (firstChild && !firstChild->nodeValue.empty())
-                {
-                    // 打印第一个字符，无论是英文还是中文
-                    std::cout << "First letter: " << firstChild->nodeValue[0];
-                    if (isChineseCharacter(firstChild->nodeValue[0]))
-                    {
-                        std::cout << firstChild->nodeValue[1] << firstChild->nodeValue[2];
-                    }
-                    std::cout << std::endl;
-                    return true;
-                }
-            }
+        }
+        std::string offset = expression.substr(nPos + 1);
+        if (offset.empty())
+        {
+            b = 0;
+            return true;
+        }
+        if (offset[0] != '+' && offset[0] != '-')
+        {
             return false;
         }
-        else if (pseudoClass.find("not(") == 0)
+        b = std::stoi(offset, &used);
+        return used == offset.size();
+    }
+    catch (const std::exception &)
+    {
+        return false;
+    }
+}
+
+// position 从 1 开始，判断是否存在 n >= 0 使 a*n + b == position
+bool matchesNth(int a, int b, int position)
+{
+    if (a == 0)
+    {
+        return position == b;
+    }
+    int diff = position - b;
+    return diff % a == 0 && diff / a >= 0;
+}
+
+// 结构伪类：直接读取元素上缓存的兄弟位置，不扫描兄弟列表
+bool isStructuralPseudoClass(const std::string &pseudoClass)
+{
+    return pseudoClass == "first-child" || pseudoClass == "last-child" || pseudoClass == "only-child" ||
+           pseudoClass == "first-of-type" || pseudoClass == "last-of-type" ||
+           pseudoClass.find("nth-child(") == 0 || pseudoClass.find("nth-last-child(") == 0 ||
+           pseudoClass.find("nth-of-type(") == 0;
+}
+
+bool matchStructuralPseudoClass(const Element *element, const std::string &pseudoClass)
+{
+    const Element *parent = element->parentElement;
+    if (!parent)
+    {
+        return false;
+    }
+    int position = static_cast<int>(element->siblingIndex) + 1;
+    int count = static_cast<int>(parent->childElementCount);
+
+    if (pseudoClass == "first-child")
+    {
+        return position == 1;
+    }
+    if (pseudoClass == "last-child")
+    {
+        return position == count;
+    }
+    if (pseudoClass == "only-child")
+    {
+        return count == 1;
+    }
+    if (pseudoClass == "first-of-type")
+    {
+        return element->typeIndex == 0;
+    }
+    if (pseudoClass == "last-of-type")
+    {
+        for (const Element *sibling = element->nextElementSibling; sibling; sibling = sibling->nextElementSibling)
         {
-            size_t openParenPos = pseudoClass.find('(');
-            size_t closeParenPos = pseudoClass.find(')');
-            if (openParenPos != std::string::npos && closeParenPos != std::string::npos)
+            if (sibling->tagName == element->tagName)
             {
-                std::string notSelector = pseudoClass.substr(openParenPos + 1, closeParenPos - openParenPos - 1);
-                return !MatchSelector(element, notSelector);
+                return false;
             }
         }
+        return true;
     }
 
-    std::string NormSelector;
-    // 标准化
-    for (char ch : selector)
+    size_t openParenPos = pseudoClass.find('(');
+    size_t closeParenPos = pseudoClass.rfind(')');
+    if (closeParenPos == std::string::npos || closeParenPos < openParenPos)
     {
-        if (ch == '.')
-        {
-            NormSelector += " ."; // .前添加空格
-        }
-        else if (ch == '#')
+        return false;
+    }
+    int a = 0, b = 0;
+    if (!parseNth(pseudoClass.substr(openParenPos + 1, closeParenPos - openParenPos - 1), a, b))
+    {
+        return false;
+    }
+    if (pseudoClass.find("nth-child(") == 0)
+    {
+        return matchesNth(a, b, position);
+    }
+    if (pseudoClass.find("nth-last-child(") == 0)
+    {
+        return matchesNth(a, b, count - position + 1);
+    }
+    return matchesNth(a, b, static_cast<int>(element->typeIndex) + 1);
+}
+
+struct CompiledSelector;
+const CompiledSelector &getCompiledSelector(const std::string &selector);
+bool matchesSelector(const Element *element, const CompiledSelector &compiled);
+bool matchHasPseudoClass(const Element *element, const std::string &argument);
+
+// 取出函数式伪类括号内的参数，如 "not(.a, .b)" 中的 ".a, .b"
+bool pseudoArgument(const std::string &pseudoClass, std::string &argument)
+{
+    size_t openParenPos = pseudoClass.find('(');
+    if (openParenPos == std::string::npos || pseudoClass.back() != ')')
+    {
+        return false;
+    }
+    argument = pseudoClass.substr(openParenPos + 1, pseudoClass.size() - openParenPos - 2);
+    return true;
+}
+
+// 匹配单个伪类（不含前导冒号）
+bool matchPseudoClass(const Element *element, const std::string &pseudoClass)
+{
+    std::string argument;
+    if (pseudoClass == "root")
+    {
+        return element->tagName == "html";
+    }
+    else if (pseudoClass == "empty")
+    {
+        return element->children.empty();
+    }
+    else if (pseudoClass.find("lang(") == 0 && pseudoArgument(pseudoClass, argument))
+    {
+        // 语言代码不区分大小写，:lang(zh) 也匹配 zh-CN、zh-Hans 等子标签
+        const Attribute *lang = element->getAttribute(AttributeNames::Lang);
+        if (!lang)
         {
-            NormSelector += " #"; // #前添加空格
+            return false;
         }
-        else
+        std::string_view value = lang->value();
+        std::transform(argument.begin(), argument.end(), argument.begin(), ::tolower);
+        return value.size() >= argument.size() && encoding::equalsIgnoreCase(value.substr(0, argument.size()), argument) &&
+               (value.size() == argument.size() || value[argument.size()] == '-');
+    }
+    else if (pseudoClass == "first-letter")
+    {
+        // 第一个子节点是非空的文本节点。匹配没有副作用：批处理、JSON Lines 输出和服务模式都在标准输出上写结果
+        if (!element->children.empty())
         {
-            NormSelector += ch;
+            const Node *front = element->children.front().get();
+            return front->nodeType == NodeType::Text && !static_cast<const Text *>(front)->nodeValue().empty();
         }
+        return false;
+    }
+    else if (isStructuralPseudoClass(pseudoClass))
+    {
+        return matchStructuralPseudoClass(element, pseudoClass);
+    }
+    else if (pseudoClass.find("not(") == 0 && pseudoArgument(pseudoClass, argument))
+    {
+        return !matchesSelector(element, getCompiledSelector(argument));
+    }
+    else if ((pseudoClass.find("is(") == 0 || pseudoClass.find("where(") == 0) && pseudoArgument(pseudoClass, argument))
+    {
+        // :where 与 :is 只有优先级不同，匹配结果相同
+        return matchesSelector(element, getCompiledSelector(argument));
     }
+    else if (pseudoClass.find("has(") == 0 && pseudoArgument(pseudoClass, argument))
+    {
+        return matchHasPseudoClass(element, argument);
+    }
+    return false;
+}
 
-    // 分割并将子选择器存入vector
-    std::istringstream iss(NormSelector);
-    std::vector<std::string> subSelectors;
-    std::string subSelector;
-    while (std::getline(iss, subSelector, ' '))
+bool MatchSelector(const Element *element, const std::string &selector)
+{
+    // 实现的伪类：:root、:empty、::first-letter、:lang()、结构伪类以及 :not()/:is()/:where()/:has()
+    if (selector == "*")
     {
-        if (!subSelector.empty())
-        {
-            subSelectors.push_back(subSelector);
-        }
+        return true;
     }
 
+    // 拆分为标签、类、ID、属性和伪类原子
+    std::vector<std::string> subSelectors = splitCompound(selector);
+
     // 没有子选择器返回 false
     if (subSelectors.empty())
     {
         return false;
     }
 
-    // 检查标签、类和 ID。如果任何一个选择器不匹配，返回false；全部匹配则返回true。
-    bool isTagMatched = false, isClassOrIdMatched = true, isMatched = false;
-
+    // 检查每个原子。如果任何一个不匹配，返回false；全部匹配则返回true。
     for (const auto &sel : subSelectors)
     {
         if (sel.empty())
         {
             continue;
         }
-        if (sel[0] != '#' && sel[0] != '.')
+        if (sel[0] == ':')
+        {
+            // 处理双冒号伪元素选择器
+            std::string pseudoClass = sel.substr(sel.size() > 1 && sel[1] == ':' ? 2 : 1);
+            if (!matchPseudoClass(element, pseudoClass))
+            {
+                return false;
+            }
+        }
+        else if (sel[0] == '[')
+        {
+            // 检查属性，编译后的属性选择器按文本缓存
+            if (!AttributeSelector::get(sel).matches(element))
+            {
+                return false;
+            }
+        }
+        else if (sel[0] != '#' && sel[0] != '.')
         {
             // 检查标签
-            if (sel != element->tagName)
+            if (sel != "*" && sel != element->tagName)
             {
                 return false;
             }
@@ -199,39 +403,15 @@ bool MatchSelector(const std::shared_ptr<Element> &element, const std::string &s
         else if (sel[0] == '#')
         {
             // 检查 ID
-            bool idFound = false;
-            for (const auto &[key, value] : element->attributes)
-            {
-                if (key == "id" && value == sel.substr(1))
-                {
-                    idFound = true;
-                    break;
-                }
-            }
-            if (!idFound)
+            if (element->id != std::string_view(sel).substr(1))
             {
                 return false;
             }
         }
         else if (sel[0] == '.')
         {
-
             // 检查每个类
-            bool classFound = false;
-            for (const auto &[key, value] : element->attributes)
-            {
-                if (key == "class")
-                {
-                    std::string classAttribute = value;
-                    std::string className = sel.substr(1);
-                    if (classAttribute.find(className) != std::string::npos)
-                    {
-                        classFound = true;
-                        break;
-                    }
-                }
-            }
-            if (!classFound)
+            if (!element->hasClass(std::string_view(sel).substr(1)))
             {
                 return false;
             }
@@ -240,21 +420,23 @@ bool MatchSelector(const std::shared_ptr<Element> &element, const std::string &s
     return true;
 }
 
-void MatchElementfind(const std::shared_ptr<Element> &root, const std::string &selector, std::vector<std::shared_ptr<Element>> &matchedElements)
+bool MatchSelector(const std::shared_ptr<Element> &element, const std::string &selector)
 {
-    // 检查当前元素是否匹配选择器
+    return MatchSelector(element.get(), selector);
+}
+
+void MatchElementfind(Element *root, const std::string &selector, std::vector<std::shared_ptr<Element>> &matchedElements)
+{
+    // 检查当前元素是否匹配选择器，只有匹配的元素才需要取得 shared_ptr
     if (MatchSelector(root, selector))
     {
-        matchedElements.push_back(root);
+        matchedElements.push_back(root->shared_from_this());
     }
 
-    // 递归遍历子元素
-    for (const auto &child : root->children)
+    // 沿元素链接递归遍历子元素
+    for (Element *child = root->firstElementChild; child; child = child->nextElementSibling)
     {
-        if (child->nodeType == NodeType::Element)
-        {
-            MatchElementfind(std::dynamic_pointer_cast<Element>(child), selector, matchedElements);
-        }
+        MatchElementfind(child, selector, matchedElements);
     }
 }
 // 选择器类型枚举
@@ -268,6 +450,459 @@ enum class SelectorType
     Multiple    // , 多选择器
 };
 
+// 编译后的选择器：每个复合选择器与它左侧的组合符，从左到右排列
+struct CompoundPart
+{
+    std::string selector;
+    SelectorType combinator; // 与前一个复合选择器之间的关系，第一个为 Simple
+};
+
+struct CompiledSelector
+{
+    std::string text;
+    std::vector<std::vector<CompoundPart>> alternatives; // 逗号分隔的各个选择器
+    std::set<std::string> attributes;                     // 匹配时读取的属性名
+    bool dependsOnAncestors = false;                      // 含 > 或空格组合符
+    bool dependsOnSiblings = false;                       // 含 + 或 ~ 组合符，或结构伪类
+    bool dependsOnChildren = false;                       // 含 :empty、:first-letter 等依赖子节点的伪类
+    bool dependsOnDescendants = false;                    // 含 :has()，任意后代的变化都可能影响结果
+};
+
+CompiledSelector compileSelector(const std::string &selector);
+
+// 合并 :not()/:is()/:where()/:has() 参数中选择器的依赖
+void collectArgumentDependencies(const std::string &compound, CompiledSelector &compiled)
+{
+    for (const auto &atom : splitCompound(compound))
+    {
+        std::string argument;
+        if (atom.size() < 2 || atom[0] != ':' || !pseudoArgument(atom, argument))
+        {
+            continue;
+        }
+        bool isHas = atom.compare(0, 5, ":has(") == 0;
+        if (!isHas && atom.compare(0, 5, ":not(") != 0 && atom.compare(0, 4, ":is(") != 0 &&
+            atom.compare(0, 7, ":where(") != 0)
+        {
+            continue;
+        }
+        CompiledSelector inner = compileSelector(argument);
+        compiled.attributes.insert(inner.attributes.begin(), inner.attributes.end());
+        compiled.dependsOnAncestors = compiled.dependsOnAncestors || inner.dependsOnAncestors;
+        compiled.dependsOnSiblings = compiled.dependsOnSiblings || inner.dependsOnSiblings;
+        compiled.dependsOnChildren = compiled.dependsOnChildren || inner.dependsOnChildren;
+        compiled.dependsOnDescendants = compiled.dependsOnDescendants || inner.dependsOnDescendants || isHas;
+        // :has(+ x) 与 :has(~ x) 看的是后面的兄弟
+        if (isHas && (findOutsideBrackets(argument, '+') != std::string::npos ||
+                      findOutsideBrackets(argument, '~') != std::string::npos))
+        {
+            compiled.dependsOnSiblings = true;
+        }
+    }
+}
+
+// 记录复合选择器读取的属性和子节点依赖
+void collectDependencies(const std::string &compound, CompiledSelector &compiled)
+{
+    if (compound.find('#') != std::string::npos)
+    {
+        compiled.attributes.insert("id");
+    }
+    if (compound.find('.') != std::string::npos)
+    {
+        compiled.attributes.insert("class");
+    }
+    if (compound.find(":lang(") != std::string::npos)
+    {
+        compiled.attributes.insert("lang");
+    }
+    // [name op value] 中的属性名
+    for (size_t open = compound.find('['); open != std::string::npos; open = compound.find('[', open + 1))
+    {
+        size_t end = compound.find_first_of("=~|^$*] \t", open + 1);
+        if (end != std::string::npos && end > open + 1)
+        {
+            compiled.attributes.insert(compound.substr(open + 1, end - open - 1));
+        }
+    }
+    if (compound.find(":empty") != std::string::npos || compound.find("first-letter") != std::string::npos)
+    {
+        compiled.dependsOnChildren = true;
+    }
+    // 结构伪类依赖兄弟位置，兄弟的增删会改变结果
+    if (compound.find("-child") != std::string::npos || compound.find("-of-type") != std::string::npos)
+    {
+        compiled.dependsOnSiblings = true;
+    }
+    if (compound.find('(') != std::string::npos)
+    {
+        collectArgumentDependencies(compound, compiled);
+    }
+}
+
+// 将选择器编译为复合选择器序列，组合符两侧的空格会被忽略
+CompiledSelector compileSelector(const std::string &selector)
+{
+    CompiledSelector compiled;
+    compiled.text = selector;
+    std::vector<CompoundPart> current;
+    SelectorType pending = SelectorType::Simple;
+
+    auto finish = [&]()
+    {
+        if (!current.empty())
+        {
+            compiled.alternatives.push_back(current);
+        }
+        current.clear();
+        pending = SelectorType::Simple;
+    };
+
+    for (const auto &token : tokenize(selector))
+    {
+        if (token == ",")
+        {
+            finish();
+        }
+        else if (token == " ")
+        {
+            if (!current.empty() && pending == SelectorType::Simple)
+            {
+                pending = SelectorType::Descendant;
+            }
+        }
+        else if (token == ">" || token == "+" || token == "~")
+        {
+            pending = token == ">" ? SelectorType::Child : token == "+" ? SelectorType::Adjacent
+                                                                        : SelectorType::General;
+        }
+        else
+        {
+            if (current.empty())
+            {
+                pending = SelectorType::Simple;
+            }
+            if (pending == SelectorType::Child || pending == SelectorType::Descendant)
+            {
+                compiled.dependsOnAncestors = true;
+            }
+            else if (pending == SelectorType::Adjacent || pending == SelectorType::General)
+            {
+                compiled.dependsOnSiblings = true;
+            }
+            collectDependencies(token, compiled);
+            current.push_back({token, pending});
+            pending = SelectorType::Simple;
+        }
+    }
+    finish();
+    return compiled;
+}
+
+// 从右向左匹配：parts[index] 已经与 element 匹配，继续检查左侧部分
+bool matchLeftParts(const Element *element, const std::vector<CompoundPart> &parts, size_t index)
+{
+    if (index == 0)
+    {
+        return true;
+    }
+    const auto &left = parts[index - 1];
+    switch (parts[index].combinator)
+    {
+    case SelectorType::Child:
+    {
+        const Element *parent = element->parentElement;
+        return parent && MatchSelector(parent, left.selector) && matchLeftParts(parent, parts, index - 1);
+    }
+    case SelectorType::Descendant:
+    {
+        for (const Element *ancestor = element->parentElement; ancestor; ancestor = ancestor->parentElement)
+        {
+            if (MatchSelector(ancestor, left.selector) && matchLeftParts(ancestor, parts, index - 1))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+    case SelectorType::Adjacent:
+    {
+        const Element *sibling = element->previousElementSibling;
+        return sibling && MatchSelector(sibling, left.selector) && matchLeftParts(sibling, parts, index - 1);
+    }
+    case SelectorType::General:
+    {
+        for (const Element *sibling = element->previousElementSibling; sibling; sibling = sibling->previousElementSibling)
+        {
+            if (MatchSelector(sibling, left.selector) && matchLeftParts(sibling, parts, index - 1))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+    default:
+        return false;
+    }
+}
+
+// 判断单个元素是否匹配编译后的选择器
+bool matchesSelector(const Element *element, const CompiledSelector &compiled)
+{
+    for (const auto &parts : compiled.alternatives)
+    {
+        if (MatchSelector(element, parts.back().selector) && matchLeftParts(element, parts, parts.size() - 1))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool matchesSelector(const std::shared_ptr<Element> &element, const CompiledSelector &compiled)
+{
+    return matchesSelector(element.get(), compiled);
+}
+
+// :not()/:is()/:where() 参数的编译结果，每个线程按文本缓存
+const CompiledSelector &getCompiledSelector(const std::string &selector)
+{
+    thread_local std::unordered_map<std::string, CompiledSelector> cache;
+    auto it = cache.find(selector);
+    if (it == cache.end())
+    {
+        it = cache.emplace(selector, compileSelector(selector)).first;
+    }
+    return it->second;
+}
+
+// :has() 中的一个相对选择器，如 "> a.download" 以子元素为起点
+struct RelativeSelector
+{
+    SelectorType anchor = SelectorType::Descendant; // 起点相对 :has 主体的组合符
+    std::vector<CompoundPart> parts;
+};
+
+// 解析 :has() 的相对选择器列表，每个线程按文本缓存；返回的地址同时作为备忘录的键
+const std::vector<RelativeSelector> &getRelativeSelectors(const std::string &argument)
+{
+    thread_local std::unordered_map<std::string, std::vector<RelativeSelector>> cache;
+    auto it = cache.find(argument);
+    if (it != cache.end())
+    {
+        return it->second;
+    }
+    std::vector<RelativeSelector> relatives;
+    std::vector<std::string> pieces(1);
+    SelectorNesting nesting;
+    for (char ch : argument)
+    {
+        if (nesting.step(ch) && ch == ',')
+        {
+            pieces.emplace_back();
+        }
+        else
+        {
+            pieces.back() += ch;
+        }
+    }
+    for (auto &piece : pieces)
+    {
+        size_t start = piece.find_first_not_of(" \t\n");
+        if (start == std::string::npos)
+        {
+            continue;
+        }
+        RelativeSelector relative;
+        char lead = piece[start];
+        if (lead == '>' || lead == '+' || lead == '~')
+        {
+            relative.anchor = lead == '>' ? SelectorType::Child : lead == '+' ? SelectorType::Adjacent
+                                                                              : SelectorType::General;
+            ++start;
+        }
+        CompiledSelector compiled = compileSelector(piece.substr(start));
+        if (compiled.alternatives.size() != 1)
+        {
+            throw std::invalid_argument(":has() 参数格式错误: " + argument);
+        }
+        relative.parts = std::move(compiled.alternatives.front());
+        relatives.push_back(std::move(relative));
+    }
+    return cache.emplace(argument, std::move(relatives)).first->second;
+}
+
+// :has() 的查询级备忘录：同一次查询中 (相对选择器, 元素) 的结果只计算一次，
+// 后代组合符的子树检查自底向上复用子元素的结果，整次查询对每个相对选择器是线性的。
+// 备忘录只在 HasMemoScope 存活期间启用；嵌套的作用域（如订阅回调中的查询）沿用外层备忘录，
+// 因此修改树的接口必须调用 invalidateHasMemo，之后的匹配不会读到修改前的结果。
+struct HasMemoKeyHash
+{
+    size_t operator()(const std::pair<const void *, const Element *> &key) const
+    {
+        return std::hash<const void *>()(key.first) * 31 + std::hash<const void *>()(key.second);
+    }
+};
+
+using HasMemo = std::unordered_map<std::pair<const void *, const Element *>, bool, HasMemoKeyHash>;
+
+thread_local HasMemo *activeHasMemo = nullptr;
+
+class HasMemoScope
+{
+private:
+    HasMemo memo;
+    HasMemo *previous;
+
+public:
+    HasMemoScope() : previous(activeHasMemo)
+    {
+        // 嵌套的作用域沿用外层备忘录
+        activeHasMemo = previous ? previous : &memo;
+    }
+    ~HasMemoScope()
+    {
+        activeHasMemo = previous;
+    }
+    HasMemoScope(const HasMemoScope &) = delete;
+    HasMemoScope &operator=(const HasMemoScope &) = delete;
+};
+
+// 树被修改后清空当前线程正在使用的备忘录
+inline void invalidateHasMemo()
+{
+    if (activeHasMemo)
+    {
+        activeHasMemo->clear();
+    }
+}
+
+// 从左向右匹配：parts[index] 已经与 element 匹配，继续检查右侧部分
+bool matchRightParts(const Element *element, const std::vector<CompoundPart> &parts, size_t index)
+{
+    if (index + 1 == parts.size())
+    {
+        return true;
+    }
+    const auto &right = parts[index + 1];
+    auto matchesAt = [&](const Element *candidate)
+    {
+        return MatchSelector(candidate, right.selector) && matchRightParts(candidate, parts, index + 1);
+    };
+    switch (right.combinator)
+    {
+    case SelectorType::Child:
+        for (const Element *child = element->firstElementChild; child; child = child->nextElementSibling)
+        {
+            if (matchesAt(child))
+            {
+                return true;
+            }
+        }
+        return false;
+    case SelectorType::Descendant:
+    {
+        // 先序遍历 element 的子树
+        const Element *cursor = element->firstElementChild;
+        while (cursor)
+        {
+            if (matchesAt(cursor))
+            {
+                return true;
+            }
+            if (cursor->firstElementChild)
+            {
+                cursor = cursor->firstElementChild;
+                continue;
+            }
+            while (cursor != element && !cursor->nextElementSibling)
+            {
+                cursor = cursor->parentElement;
+            }
+            cursor = cursor == element ? nullptr : cursor->nextElementSibling;
+        }
+        return false;
+    }
+    case SelectorType::Adjacent:
+        return element->nextElementSibling && matchesAt(element->nextElementSibling);
+    case SelectorType::General:
+        for (const Element *sibling = element->nextElementSibling; sibling; sibling = sibling->nextElementSibling)
+        {
+            if (matchesAt(sibling))
+            {
+                return true;
+            }
+        }
+        return false;
+    default:
+        return false;
+    }
+}
+
+// 判断 element 是否满足一个相对选择器
+bool matchRelative(const Element *element, const RelativeSelector &relative)
+{
+    if (activeHasMemo)
+    {
+        auto cached = activeHasMemo->find({&relative, element});
+        if (cached != activeHasMemo->end())
+        {
+            return cached->second;
+        }
+    }
+
+    bool result = false;
+    const std::string &first = relative.parts.front().selector;
+    auto matchesFrom = [&](const Element *candidate)
+    {
+        return MatchSelector(candidate, first) && matchRightParts(candidate, relative.parts, 0);
+    };
+    switch (relative.anchor)
+    {
+    case SelectorType::Child:
+        for (const Element *child = element->firstElementChild; child && !result; child = child->nextElementSibling)
+        {
+            result = matchesFrom(child);
+        }
+        break;
+    case SelectorType::Adjacent:
+        result = element->nextElementSibling && matchesFrom(element->nextElementSibling);
+        break;
+    case SelectorType::General:
+        // 后面的兄弟之一匹配，或者下一个兄弟满足同一条件（可复用备忘录）
+        if (const Element *next = element->nextElementSibling)
+        {
+            result = matchesFrom(next) || matchRelative(next, relative);
+        }
+        break;
+    default:
+        // 某个子元素匹配，或者某个子元素的子树中有匹配（可复用备忘录）
+        for (const Element *child = element->firstElementChild; child && !result; child = child->nextElementSibling)
+        {
+            result = matchesFrom(child) || matchRelative(child, relative);
+        }
+        break;
+    }
+
+    if (activeHasMemo)
+    {
+        activeHasMemo->emplace(std::make_pair(static_cast<const void *>(&relative), element), result);
+    }
+    return result;
+}
+
+bool matchHasPseudoClass(const Element *element, const std::string &argument)
+{
+    for (const auto &relative : getRelativeSelectors(argument))
+    {
+        if (matchRelative(element, relative))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
 // CSS选择器处理类
 class CssSelectorMatcher
 {
@@ -313,30 +948,15 @@ private:
         std::vector<std::shared_ptr<Element>> matchPrecElements;
         std::set<std::shared_ptr<Element>> uniqueMatch;
 
-        MatchElementfind(root, precSelector, matchPrecElements);
+        MatchElementfind(root.get(), precSelector, matchPrecElements);
 
         for (const auto &precElement : matchPrecElements)
         {
-            auto parent = precElement->parent.lock();
-            if (parent)
+            // 只考虑紧邻的下一个元素兄弟
+            Element *sibling = precElement->nextElementSibling;
+            if (sibling && MatchSelector(sibling, adjacentSelector))
             {
-                bool flag = false;
-                for (const auto &child : parent->children)
-                {
-                    if (flag)
-                    {
-                        auto siblingElement = std::dynamic_pointer_cast<Element>(child);
-                        if (siblingElement && MatchSelector(siblingElement, adjacentSelector))
-                        {
-                            uniqueMatch.insert(siblingElement);
-                            break; // 只考虑第一个紧邻的兄弟元素
-                        }
-                    }
-                    if (child == precElement)
-                    {
-                        flag = true;
-                    }
-                }
+                uniqueMatch.insert(sibling->shared_from_this());
             }
         }
 
@@ -349,36 +969,30 @@ private:
     std::vector<std::shared_ptr<Element>> GenSelect(const std::string &precedSelector, const std::string &siblingSelector, const std::shared_ptr<Element> &root)
     {
         std::vector<std::shared_ptr<Element>> matchedPrecedingElements;
-        MatchElementfind(root, precedSelector, matchedPrecedingElements);
+        MatchElementfind(root.get(), precedSelector, matchedPrecedingElements);
+        std::unordered_set<const Element *> preceding;
+        for (const auto &element : matchedPrecedingElements)
+        {
+            preceding.insert(element.get());
+        }
 
-        std::set<std::shared_ptr<Element>> matchedSet;
+        // 每个前导元素只向后扫描到下一个前导元素（含）为止，之后的兄弟由那个元素负责，
+        // 因此每个兄弟只检查一次，结果也不会重复
+        std::vector<std::shared_ptr<Element>> finalMatchedElements;
         for (const auto &precedingElement : matchedPrecedingElements)
         {
-            auto parent = std::dynamic_pointer_cast<Element>(precedingElement->parent.lock());
-            if (parent)
+            for (Element *sibling = precedingElement->nextElementSibling; sibling; sibling = sibling->nextElementSibling)
             {
-                bool startMatching = false;
-                for (const auto &child : parent->children)
+                if (MatchSelector(sibling, siblingSelector))
                 {
-                    if (child == precedingElement)
-                    {
-                        startMatching = true;
-                        continue;
-                    }
-                    if (startMatching)
-                    {
-                        auto childElement = std::dynamic_pointer_cast<Element>(child);
-                        if (childElement && MatchSelector(childElement, siblingSelector))
-                        {
-                            matchedSet.insert(childElement);
-                        }
-                    }
+                    finalMatchedElements.push_back(sibling->shared_from_this());
+                }
+                if (preceding.count(sibling))
+                {
+                    break;
                 }
             }
         }
-
-        // 转换为 vector 输出
-        std::vector<std::shared_ptr<Element>> finalMatchedElements(matchedSet.begin(), matchedSet.end());
         return finalMatchedElements;
     }
     // MultipleSelect函数
@@ -431,7 +1045,7 @@ private:
     std::vector<std::shared_ptr<Element>> findElements(const std::string &selector)
     {
         std::vector<std::shared_ptr<Element>> results;
-        MatchElementfind(root, selector, results);
+        MatchElementfind(root.get(), selector, results);
         return results;
     }
 
@@ -439,14 +1053,11 @@ private:
     ElementSet matchChildren(const std::shared_ptr<Element> &parent, const std::string &selector)
     {
         ElementSet results;
-        for (const auto &child : parent->children)
+        for (Element *element = parent->firstElementChild; element; element = element->nextElementSibling)
         {
-            if (auto element = std::dynamic_pointer_cast<Element>(child))
+            if (MatchSelector(element, selector))
             {
-                if (MatchSelector(element, selector))
-                {
-                    results.insert(element);
-                }
+                results.insert(element->shared_from_this());
             }
         }
         return results;
@@ -456,19 +1067,20 @@ private:
     ElementSet matchDescendants(const std::shared_ptr<Element> &parent, const std::string &selector)
     {
         ElementSet results;
-        for (const auto &child : parent->children)
+        collectDescendants(parent.get(), selector, results);
+        return results;
+    }
+
+    void collectDescendants(const Element *parent, const std::string &selector, ElementSet &results)
+    {
+        for (Element *element = parent->firstElementChild; element; element = element->nextElementSibling)
         {
-            if (auto element = std::dynamic_pointer_cast<Element>(child))
+            if (MatchSelector(element, selector))
             {
-                if (MatchSelector(element, selector))
-                {
-                    results.insert(element);
-                }
-                auto childResults = matchDescendants(element, selector);
-                results.insert(childResults.begin(), childResults.end());
+                results.insert(element->shared_from_this());
             }
+            collectDescendants(element, selector, results);
         }
-        return results;
     }
 
     // 递归匹配选择器部分
@@ -521,11 +1133,32 @@ private:
         return results;
     }
 
+    // "div > a" 中组合符两侧的空格不是后代组合符
+    static std::vector<std::string> dropSpacesAroundCombinators(const std::vector<std::string> &tokens)
+    {
+        auto isCombinator = [](const std::string &token)
+        {
+            return token == ">" || token == "+" || token == "~" || token == ",";
+        };
+        std::vector<std::string> result;
+        for (size_t i = 0; i < tokens.size(); ++i)
+        {
+            if (tokens[i] == " " && ((i > 0 && isCombinator(tokens[i - 1])) ||
+                                     (i + 1 < tokens.size() && isCombinator(tokens[i + 1]))))
+            {
+                continue;
+            }
+            result.push_back(tokens[i]);
+        }
+        return result;
+    }
+
 public:
     CssSelectorMatcher(const std::shared_ptr<Element> &rootElement) : root(rootElement) {}
     std::vector<std::shared_ptr<Element>> match(const std::string &selector)
     {
-        auto parts = tokenize(selector);
+        HasMemoScope hasMemo;
+        auto parts = dropSpacesAroundCombinators(tokenize(selector));
         ElementSet results;
         // 检查是否包含逗号
         bool hasComma = std::find(parts.begin(), parts.end(), ",") != parts.end();
@@ -0,0 +1,398 @@
+#ifndef SELECTORVM_CPP
+#define SELECTORVM_CPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <map>
+#include <mutex>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include "element.cpp"
+#include "selectormatcher.cpp"
+
+// 选择器字节码：把 compileSelector 的结果降级为从右向左执行的扁平指令序列，
+// 由 SelectorProgram::matches 中的解释循环执行。程序构造后不可变，可在线程间共享、缓存和序列化。
+enum class SelectorOp : uint8_t
+{
+    CheckTag,          // 标签名等于 strings[operand]
+    CheckClass,        // classBloom 含 bits，且类名列表含 strings[operand]
+    CheckId,           // id 等于 strings[operand]
+    CheckAttribute,    // 属性选择器 strings[operand]，执行时使用预先编译的 AttributeSelector
+    CheckCompound,     // 交给 MatchSelector 检查 strings[operand]（伪类等未降级的复合选择器）
+    MoveToParent,      // 移动到父元素，不存在则失败
+    MoveToPrevSibling, // 移动到前一个元素兄弟，不存在则失败
+    MarkAncestor,      // 移动到父元素并记录回溯点，之后失败时从该元素的父元素重试（后代组合符）
+    MarkPrevSibling,   // 移动到前一个兄弟并记录回溯点，之后失败时继续向前重试（通用兄弟组合符）
+    Match,             // 当前分支匹配成功
+};
+
+struct SelectorInstruction
+{
+    SelectorOp op;
+    uint32_t operand;
+    uint64_t bits;
+};
+
+class SelectorProgram
+{
+private:
+    std::vector<SelectorInstruction> code;
+    std::vector<std::string> strings;
+    std::vector<uint32_t> alternativeStarts; // 逗号分隔的每个选择器在 code 中的起点
+    std::vector<AttributeSelector> attributeSelectors; // 与 strings 下标对应，仅 CheckAttribute 使用的项有效
+
+    // 为 CheckAttribute 引用的字符串编译属性选择器
+    void prepareAttributes()
+    {
+        attributeSelectors.assign(strings.size(), AttributeSelector());
+        for (const auto &instruction : code)
+        {
+            if (instruction.op == SelectorOp::CheckAttribute)
+            {
+                attributeSelectors[instruction.operand] = AttributeSelector::parse(strings[instruction.operand]);
+            }
+        }
+    }
+
+    uint32_t addString(std::string_view text)
+    {
+        for (size_t i = 0; i < strings.size(); ++i)
+        {
+            if (strings[i] == text)
+            {
+                return static_cast<uint32_t>(i);
+            }
+        }
+        strings.emplace_back(text);
+        return static_cast<uint32_t>(strings.size() - 1);
+    }
+
+    void emit(SelectorOp op, uint32_t operand = 0, uint64_t bits = 0)
+    {
+        code.push_back({op, operand, bits});
+    }
+
+    // 复合选择器降级为原子检查；含伪类的复合选择器整体交给 MatchSelector
+    void emitCompound(const std::string &compound)
+    {
+        if (findOutsideBrackets(compound, ':') != std::string::npos)
+        {
+            emit(SelectorOp::CheckCompound, addString(compound));
+            return;
+        }
+        for (const auto &atom : splitCompound(compound))
+        {
+            char lead = atom[0];
+            std::string_view name = (lead == '.' || lead == '#') ? std::string_view(atom).substr(1) : std::string_view(atom);
+            if (lead == '[')
+            {
+                emit(SelectorOp::CheckAttribute, addString(atom));
+            }
+            else if (lead == '.')
+            {
+                emit(SelectorOp::CheckClass, addString(name), Element::classBit(name));
+            }
+            else if (lead == '#')
+            {
+                emit(SelectorOp::CheckId, addString(name));
+            }
+            else if (name != "*")
+            {
+                emit(SelectorOp::CheckTag, addString(name));
+            }
+        }
+    }
+
+    bool execute(const Element *start) const
+    {
+        struct Backtrack
+        {
+            uint32_t pc;
+            const Element *element;
+        };
+        std::vector<Backtrack> marks;
+
+        for (uint32_t alternative : alternativeStarts)
+        {
+            marks.clear();
+            const Element *element = start;
+            uint32_t pc = alternative;
+            while (true)
+            {
+                const SelectorInstruction &instruction = code[pc];
+                bool ok = true;
+                switch (instruction.op)
+                {
+                case SelectorOp::CheckTag:
+                    ok = element->tagName == strings[instruction.operand];
+                    break;
+                case SelectorOp::CheckClass:
+                    ok = (element->classBloom & instruction.bits) && element->hasClass(strings[instruction.operand]);
+                    break;
+                case SelectorOp::CheckId:
+                    ok = element->id == strings[instruction.operand];
+                    break;
+                case SelectorOp::CheckAttribute:
+                    ok = attributeSelectors[instruction.operand].matches(element);
+                    break;
+                case SelectorOp::CheckCompound:
+                    ok = MatchSelector(element, strings[instruction.operand]);
+                    break;
+                case SelectorOp::MoveToParent:
+                    element = element->parentElement;
+                    ok = element != nullptr;
+                    break;
+                case SelectorOp::MoveToPrevSibling:
+                    element = element->previousElementSibling;
+                    ok = element != nullptr;
+                    break;
+                case SelectorOp::MarkAncestor:
+                    element = element->parentElement;
+                    ok = element != nullptr;
+                    if (ok)
+                    {
+                        marks.push_back({pc, element});
+                    }
+                    break;
+                case SelectorOp::MarkPrevSibling:
+                    element = element->previousElementSibling;
+                    ok = element != nullptr;
+                    if (ok)
+                    {
+                        marks.push_back({pc, element});
+                    }
+                    break;
+                case SelectorOp::Match:
+                    return true;
+                }
+
+                if (ok)
+                {
+                    ++pc;
+                }
+                else if (!marks.empty())
+                {
+                    // 回到最近的回溯点，从记录的元素继续向上或向前移动
+                    pc = marks.back().pc;
+                    element = marks.back().element;
+                    marks.pop_back();
+                }
+                else
+                {
+                    break;
+                }
+            }
+        }
+        return false;
+    }
+
+    void collect(Element *element, std::vector<std::shared_ptr<Element>> &results) const
+    {
+        for (Element *child = element->firstElementChild; child; child = child->nextElementSibling)
+        {
+            if (execute(child))
+            {
+                results.push_back(child->shared_from_this());
+            }
+            collect(child, results);
+        }
+    }
+
+    static void writeU32(std::string &out, uint32_t value)
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            out += static_cast<char>((value >> (8 * i)) & 0xff);
+        }
+    }
+
+    static void writeU64(std::string &out, uint64_t value)
+    {
+        for (int i = 0; i < 8; ++i)
+        {
+            out += static_cast<char>((value >> (8 * i)) & 0xff);
+        }
+    }
+
+    static uint64_t readInteger(const std::string &in, size_t &pos, int bytes)
+    {
+        if (pos + bytes > in.size())
+        {
+            throw std::runtime_error("选择器字节码被截断");
+        }
+        uint64_t value = 0;
+        for (int i = 0; i < bytes; ++i)
+        {
+            value |= static_cast<uint64_t>(static_cast<unsigned char>(in[pos++])) << (8 * i);
+        }
+        return value;
+    }
+
+    static constexpr char MAGIC[4] = {'C', 'S', 'B', '2'};
+
+public:
+    SelectorProgram() = default;
+
+    static SelectorProgram compile(const std::string &selector)
+    {
+        SelectorProgram program;
+        for (const auto &parts : compileSelector(selector).alternatives)
+        {
+            program.alternativeStarts.push_back(static_cast<uint32_t>(program.code.size()));
+            // 从最右侧的复合选择器开始，沿组合符向左移动
+            for (size_t i = parts.size(); i-- > 0;)
+            {
+                program.emitCompound(parts[i].selector);
+                if (i == 0)
+                {
+                    break;
+                }
+                switch (parts[i].combinator)
+                {
+                case SelectorType::Child:
+                    program.emit(SelectorOp::MoveToParent);
+                    break;
+                case SelectorType::Adjacent:
+                    program.emit(SelectorOp::MoveToPrevSibling);
+                    break;
+                case SelectorType::General:
+                    program.emit(SelectorOp::MarkPrevSibling);
+                    break;
+                default:
+                    program.emit(SelectorOp::MarkAncestor);
+                    break;
+                }
+            }
+            program.emit(SelectorOp::Match);
+        }
+        program.prepareAttributes();
+        return program;
+    }
+
+    bool matches(const Element *element) const
+    {
+        return execute(element);
+    }
+
+    // 返回 root 的所有后代中匹配的元素，按文档顺序排列
+    std::vector<std::shared_ptr<Element>> match(const std::shared_ptr<Element> &root) const
+    {
+        HasMemoScope hasMemo;
+        std::vector<std::shared_ptr<Element>> results;
+        collect(root.get(), results);
+        return results;
+    }
+
+    const std::vector<SelectorInstruction> &instructions() const
+    {
+        return code;
+    }
+
+    // 序列化为与平台无关的小端二进制格式，可随提取模板一起保存
+    std::string serialize() const
+    {
+        std::string out(MAGIC, sizeof(MAGIC));
+        writeU32(out, static_cast<uint32_t>(strings.size()));
+        for (const auto &text : strings)
+        {
+            writeU32(out, static_cast<uint32_t>(text.size()));
+            out += text;
+        }
+        writeU32(out, static_cast<uint32_t>(alternativeStarts.size()));
+        for (uint32_t start : alternativeStarts)
+        {
+            writeU32(out, start);
+        }
+        writeU32(out, static_cast<uint32_t>(code.size()));
+        for (const auto &instruction : code)
+        {
+            out += static_cast<char>(instruction.op);
+            writeU32(out, instruction.operand);
+            writeU64(out, instruction.bits);
+        }
+        return out;
+    }
+
+    static SelectorProgram deserialize(const std::string &in)
+    {
+        if (in.size() < sizeof(MAGIC) || std::memcmp(in.data(), MAGIC, sizeof(MAGIC)) != 0)
+        {
+            throw std::runtime_error("不是选择器字节码");
+        }
+        SelectorProgram program;
+        size_t pos = sizeof(MAGIC);
+        uint32_t stringCount = static_cast<uint32_t>(readInteger(in, pos, 4));
+        for (uint32_t i = 0; i < stringCount; ++i)
+        {
+            size_t length = readInteger(in, pos, 4);
+            if (pos + length > in.size())
+            {
+                throw std::runtime_error("选择器字节码被截断");
+            }
+            program.strings.push_back(in.substr(pos, length));
+            pos += length;
+        }
+        uint32_t alternativeCount = static_cast<uint32_t>(readInteger(in, pos, 4));
+        for (uint32_t i = 0; i < alternativeCount; ++i)
+        {
+            program.alternativeStarts.push_back(static_cast<uint32_t>(readInteger(in, pos, 4)));
+        }
+        uint32_t codeSize = static_cast<uint32_t>(readInteger(in, pos, 4));
+        for (uint32_t i = 0; i < codeSize; ++i)
+        {
+            auto op = static_cast<SelectorOp>(readInteger(in, pos, 1));
+            uint32_t operand = static_cast<uint32_t>(readInteger(in, pos, 4));
+            uint64_t bits = readInteger(in, pos, 8);
+            if (op > SelectorOp::Match)
+            {
+                throw std::runtime_error("未知的选择器指令");
+            }
+            program.code.push_back({op, operand, bits});
+        }
+
+        // 校验跳转和字符串下标，保证解释器不会越界
+        for (uint32_t start : program.alternativeStarts)
+        {
+            if (start >= program.code.size())
+            {
+                throw std::runtime_error("选择器字节码起点越界");
+            }
+        }
+        if (!program.code.empty() && program.code.back().op != SelectorOp::Match)
+        {
+            throw std::runtime_error("选择器字节码缺少结束指令");
+        }
+        for (const auto &instruction : program.code)
+        {
+            bool usesString = instruction.op == SelectorOp::CheckTag || instruction.op == SelectorOp::CheckClass ||
+                              instruction.op == SelectorOp::CheckId || instruction.op == SelectorOp::CheckAttribute ||
+                              instruction.op == SelectorOp::CheckCompound;
+            if (usesString && instruction.operand >= program.strings.size())
+            {
+                throw std::runtime_error("选择器字节码字符串下标越界");
+            }
+        }
+        program.prepareAttributes();
+        return program;
+    }
+};
+
+// 进程内的字节码缓存，同一选择器只编译一次；返回的程序不可变，可被多个线程同时执行
+std::shared_ptr<const SelectorProgram> getSelectorProgram(const std::string &selector)
+{
+    static std::mutex cacheMutex;
+    static std::map<std::string, std::shared_ptr<const SelectorProgram>> cache;
+
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    auto it = cache.find(selector);
+    if (it == cache.end())
+    {
+        it = cache.emplace(selector, std::make_shared<const SelectorProgram>(SelectorProgram::compile(selector))).first;
+    }
+    return it->second;
+}
+
+#endif
@@ -0,0 +1,873 @@
+#ifndef SELFTEST_CPP
+#define SELFTEST_CPP
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <stdexcept>
+#include <algorithm>
+#include <fstream>
+#include <filesystem>
+#include <cstdio>
+#include "element.cpp"
+#include "parser.cpp"
+#include "selectormatcher.cpp"
+#include "document.cpp"
+#include "frozendocument.cpp"
+#include "threadpool.cpp"
+#include "staticselector.cpp"
+#include "selectorvm.cpp"
+#include "extraction.cpp"
+#include "compression.cpp"
+#include "pipeline.cpp"
+
+// 回归自检：main --self-test [前缀] 运行全部用例（或名称以前缀开头的用例），有失败时返回非零。
+// 每个用例对应某个模块提交时验证过的行为，如并发查询、选择器编译的等价性和容错解析的结果，
+// 修改这些模块之后应当运行一遍。用例只依赖树中已有的模块，不需要外部测试框架。
+namespace selftest
+{
+    // 一个用例的检查结果
+    class Context
+    {
+    private:
+        std::string caseName;
+        size_t failures = 0;
+
+    public:
+        explicit Context(std::string name) : caseName(std::move(name))
+        {
+        }
+
+        size_t failed() const
+        {
+            return failures;
+        }
+
+        void check(bool ok, const std::string &what)
+        {
+            if (!ok)
+            {
+                ++failures;
+                std::cerr << "FAIL " << caseName << ": " << what << std::endl;
+            }
+        }
+
+        void expectEqual(const std::string &actual, const std::string &expected, const std::string &what)
+        {
+            check(actual == expected, what + "\n    实际: " + actual + "\n    期望: " + expected);
+        }
+    };
+
+    struct TestCase
+    {
+        const char *name;
+        std::function<void(Context &)> body;
+    };
+
+    inline std::shared_ptr<Element> parseHtml(std::string_view html)
+    {
+        auto root = createElement("root");
+        Parser parser;
+        parser.begin(root);
+        parser.feed(html.data(), html.size());
+        parser.finish();
+        return root;
+    }
+
+    // 树的紧凑表示，如 div(p(b,i),p)，只含元素
+    inline std::string shape(const Element *element)
+    {
+        std::string out;
+        for (const Element *child = element->firstElementChild; child; child = child->nextElementSibling)
+        {
+            if (!out.empty())
+            {
+                out += ',';
+            }
+            out += child->tagName;
+            if (child->firstElementChild)
+            {
+                out += '(' + shape(child) + ')';
+            }
+        }
+        return out;
+    }
+
+    // 元素列表的摘要：每个元素的标签名和文档序号，用于比较两种查询的结果
+    template <typename List>
+    std::string describe(const List &elements)
+    {
+        std::string out;
+        for (const auto &element : elements)
+        {
+            out += element->tagName + '@' + std::to_string(element->order) + ' ';
+        }
+        return out;
+    }
+
+    // 元素列表的标签名，如 "b i"
+    template <typename List>
+    std::string tags(const List &elements)
+    {
+        std::string out;
+        for (const auto &element : elements)
+        {
+            out += (out.empty() ? "" : " ") + element->tagName;
+        }
+        return out;
+    }
+
+    // 含 id、class、属性、嵌套列表和链接的合成文档，items 控制规模
+    inline std::string sampleDocument(size_t items)
+    {
+        std::string html = "<html><body><div id=main class=\"page wide\">";
+        for (size_t i = 0; i < items; ++i)
+        {
+            std::string n = std::to_string(i);
+            html += "<div class=\"item" + std::string(i % 3 == 0 ? " hot" : "") + "\" id=n" + n + " data-id=" + n + ">";
+            html += "<h2>标题 " + n + "</h2><ul>";
+            for (size_t j = 0; j < i % 4 + 1; ++j)
+            {
+                html += "<li class=tag>t" + std::to_string(j) + (j % 2 ? "<a href=/x" + n + ">链接</a>" : "") + "</li>";
+            }
+            html += "</ul><p>价格 <b>" + n + "</b> 元</p></div>";
+        }
+        html += "</div></body></html>";
+        return html;
+    }
+
+    // 各查询路径都支持的选择器
+    inline const std::vector<std::string> &sampleSelectors()
+    {
+        static const std::vector<std::string> selectors = {
+            "div li", ".item > ul > li", "#n7", "li:nth-child(2n+1)", "[data-id]", "div.hot a",
+            "ul li:has(a)", "a[href^=\"/x1\"]", "h2 + ul", "li ~ li", ":not(li)", "p b, h2"};
+        return selectors;
+    }
+
+    // 冻结文档被多个线程同时查询时结果与单线程相同，冻结后修改接口抛出异常
+    inline void frozenConcurrentQueries(Context &context)
+    {
+        auto root = parseHtml(sampleDocument(300));
+        Document document(root);
+        std::vector<std::string> expected;
+        for (const auto &selector : sampleSelectors())
+        {
+            expected.push_back(describe(document.querySelectorAll(selector)));
+            context.check(!expected.back().empty(), "样例文档中没有匹配 " + selector + " 的元素");
+        }
+        auto frozen = document.freeze();
+        for (size_t i = 0; i < expected.size(); ++i)
+        {
+            context.expectEqual(describe(frozen->querySelectorAll(sampleSelectors()[i])), expected[i],
+                                "FrozenDocument 与 Document 的结果不同: " + sampleSelectors()[i]);
+        }
+
+        std::atomic<size_t> mismatches{0};
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < 8; ++t)
+        {
+            threads.emplace_back([&, t]
+                                 {
+                for (size_t round = 0; round < 50; ++round)
+                {
+                    size_t i = (t + round) % expected.size();
+                    if (describe(frozen->querySelectorAll(sampleSelectors()[i])) != expected[i])
+                    {
+                        ++mismatches;
+                    }
+                } });
+        }
+        for (auto &thread : threads)
+        {
+            thread.join();
+        }
+        context.check(mismatches == 0, std::to_string(mismatches.load()) + " 次并发查询的结果与单线程不同");
+
+        bool threw = false;
+        try
+        {
+            document.setAttribute(root->firstElementChild->shared_from_this(), "class", "x");
+        }
+        catch (const std::logic_error &)
+        {
+            threw = true;
+        }
+        context.check(threw, "冻结后的 setAttribute 没有抛出 std::logic_error");
+    }
+
+    // 在线程池中分块并行匹配的结果与单线程相同，包括像服务那样在池内任务中嵌套调用
+    inline void parallelQueries(Context &context)
+    {
+        Document document(parseHtml(sampleDocument(3000)));
+        auto frozen = document.freeze();
+        ThreadPool pool(4);
+        std::vector<std::string> expected;
+        for (const auto &selector : sampleSelectors())
+        {
+            expected.push_back(describe(frozen->querySelectorAll(selector)));
+            context.expectEqual(describe(frozen->querySelectorAll(selector, pool)), expected.back(),
+                                "并行查询与单线程的结果不同: " + selector);
+        }
+
+        std::atomic<size_t> mismatches{0};
+        for (size_t task = 0; task < 32; ++task)
+        {
+            pool.submit([&, task]
+                        {
+                size_t i = task % expected.size();
+                if (describe(frozen->querySelectorAll(sampleSelectors()[i], pool)) != expected[i])
+                {
+                    ++mismatches;
+                } });
+        }
+        pool.wait();
+        context.check(mismatches == 0, std::to_string(mismatches.load()) + " 次嵌套的并行查询结果与单线程不同");
+
+        uint64_t tasks = 0;
+        for (const auto &worker : pool.stats())
+        {
+            tasks += worker.tasksExecuted;
+        }
+        context.check(tasks >= 32, "线程池统计的任务数 " + std::to_string(tasks) + " 少于提交的任务数");
+        std::string report = pool.report();
+        context.expectEqual(std::to_string(std::count(report.begin(), report.end(), '\n')), "4", "每个工作线程一行统计");
+    }
+
+    // 查询结果不含根元素，无论候选来自索引还是全量扫描
+    inline void rootExcluded(Context &context)
+    {
+        auto makeRoot = []
+        {
+            auto root = parseHtml("<div class=c>x</div>");
+            root->setAttribute("class", "c");
+            root->setAttribute("id", "r");
+            return root;
+        };
+        auto root = makeRoot();
+        Document document(root);
+        Document frozenSource(makeRoot());
+        auto frozen = frozenSource.freeze();
+        for (const std::string selector : {"root", "#r", ".c", "[id]", "*", ":not(div)"})
+        {
+            for (const auto &element : document.querySelectorAll(selector))
+            {
+                context.check(element != root, "Document 的结果包含根元素: " + selector);
+            }
+            for (const Element *element : frozen->querySelectorAll(selector))
+            {
+                context.check(element != frozen->getRoot(), "FrozenDocument 的结果包含根元素: " + selector);
+            }
+        }
+        context.expectEqual(tags(document.querySelectorAll(".c")), "div", "索引候选 .c");
+    }
+
+    // 订阅回调中修改文档后，同一次 flushChanges 中的 :has() 匹配和回调中的查询都看到修改后的树
+    inline void hasAfterCallbackMutation(Context &context)
+    {
+        auto root = parseHtml("<div id=d><i></i></div>");
+        Document document(root);
+        auto div = document.getElementById("d").front();
+        std::vector<std::string> hasEvents;
+        std::string queried;
+        bool mutated = false;
+        document.subscribe("div:has(b)", [&](const std::vector<std::shared_ptr<Element>> &added,
+                                             const std::vector<std::shared_ptr<Element>> &removed)
+                           { hasEvents.push_back("+" + tags(added) + " -" + tags(removed)); });
+        document.subscribe("span", [&](const std::vector<std::shared_ptr<Element>> &added,
+                                       const std::vector<std::shared_ptr<Element>> &)
+                           {
+            if (mutated || added.empty())
+            {
+                return;
+            }
+            mutated = true;
+            document.appendChild(div, createElement("b"));
+            queried = tags(document.querySelectorAll("div:has(b)")); });
+
+        document.appendChild(div, createElement("span"));
+        context.check(mutated, "span 的订阅回调没有执行");
+        context.expectEqual(queried, "div", "回调中的 :has() 查询应看到新加入的 <b>");
+        context.check(std::find(hasEvents.begin(), hasEvents.end(), "+div -") != hasEvents.end(),
+                      "div:has(b) 的订阅应收到 div");
+        context.expectEqual(tags(document.querySelectorAll("div:has(b)")), "div", "修改之后的 :has() 查询");
+    }
+
+    // 元素链接是否与 children 一致：firstElementChild/nextElementSibling 按顺序列出全部子元素，
+    // previousElementSibling 反向相同，parentElement 指向父元素
+    inline bool linksConsistent(const Element *parent)
+    {
+        std::vector<const Element *> elements;
+        for (const auto &child : parent->children)
+        {
+            if (child->nodeType == NodeType::Element)
+            {
+                elements.push_back(static_cast<const Element *>(child.get()));
+            }
+        }
+        const Element *previous = nullptr;
+        const Element *walk = parent->firstElementChild;
+        for (const Element *element : elements)
+        {
+            if (walk != element || element->parentElement != parent || element->previousElementSibling != previous ||
+                !linksConsistent(element))
+            {
+                return false;
+            }
+            previous = walk;
+            walk = walk->nextElementSibling;
+        }
+        return walk == nullptr && parent->lastElementChild == previous;
+    }
+
+    // 增删节点之后元素链接保持一致，兄弟组合器只看元素兄弟（跳过文本节点）
+    inline void elementLinks(Context &context)
+    {
+        auto root = parseHtml("<div id=d><a></a>文本<b></b><i></i><p>x</p></div>");
+        context.check(linksConsistent(root.get()), "解析得到的树链接不一致");
+        Document document(root);
+        context.expectEqual(tags(document.querySelectorAll("a + b")), "b", "a + b 应跳过中间的文本节点");
+
+        auto div = document.getElementById("d").front();
+        auto b = document.querySelectorAll("b").front();
+        auto p = document.querySelectorAll("p").front();
+        document.removeChild(div, b);
+        context.check(linksConsistent(root.get()), "移除中间元素后链接不一致");
+        context.expectEqual(tags(document.querySelectorAll("a + i")), "i", "移除 b 之后 a + i 应匹配");
+        document.appendChild(p, b);
+        context.check(linksConsistent(root.get()), "追加元素后链接不一致");
+        document.appendChild(div, document.querySelectorAll("a").front());
+        context.check(linksConsistent(root.get()), "移动元素后链接不一致");
+        context.expectEqual(shape(root.get()), "div(i,p(b),a)", "移动之后的树");
+        context.expectEqual(tags(document.querySelectorAll("i ~ a")), "a", "i ~ a");
+        context.expectEqual(describe(document.querySelectorAll("i ~ a")), describe(CssSelectorMatcher(root).match("i ~ a")),
+                            "Document 与 CssSelectorMatcher 的兄弟查询结果不同");
+        context.expectEqual(tags(document.querySelectorAll("div > :last-child")), "a", "最后一个子元素");
+    }
+
+    // 容错解析对不规范标记构建的树与浏览器一致
+    inline void parserRecovery(Context &context)
+    {
+        static const std::pair<const char *, const char *> CASES[] = {
+            {"<b>1<i>2</b>3</i>", "b(i),i"},
+            {"<p>a<div>b</div>", "p,div"},
+            {"<ul><li>a<li>b</ul>", "ul(li,li)"},
+            {"<dl><dt>a<dd>b<dt>c</dl>", "dl(dt,dd,dt)"},
+            {"<select><option>a<option>b</select>", "select(option,option)"},
+            {"x</p>y", "p"},
+            {"a</br>b", "br"},
+            {"<div></span>x</div>", "div"},
+            {"<a href=1>x<a href=2>y", "a,a"},
+            {"<h1>a<h2>b", "h1,h2"},
+            {"<p><b>x<p>y", "p(b),p(b)"},
+            // 格式化元素不跨单元格、行或表格重建
+            {"<table><tr><td><b>x</td><td>y</td></tr></table>", "table(tr(td(b),td))"},
+            {"<table><tr><td><a href=1>x</td></tr><tr><td>y</td></tr></table>", "table(tr(td(a)),tr(td))"},
+            {"<table><tr><td><a href=1>x<tr><td>y</table>", "table(tr(td(a)),tr(td))"},
+            {"<table><tr><td><table><tr><td><i>a</td></tr></table>b</td></tr></table>", "table(tr(td(table(tr(td(i))))))"},
+            // 表格之外被隐式关闭的格式化元素在表格之后重建
+            {"<p><b>x<table><tr><td>y</td></tr></table>z", "p(b),table(tr(td)),b"},
+            // 格式化元素的结束标签越过块级元素时按 adoption agency 处理
+            {"<div><b>1<p>2</b>3</p></div>", "div(b,p(b))"},
+            {"<b><i>1<p>2</b>3</i>", "b(i),i,p(i(b))"},
+            {"<a href=1><div>x<a href=2>y</a></div>", "a,div(a,a)"},
+            // 结束标签不越过作用域边界和特殊元素
+            {"<div><table><tr><td>x</div>y</td></tr></table>z</div>", "div(table(tr(td)))"},
+            {"<span><div>x</span>y</div>", "span(div)"},
+            {"<ul><li><div>a</li>b</div></ul>", "ul(li(div))"},
+        };
+        for (const auto &[html, expected] : CASES)
+        {
+            context.expectEqual(shape(parseHtml(html).get()), expected, html);
+        }
+        auto root = parseHtml("<table><tr><td><b>x</td><td>y</td></tr></table>");
+        Document document(root);
+        context.expectEqual(tags(document.querySelectorAll("tr > td")), "td td", "tr > td 应找到两个单元格");
+
+        // 移动后的节点保持文本顺序，文本表的范围和源文本范围仍然正确
+        auto adopted = parseHtml("<div id=d><b>1<p>2</b>3</p></div>");
+        Document adoptedDocument(adopted);
+        auto div = adoptedDocument.querySelectorAll("#d").front();
+        auto paragraph = adoptedDocument.querySelectorAll("p").front();
+        context.expectEqual(div->innerText(), "1\n2\n3\n", "adoption 之后 div 的文本");
+        context.expectEqual(paragraph->innerText(), "2\n3\n", "adoption 之后 p 的文本");
+        context.expectEqual(adoptedDocument.querySelectorAll("b").front()->innerText(), "1\n", "第一个 b 的文本");
+        context.expectEqual(paragraph->outerHTML(), "<p><b>2</b>3</p>", "adoption 之后 p 的 outerHTML");
+        auto cell = parseHtml("<div><table><tr><td>x</div>y</td></tr></table>z</div>");
+        Document cellDocument(cell);
+        context.expectEqual(cellDocument.querySelectorAll("td").front()->innerText(), "x\ny\n", "单元格中的 </div> 被忽略");
+    }
+
+    // 修改后 outerHTML 和 innerText 反映当前的树，包括修改解析器合成的元素（重建的格式化元素、</br>）和新建的元素
+    inline void sourceInvalidation(Context &context)
+    {
+        const std::string html = "<div id=d><b>1<i>2</b>3</i></div><p id=p>a</br>b</p><section id=s><span>x</span></section>";
+        auto root = parseHtml(html);
+        Document document(root);
+        auto div = document.getElementById("d").front();
+        context.expectEqual(div->outerHTML(), "<div id=d><b>1<i>2</b>3</i></div>", "未修改的元素取源文本");
+
+        auto clone = document.querySelectorAll("div > i").front();
+        context.check(clone->sourceStart == Element::NO_SOURCE, "重建的 <i> 不应有源文本范围");
+        document.setAttribute(clone, "class", "x");
+        context.check(div->outerHTML().find("class=\"x\"") != std::string::npos, "修改重建的 <i> 之后 div 的 outerHTML 没有更新: " + div->outerHTML());
+        document.setText(clone, "三");
+        context.check(div->outerHTML().find("三") != std::string::npos, "setText 之后 div 的 outerHTML 没有更新: " + div->outerHTML());
+        context.expectEqual(div->innerText(), "1\n2\n三\n", "setText 之后 div 的 innerText");
+
+        auto paragraph = document.getElementById("p").front();
+        auto br = document.querySelectorAll("p > br").front();
+        document.setAttribute(br, "class", "y");
+        context.check(paragraph->outerHTML().find("class=\"y\"") != std::string::npos, "修改 </br> 生成的 <br> 之后 p 的 outerHTML 没有更新");
+
+        auto section = document.getElementById("s").front();
+        auto created = createElement("em");
+        document.appendChild(section, created);
+        document.setText(created, "新");
+        context.check(section->outerHTML().find("<em>新</em>") != std::string::npos, "新建元素的修改没有反映到 section: " + section->outerHTML());
+        context.expectEqual(section->innerText(), "x\n新\n", "新建元素的文本没有反映到 section");
+
+        // 失去文本表范围的元素逐个节点累加哈希，与按 innerText 计算的结果相同；
+        // 仍有范围的元素取零拷贝切片
+        auto stringHash = [](const std::string &text)
+        {
+            uint64_t hash = 0;
+            for (char ch : text)
+            {
+                hash = hash * TextTable::HASH_BASE + static_cast<unsigned char>(ch);
+            }
+            return hash;
+        };
+        context.check(!section->hasTextRange() && section->textHash() == stringHash(section->innerText()), "修改后 section 的 textHash");
+        context.check(!root->hasTextRange() && root->textHash() == stringHash(root->innerText()), "修改后根的 textHash");
+        auto span = document.querySelectorAll("span").front();
+        context.check(span->hasTextRange() && span->innerTextView() == "x\n" && span->textHash() == stringHash("x\n"),
+                      "未修改的元素的 innerTextView 和 textHash");
+    }
+
+    // 属性选择器中的属性名不区分大小写（解析器已把属性名转为小写），格式错误的选择器抛出 std::invalid_argument
+    inline void attributeSelectors(Context &context)
+    {
+        const std::string html = "<div DATA-ID=7 Title=\"Hello\"><p data-id=8>x</p></div>";
+        Document document(parseHtml(html));
+        Document frozenSource(parseHtml(html));
+        auto frozen = frozenSource.freeze();
+        const std::vector<std::pair<std::string, std::string>> cases = {
+            {"[DATA-ID]", "div p"},
+            {"[data-id]", "div p"},
+            {"[Data-Id=\"7\"]", "div"},
+            {"div[TITLE^=Hel]", "div"},
+            {"[title=hello i]", "div"},
+        };
+        for (const auto &[selector, expected] : cases)
+        {
+            context.expectEqual(tags(document.querySelectorAll(selector)), expected, "Document: " + selector);
+            context.expectEqual(tags(frozen->querySelectorAll(selector)), expected, "FrozenDocument: " + selector);
+        }
+
+        for (const std::string selector : {"[", "[=x]", "[a=\"x]", "[a~x]"})
+        {
+            bool threw = false;
+            try
+            {
+                document.querySelectorAll(selector);
+            }
+            catch (const std::invalid_argument &)
+            {
+                threw = true;
+            }
+            context.check(threw, "格式错误的选择器没有抛出 std::invalid_argument: " + selector);
+        }
+    }
+
+    // 类型选择器不区分大小写：解析器把标签名转为小写，各个匹配器都按小写比较
+    inline void typeSelectorCase(Context &context)
+    {
+        const std::string html = "<DIV id=a><Span>x</Span></DIV><div id=b></div>";
+        auto root = parseHtml(html);
+        Document document(root);
+        Document frozenSource(parseHtml(html));
+        auto frozen = frozenSource.freeze();
+        context.expectEqual(tags(document.querySelectorAll("DIV")), "div div", "Document: DIV");
+        context.expectEqual(tags(frozen->querySelectorAll("DIV")), "div div", "FrozenDocument: DIV");
+        context.expectEqual(tags(document.querySelectorAll("Div > SPAN")), "span", "Document: Div > SPAN");
+        context.expectEqual(tags(frozen->querySelectorAll("DIV#b, SPAN")), "span div", "FrozenDocument: DIV#b, SPAN");
+        context.expectEqual(std::to_string(CssSelectorMatcher(root).match("DIV").size()), "2", "CssSelectorMatcher: DIV");
+        context.expectEqual(std::to_string(CssSelectorMatcher(root).match("DIV > Span").size()), "1", "CssSelectorMatcher: DIV > Span");
+
+        const Element *span = document.querySelectorAll("span").front().get();
+        context.check(SelectorProgram::compile("DIV#a > SPAN").matches(span), "SelectorProgram: DIV#a > SPAN");
+        context.check(!SelectorProgram::compile("P").matches(span), "SelectorProgram: P");
+#if __cplusplus >= 202002L
+        context.expectEqual(std::to_string(compileSelector<"DIV > SPAN">().match(root).size()), "1", "编译期选择器: DIV > SPAN");
+        context.expectEqual(std::to_string(compileSelector<"Div">().match(root).size()), "2", "编译期选择器: Div");
+#endif
+    }
+
+    // CssSelectorMatcher 的兄弟组合器与 Document 结果相同；~ 对每个兄弟只检查一次，长列表上是线性的
+    inline void siblingSelectors(Context &context)
+    {
+        auto root = parseHtml("<ul><li class=a>1<li>2<li class=a>3<li>4</ul><p>x<span>y</span><p>z<li class=a>5");
+        Document document(root);
+        for (const std::string selector : {"li ~ li", "li.a ~ li", "li ~ li.a", "li.a ~ li.a", "p ~ p", "li + li", "ul ~ p"})
+        {
+            auto expected = document.querySelectorAll(selector);
+            auto actual = CssSelectorMatcher(root).match(selector);
+            std::sort(expected.begin(), expected.end());
+            std::sort(actual.begin(), actual.end());
+            context.check(actual == expected, "CssSelectorMatcher 与 Document 的结果不同: " + selector + "（" +
+                                                  std::to_string(actual.size()) + " 个，期望 " + std::to_string(expected.size()) + " 个）");
+        }
+
+        std::string list = "<ul>";
+        for (size_t i = 0; i < 20000; ++i)
+        {
+            list += "<li>x</li>";
+        }
+        auto longList = parseHtml(list + "</ul>");
+        context.expectEqual(std::to_string(CssSelectorMatcher(longList).match("li ~ li").size()), "19999", "长列表上的 li ~ li");
+    }
+
+    // 匹配不向标准输出写任何内容（批处理的 JSON Lines 和服务模式的响应都写在标准输出上）
+    inline void matchingIsSilent(Context &context)
+    {
+        auto root = parseHtml("<p>中文</p><p><b>x</b></p>");
+        Document document(root);
+        std::ostringstream captured;
+        std::streambuf *original = std::cout.rdbuf(captured.rdbuf());
+        auto matched = tags(document.querySelectorAll("p::first-letter"));
+        auto frozen = document.freeze();
+        auto frozenMatched = tags(frozen->querySelectorAll("p::first-letter"));
+        std::cout.rdbuf(original);
+        context.expectEqual(matched, "p", "p::first-letter");
+        context.expectEqual(frozenMatched, "p", "冻结文档上的 p::first-letter");
+        context.expectEqual(captured.str(), "", "匹配时向标准输出写了内容");
+    }
+
+#ifdef COMPRESSION_HAS_ZLIB
+    inline std::string gzip(std::string_view data)
+    {
+        z_stream stream{};
+        deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+        std::string out(deflateBound(&stream, static_cast<uLong>(data.size())), '\0');
+        stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+        stream.avail_in = static_cast<uInt>(data.size());
+        stream.next_out = reinterpret_cast<Bytef *>(out.data());
+        stream.avail_out = static_cast<uInt>(out.size());
+        deflate(&stream, Z_FINISH);
+        out.resize(stream.total_out);
+        deflateEnd(&stream);
+        return out;
+    }
+#endif
+
+    inline BatchDocument parseContent(std::string_view content, const DocumentLimits &limits = DocumentLimits())
+    {
+        BatchDocument document;
+        document.content.assign(content.begin(), content.end());
+        BatchPipeline::parseDocument(document, limits);
+        return document;
+    }
+
+    // 批处理和服务模式的解析路径：压缩数据边解压边分块送入解析器，结果与一次性解析相同；
+    // 注释、DOCTYPE、script 和 style 由解析器处理，不需要预处理
+    inline void streamingParse(Context &context)
+    {
+        auto markup = parseContent("<!DOCTYPE html><!-- <p>注释</p> --><script>var s = '<p>';</script>"
+                                   "<style>p { color: red }</style><p>x</p>");
+        context.expectEqual(shape(markup.root.get()), "script,style,p", "注释被跳过，script/style 的内容不产生元素");
+        context.expectEqual(markup.root->innerText(), "x\n", "script/style 的内容不计入文本");
+
+        std::string html = sampleDocument(1000);
+        auto expected = parseHtml(html);
+        auto plain = parseContent(html);
+        context.expectEqual(shape(plain.root.get()), shape(expected.get()), "未压缩的文档");
+#ifdef COMPRESSION_HAS_ZLIB
+        std::string compressed = gzip(html);
+        context.check(html.size() > 2 * Decompressor::CHUNK_SIZE, "样例文档应跨越多个解压块");
+        auto streamed = parseContent(compressed);
+        context.expectEqual(shape(streamed.root.get()), shape(expected.get()), "gzip 文档的树");
+        context.expectEqual(streamed.root->innerText(), expected->innerText(), "gzip 文档的文本");
+
+        auto limited = parseContent(compressed, DocumentLimits{0, 100});
+        context.check(limited.status == BudgetStatus::NodeLimitExceeded && limited.usage.nodes <= 100,
+                      "超出节点预算后应停止解压和解析: " + formatUsage(limited.status, limited.usage));
+
+        std::string path = "/tmp/selftest-" + std::to_string(::getpid()) + ".html.gz";
+        std::ofstream(path, std::ios::binary) << compressed;
+        BatchDocument file;
+        file.path = path;
+        BatchPipeline::parseFile(file);
+        std::remove(path.c_str());
+        context.expectEqual(shape(file.root.get()), shape(expected.get()), "parseFile 读取 gzip 文件");
+#endif
+    }
+
+    // 读取阶段的错误记录在文档上，不中断整批处理
+    inline void readErrors(Context &context)
+    {
+        std::string directory = "/tmp/selftest-" + std::to_string(::getpid()) + ".dir";
+        std::filesystem::create_directory(directory);
+        std::string path = directory + "/a.html";
+        std::ofstream(path, std::ios::binary) << "<p>x</p>";
+
+        BatchDocument folder;
+        folder.path = directory;
+        BatchPipeline::readDocument(folder);
+        context.check(!folder.error.empty() && folder.content.empty(), "目录应报告错误");
+
+        BatchDocument missing;
+        missing.path = directory + "/missing.html";
+        BatchPipeline::readDocument(missing);
+        context.check(!missing.error.empty(), "不存在的文件应报告错误");
+
+        BatchDocument file;
+        file.path = path;
+        BatchPipeline::readDocument(file);
+        context.expectEqual(std::string(file.content.begin(), file.content.end()), "<p>x</p>", "读取文件内容");
+        context.check(file.error.empty(), "读取文件不应报告错误: " + file.error);
+
+        std::filesystem::remove_all(directory);
+    }
+
+    // 按 UTF-16 编码 UTF-8 文本（只含 BMP 字符），带 BOM
+    inline std::string utf16(std::string_view text, bool bigEndian)
+    {
+        std::string out = bigEndian ? "\xFE\xFF" : "\xFF\xFE";
+        for (size_t i = 0; i < text.size();)
+        {
+            unsigned char lead = static_cast<unsigned char>(text[i]);
+            size_t length = encoding::utf8Length(lead);
+            uint32_t codepoint = length == 1 ? lead : lead & (0xFF >> (length + 1));
+            for (size_t k = 1; k < length; ++k)
+            {
+                codepoint = (codepoint << 6) | (static_cast<unsigned char>(text[i + k]) & 0x3F);
+            }
+            i += length;
+            char high = static_cast<char>(codepoint >> 8), low = static_cast<char>(codepoint & 0xFF);
+            out += bigEndian ? std::string{high, low} : std::string{low, high};
+        }
+        return out;
+    }
+
+    // 含 NUL 字节的输入按长度解析，不在第一个 NUL 处截断
+    inline void encodedInput(Context &context)
+    {
+        const std::string html = "<html><body><p>甲</p><p class=x>乙</p></body></html>";
+        auto expected = parseHtml(html);
+        for (bool bigEndian : {false, true})
+        {
+            std::string bytes = utf16(html, bigEndian);
+            std::string label = bigEndian ? "UTF-16BE" : "UTF-16LE";
+
+            auto root = createElement("root");
+            Parser parser;
+            parser.parse(bytes, root);
+            context.check(parser.getCharset() == (bigEndian ? Charset::Utf16BE : Charset::Utf16LE), label + " 的 BOM");
+            context.expectEqual(shape(root.get()), shape(expected.get()), label + " Parser::parse");
+            context.expectEqual(root->innerText(), expected->innerText(), label + " 文本");
+
+            auto document = parseContent(bytes);
+            context.expectEqual(shape(document.root.get()), shape(expected.get()), label + " 批处理解析");
+#ifdef COMPRESSION_HAS_ZLIB
+            auto compressed = parseContent(gzip(bytes));
+            context.expectEqual(shape(compressed.root.get()), shape(expected.get()), label + " gzip 批处理解析");
+#endif
+        }
+
+#ifdef ENCODING_HAS_ICONV
+        // "中文" 的 GBK 编码
+        auto gbk = parseContent("<meta charset=gbk><p>\xD6\xD0\xCE\xC4</p>");
+        context.expectEqual(gbk.root->innerText(), "中文\n", "GBK 文档");
+#endif
+    }
+
+    // 记录的字段值，如 "title=A|link=/a|tags=x,y|variants=[name=v1][name=v2]"
+    inline std::string flatten(const ExtractedRecord &record, const ExtractionTemplate &extraction, size_t shape = 0)
+    {
+        std::string out;
+        const auto &fields = extraction.record(shape).fields;
+        for (size_t i = 0; i < fields.size(); ++i)
+        {
+            out += (i ? "|" : "") + fields[i].name + "=";
+            const auto &values = record.fields[i].values;
+            for (size_t j = 0; j < values.size(); ++j)
+            {
+                out += (j ? "," : "") + values[j];
+            }
+            for (const auto &nested : record.fields[i].records)
+            {
+                out += "[" + flatten(nested, extraction, fields[i].nested) + "]";
+            }
+        }
+        return out;
+    }
+
+    // 字段的文本值：各文本节点以空格连接
+    inline std::string fieldText(const Element *element)
+    {
+        std::string text = element->innerText();
+        std::replace(text.begin(), text.end(), '\n', ' ');
+        if (!text.empty())
+        {
+            text.pop_back();
+        }
+        return text;
+    }
+
+    // 提取模板的取值规则，以及单次遍历与逐记录逐字段查询的结果一致
+    inline void extractionTemplate(Context &context)
+    {
+        auto root = parseHtml("<div class=product data-id=7><h2>A</h2><a href=/a>x</a><a href=/b>y</a>"
+                              "<span class=tag>x</span><span class=tag>y</span>"
+                              "<div class=variant><b class=name>v1</b></div><div class=variant><b class=name>v2</b></div></div>"
+                              "<div class=product><h2>B <i>2</i></h2><a>无链接</a></div>");
+        auto extraction = ExtractionTemplate::parse(
+            "div.product { /* 注释 */ id: @DATA-ID; title: h2; link: a @href; links[]: a @href; tags[]: .tag;"
+            " variants[]: .variant { name: .name; } }");
+        auto records = extraction.extract(root);
+        context.check(records.size() == 2, "应提取 2 条记录");
+        if (records.size() == 2)
+        {
+            context.expectEqual(flatten(records[0], extraction),
+                                "id=7|title=A|link=/a|links=/a,/b|tags=x,y|variants=[name=v1][name=v2]", "第一条记录");
+            context.expectEqual(flatten(records[1], extraction), "id=|title=B 2|link=|links=|tags=|variants=",
+                                "第二条记录（缺少属性时不产生值）");
+        }
+
+        auto sample = parseHtml(sampleDocument(200));
+        auto bulk = ExtractionTemplate::parse("div.item { title: h2; link: a @href; tags[]: li; }");
+        auto extracted = bulk.extract(sample);
+        Document document(sample);
+        auto items = document.querySelectorAll("div.item");
+        context.check(extracted.size() == items.size() && !items.empty(), "记录数与 div.item 的匹配数不同");
+        for (size_t i = 0; i < std::min(extracted.size(), items.size()); ++i)
+        {
+            // CssSelectorMatcher 的结果不一定按文档顺序，Document 已为元素编号
+            CssSelectorMatcher scoped(items[i]);
+            auto query = [&scoped](const std::string &selector)
+            {
+                auto found = scoped.match(selector);
+                std::sort(found.begin(), found.end(), [](const auto &a, const auto &b)
+                          { return a->order < b->order; });
+                return found;
+            };
+            auto titles = query("h2");
+            auto links = query("a");
+            std::string expected = "title=" + (titles.empty() ? "" : fieldText(titles.front().get())) +
+                                   "|link=" + (links.empty() ? "" : std::string(links.front()->getAttribute(AttributeNames::Href)->value())) +
+                                   "|tags=";
+            auto tagElements = query("li");
+            for (size_t j = 0; j < tagElements.size(); ++j)
+            {
+                expected += (j ? "," : "") + fieldText(tagElements[j].get());
+            }
+            context.expectEqual(flatten(extracted[i], bulk), expected, "第 " + std::to_string(i) + " 条记录与逐字段查询不同");
+        }
+
+        bool threw = false;
+        try
+        {
+            ExtractionTemplate::parse("div { title h2 }");
+        }
+        catch (const std::invalid_argument &)
+        {
+            threw = true;
+        }
+        context.check(threw, "格式错误的模板没有抛出 std::invalid_argument");
+    }
+
+#if __cplusplus >= 202002L
+    template <FixedString Text>
+    void expectSameAsRuntime(Context &context, const std::shared_ptr<Element> &root)
+    {
+        std::string selector(Text.view());
+        auto expected = CssSelectorMatcher(root).match(selector);
+        context.check(!expected.empty(), "样例文档中没有匹配 " + selector + " 的元素");
+        // CssSelectorMatcher 的逗号和兄弟查询按指针排序，只比较元素集合
+        auto actual = compileSelector<Text>().match(root);
+        std::sort(actual.begin(), actual.end());
+        std::sort(expected.begin(), expected.end());
+        context.check(actual == expected, "编译期选择器与 CssSelectorMatcher 的结果不同: " + selector + "（" +
+                                              std::to_string(actual.size()) + " 个，期望 " + std::to_string(expected.size()) + " 个）");
+    }
+
+    // 编译期选择器与运行时匹配器对同一文档给出相同的结果
+    inline void staticSelectorEquivalence(Context &context)
+    {
+        auto root = parseHtml(sampleDocument(60));
+        expectSameAsRuntime<"div li">(context, root);
+        expectSameAsRuntime<".item > ul > li">(context, root);
+        expectSameAsRuntime<"div.item#n4 > h2">(context, root);
+        expectSameAsRuntime<"div.hot a">(context, root);
+        expectSameAsRuntime<"h2 + ul">(context, root);
+        expectSameAsRuntime<"li ~ li">(context, root);
+        expectSameAsRuntime<"li:first-child">(context, root);
+        expectSameAsRuntime<"ul > li:last-child">(context, root);
+        expectSameAsRuntime<"ul > li:only-child">(context, root);
+        expectSameAsRuntime<"p b, h2">(context, root);
+        expectSameAsRuntime<"body * > b">(context, root);
+    }
+#endif
+
+    inline const std::vector<TestCase> &cases()
+    {
+        static const std::vector<TestCase> all = {
+            {"frozen.concurrent-queries", frozenConcurrentQueries},
+            {"frozen.parallel-queries", parallelQueries},
+            {"document.root-excluded", rootExcluded},
+            {"document.has-after-mutation", hasAfterCallbackMutation},
+            {"element.links", elementLinks},
+            {"parser.recovery", parserRecovery},
+            {"element.source-invalidation", sourceInvalidation},
+            {"selector.attributes", attributeSelectors},
+            {"selector.type-case", typeSelectorCase},
+            {"selector.siblings", siblingSelectors},
+            {"selector.silent", matchingIsSilent},
+            {"extraction.template", extractionTemplate},
+            {"pipeline.streaming", streamingParse},
+            {"pipeline.read-errors", readErrors},
+            {"parser.encoded-input", encodedInput},
+#if __cplusplus >= 202002L
+            {"selector.static-equivalence", staticSelectorEquivalence},
+#endif
+        };
+        return all;
+    }
+
+    // 运行名称以 prefix 开头的用例，返回失败的用例数
+    inline int run(std::string_view prefix)
+    {
+        size_t ran = 0;
+        size_t failed = 0;
+        for (const auto &testCase : cases())
+        {
+            if (std::string_view(testCase.name).substr(0, prefix.size()) != prefix)
+            {
+                continue;
+            }
+            Context context(testCase.name);
+            try
+            {
+                testCase.body(context);
+            }
+            catch (const std::exception &e)
+            {
+                context.check(false, std::string("异常: ") + e.what());
+            }
+            ++ran;
+            failed += context.failed() ? 1 : 0;
+            std::cerr << (context.failed() ? "FAIL " : "ok   ") << testCase.name << std::endl;
+        }
+        std::cerr << ran << " 个用例，" << failed << " 个失败" << std::endl;
+        return static_cast<int>(failed);
+    }
+}
+
+#endif
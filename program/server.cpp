@@ -0,0 +1,715 @@
+#ifndef SERVER_CPP
+#define SERVER_CPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <map>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "element.cpp"
+#include "document.cpp"
+#include "extraction.cpp"
+#include "output.cpp"
+#include "pipeline.cpp"
+#include "threadpool.cpp"
+
+// 每种请求的延迟统计。直方图按 2 的幂划分微秒数，分位数取所在桶的上界，误差不超过 2 倍；
+// 计数都是原子变量，记录时不加锁
+class LatencyMetrics
+{
+public:
+    static constexpr size_t BUCKETS = 40;
+
+private:
+    struct Histogram
+    {
+        std::atomic<uint64_t> count{0};
+        std::atomic<uint64_t> totalMicros{0};
+        std::atomic<uint64_t> maxMicros{0};
+        std::atomic<uint64_t> buckets[BUCKETS] = {};
+    };
+
+    std::vector<std::string> names;
+    std::unique_ptr<Histogram[]> histograms;
+
+    static size_t bucketOf(uint64_t micros)
+    {
+        size_t bucket = 0;
+        while (micros > 0 && bucket + 1 < BUCKETS)
+        {
+            micros >>= 1;
+            ++bucket;
+        }
+        return bucket;
+    }
+
+    // 第 bucket 个桶的上界（微秒）
+    static uint64_t bucketLimit(size_t bucket)
+    {
+        return bucket == 0 ? 0 : (uint64_t(1) << bucket) - 1;
+    }
+
+    static uint64_t percentile(const Histogram &histogram, uint64_t count, double fraction)
+    {
+        uint64_t rank = static_cast<uint64_t>(fraction * static_cast<double>(count - 1)) + 1;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BUCKETS; ++i)
+        {
+            seen += histogram.buckets[i];
+            if (seen >= rank)
+            {
+                return std::min(bucketLimit(i), histogram.maxMicros.load());
+            }
+        }
+        return histogram.maxMicros;
+    }
+
+public:
+    explicit LatencyMetrics(std::vector<std::string> requestNames)
+        : names(std::move(requestNames)), histograms(new Histogram[names.size()])
+    {
+    }
+
+    void record(size_t kind, uint64_t micros)
+    {
+        Histogram &histogram = histograms[kind];
+        ++histogram.count;
+        histogram.totalMicros += micros;
+        ++histogram.buckets[bucketOf(micros)];
+        uint64_t previous = histogram.maxMicros;
+        while (micros > previous && !histogram.maxMicros.compare_exchange_weak(previous, micros))
+        {
+        }
+    }
+
+    // 每种请求一行：名称 count avg_us p50_us p90_us p99_us max_us
+    std::string report() const
+    {
+        std::string out;
+        for (size_t i = 0; i < names.size(); ++i)
+        {
+            const Histogram &histogram = histograms[i];
+            uint64_t count = histogram.count;
+            if (count == 0)
+            {
+                continue;
+            }
+            out += names[i] + " count=" + std::to_string(count) +
+                   " avg_us=" + std::to_string(histogram.totalMicros / count) +
+                   " p50_us=" + std::to_string(percentile(histogram, count, 0.5)) +
+                   " p90_us=" + std::to_string(percentile(histogram, count, 0.9)) +
+                   " p99_us=" + std::to_string(percentile(histogram, count, 0.99)) +
+                   " max_us=" + std::to_string(histogram.maxMicros) + "\n";
+        }
+        return out;
+    }
+};
+
+// 常驻查询服务：解析后的文档和编译后的选择器、提取模板常驻内存，请求在线程池中并发执行，
+// QUERY 和 COUNT 的候选元素在同一个线程池中分块并行验证。
+//
+// 协议（Unix 域套接字或标准输入/输出上相同）：每个请求是一行
+//     <id> <命令> [参数...]
+// 最后一个参数（选择器、模板）取到行尾。命令：
+//     LOAD <name> <path>      读取并解析文件（可以是 gzip/zstd 压缩的），以 name 常驻
+//     PUT <name> <length>     之后紧跟 length 字节的 HTML，解析后以 name 常驻
+//                             LOAD 和 PUT 返回文档的内存占用（格式见 formatUsage）；超出预算时
+//                             status 不是 ok，常驻的是截断的文档
+//     DROP <name>             释放文档
+//     QUERY <name> <selector> 匹配的元素，每行一个 JSON 对象（格式同 --format jsonl）
+//     COUNT <name> <selector> 匹配的元素个数
+//     EXTRACT <name> <template> 按提取模板（写在一行内）提取的记录，每行一个 JSON 对象
+//     STATS                   各命令的延迟统计和线程池各工作线程的任务数、窃取数、利用率
+// 每个响应是
+//     <id> OK|ERR <length> <latency_us>\n<length 字节的内容>
+// 同一连接上的请求可以流水线发送，响应按完成顺序返回，用 id 对应；latency_us 从读到请求开始计时。
+// 同一连接上涉及同一文档的请求按发送顺序生效：LOAD/PUT/DROP 等到之前涉及该文档的请求完成后才执行，
+// 之后涉及该文档的请求等它完成；其余请求并发执行。
+// 每个连接同时在执行和排队的请求不超过 MAX_IN_FLIGHT 个，超过时暂停读取该连接（反压）。
+// PUT 的内容不能超过字节预算（没有预算时为 MAX_BODY），超出时内容被读取并丢弃，请求返回错误。
+class QueryServer
+{
+public:
+    static constexpr size_t MAX_IN_FLIGHT = 64;
+    static constexpr size_t MAX_LINE = 1 << 20;
+    static constexpr size_t MAX_BODY = size_t(1) << 30;
+
+private:
+    enum RequestKind
+    {
+        Load,
+        Put,
+        Drop,
+        Query,
+        Count,
+        Extract,
+        Stats,
+        Invalid,
+    };
+
+    struct Request
+    {
+        std::string id;
+        RequestKind kind = Invalid;
+        std::string name;
+        std::string argument; // 路径、选择器或模板
+        std::string body;     // PUT 的内容
+        std::string error;    // 读取请求时发现的错误，执行时报告
+        std::chrono::steady_clock::time_point received;
+    };
+
+    // 一个连接上按文档排序请求：修改文档的请求（LOAD/PUT/DROP）独占该文档，只读请求之间共享。
+    // 不能立即执行的请求按到达顺序排队，排在队首之后的请求即使可以执行也要等待，保证先后顺序
+    class DocumentOrdering
+    {
+    private:
+        struct State
+        {
+            size_t readers = 0;
+            bool writing = false;
+            std::deque<std::shared_ptr<Request>> waiting;
+        };
+
+        std::mutex mutex;
+        std::unordered_map<std::string, State> states;
+
+        static bool isWrite(RequestKind kind)
+        {
+            return kind == Load || kind == Put || kind == Drop;
+        }
+
+        static bool tryStart(State &state, RequestKind kind)
+        {
+            if (state.writing || (isWrite(kind) && state.readers > 0))
+            {
+                return false;
+            }
+            if (isWrite(kind))
+            {
+                state.writing = true;
+            }
+            else
+            {
+                ++state.readers;
+            }
+            return true;
+        }
+
+    public:
+        // 请求可以立即执行时返回 true，否则排队
+        bool admit(const std::shared_ptr<Request> &request)
+        {
+            if (request->name.empty())
+            {
+                return true;
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            State &state = states[request->name];
+            if (state.waiting.empty() && tryStart(state, request->kind))
+            {
+                return true;
+            }
+            state.waiting.push_back(request);
+            return false;
+        }
+
+        // 请求执行完毕，返回因此可以执行的排队请求
+        std::vector<std::shared_ptr<Request>> complete(const Request &request)
+        {
+            std::vector<std::shared_ptr<Request>> ready;
+            if (request.name.empty())
+            {
+                return ready;
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = states.find(request.name);
+            State &state = it->second;
+            if (isWrite(request.kind))
+            {
+                state.writing = false;
+            }
+            else
+            {
+                --state.readers;
+            }
+            while (!state.waiting.empty() && tryStart(state, state.waiting.front()->kind))
+            {
+                ready.push_back(std::move(state.waiting.front()));
+                state.waiting.pop_front();
+            }
+            if (state.readers == 0 && !state.writing && state.waiting.empty())
+            {
+                states.erase(it);
+            }
+            return ready;
+        }
+    };
+
+    // 一个客户端连接：按行读取请求，响应整块写回（写入加锁，不同请求的响应不会交错）
+    class Connection
+    {
+    private:
+        int inFd;
+        int outFd;
+        bool ownsFd;
+        std::string buffer;
+        size_t pos = 0;
+        std::mutex writeMutex;
+        std::mutex flightMutex;
+        std::condition_variable flightDone;
+        size_t inFlight = 0;
+        DocumentOrdering documentOrdering;
+
+        bool fill()
+        {
+            if (pos > 0)
+            {
+                buffer.erase(0, pos);
+                pos = 0;
+            }
+            char chunk[64 * 1024];
+            while (true)
+            {
+                ssize_t got = ::read(inFd, chunk, sizeof(chunk));
+                if (got < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                if (got <= 0)
+                {
+                    return false;
+                }
+                buffer.append(chunk, static_cast<size_t>(got));
+                return true;
+            }
+        }
+
+    public:
+        Connection(int input, int output, bool owns) : inFd(input), outFd(output), ownsFd(owns) {}
+
+        ~Connection()
+        {
+            if (ownsFd)
+            {
+                ::close(inFd);
+            }
+        }
+
+        // 读取一行（不含换行）；连接关闭时返回 false
+        bool readLine(std::string &line)
+        {
+            while (true)
+            {
+                size_t end = buffer.find('\n', pos);
+                if (end != std::string::npos)
+                {
+                    line.assign(buffer, pos, end - pos);
+                    if (!line.empty() && line.back() == '\r')
+                    {
+                        line.pop_back();
+                    }
+                    pos = end + 1;
+                    return true;
+                }
+                if (buffer.size() - pos > MAX_LINE || !fill())
+                {
+                    return false;
+                }
+            }
+        }
+
+        // 读取并丢弃 length 字节；连接关闭时返回 false
+        bool skipBytes(size_t length)
+        {
+            while (buffer.size() - pos < length)
+            {
+                length -= buffer.size() - pos;
+                pos = buffer.size();
+                if (!fill())
+                {
+                    return false;
+                }
+            }
+            pos += length;
+            return true;
+        }
+
+        bool readBytes(size_t length, std::string &out)
+        {
+            while (buffer.size() - pos < length)
+            {
+                if (!fill())
+                {
+                    return false;
+                }
+            }
+            out.assign(buffer, pos, length);
+            pos += length;
+            return true;
+        }
+
+        void respond(const std::string &id, bool ok, const std::string &payload, uint64_t micros)
+        {
+            std::string header = id + (ok ? " OK " : " ERR ") + std::to_string(payload.size()) + " " +
+                                 std::to_string(micros) + "\n";
+            std::lock_guard<std::mutex> lock(writeMutex);
+            OutputBuffer out(outFd, 4096);
+            out.append(header);
+            out.append(payload);
+            out.flush();
+        }
+
+        void beginRequest()
+        {
+            std::unique_lock<std::mutex> lock(flightMutex);
+            flightDone.wait(lock, [this]
+                            { return inFlight < MAX_IN_FLIGHT; });
+            ++inFlight;
+        }
+
+        void endRequest()
+        {
+            std::lock_guard<std::mutex> lock(flightMutex);
+            --inFlight;
+            flightDone.notify_all();
+        }
+
+        DocumentOrdering &ordering()
+        {
+            return documentOrdering;
+        }
+
+        // 等待该连接上的请求全部完成
+        void drain()
+        {
+            std::unique_lock<std::mutex> lock(flightMutex);
+            flightDone.wait(lock, [this]
+                            { return inFlight == 0; });
+        }
+    };
+
+    ThreadPool &pool;
+    DocumentLimits limits;
+    LatencyMetrics metrics{{"LOAD", "PUT", "DROP", "QUERY", "COUNT", "EXTRACT", "STATS", "INVALID"}};
+    mutable std::shared_mutex documentsMutex;
+    std::unordered_map<std::string, std::shared_ptr<const FrozenDocument>> documents;
+    std::mutex templatesMutex;
+    std::map<std::string, std::shared_ptr<const ExtractionTemplate>> templates;
+
+    static RequestKind kindOf(std::string_view command)
+    {
+        static const std::pair<std::string_view, RequestKind> COMMANDS[] = {
+            {"LOAD", Load}, {"PUT", Put}, {"DROP", Drop}, {"QUERY", Query}, {"COUNT", Count}, {"EXTRACT", Extract}, {"STATS", Stats}};
+        for (const auto &[name, kind] : COMMANDS)
+        {
+            if (command == name)
+            {
+                return kind;
+            }
+        }
+        return Invalid;
+    }
+
+    // 取出下一个以空格分隔的词
+    static std::string_view nextWord(std::string_view &rest)
+    {
+        size_t start = rest.find_first_not_of(' ');
+        if (start == std::string_view::npos)
+        {
+            rest = std::string_view();
+            return std::string_view();
+        }
+        size_t end = rest.find(' ', start);
+        std::string_view word = rest.substr(start, end == std::string_view::npos ? std::string_view::npos : end - start);
+        rest = end == std::string_view::npos ? std::string_view() : rest.substr(end + 1);
+        return word;
+    }
+
+    std::shared_ptr<const FrozenDocument> findDocument(const std::string &name) const
+    {
+        std::shared_lock<std::shared_mutex> lock(documentsMutex);
+        auto it = documents.find(name);
+        if (it == documents.end())
+        {
+            throw std::invalid_argument("没有名为 " + name + " 的文档");
+        }
+        return it->second;
+    }
+
+    // 常驻已解析的文档，返回内存占用报告
+    std::string storeDocument(const std::string &name, BatchDocument &document)
+    {
+        Document indexed(document.root);
+        auto frozen = indexed.freeze();
+        {
+            std::unique_lock<std::shared_mutex> lock(documentsMutex);
+            documents[name] = std::move(frozen);
+        }
+        return formatUsage(document.status, document.usage) + "\n";
+    }
+
+    std::shared_ptr<const ExtractionTemplate> findTemplate(const std::string &text)
+    {
+        std::lock_guard<std::mutex> lock(templatesMutex);
+        auto it = templates.find(text);
+        if (it == templates.end())
+        {
+            it = templates.emplace(text, std::make_shared<const ExtractionTemplate>(ExtractionTemplate::parse(text))).first;
+        }
+        return it->second;
+    }
+
+    // 执行请求，返回响应内容；错误以异常报告
+    std::string execute(Request &request)
+    {
+        if (!request.error.empty())
+        {
+            throw std::invalid_argument(request.error);
+        }
+        std::string payload;
+        switch (request.kind)
+        {
+        case Load:
+        {
+            BatchDocument document;
+            document.path = request.argument;
+            BatchPipeline::parseFile(document, limits);
+            payload = storeDocument(request.name, document);
+            break;
+        }
+        case Put:
+        {
+            BatchDocument document;
+            document.content.assign(request.body.begin(), request.body.end());
+            std::string().swap(request.body);
+            BatchPipeline::parseDocument(document, limits);
+            payload = storeDocument(request.name, document);
+            break;
+        }
+        case Drop:
+        {
+            std::unique_lock<std::shared_mutex> lock(documentsMutex);
+            if (documents.erase(request.name) == 0)
+            {
+                throw std::invalid_argument("没有名为 " + request.name + " 的文档");
+            }
+            break;
+        }
+        case Query:
+        {
+            auto document = findDocument(request.name);
+            OutputBuffer out(payload);
+            JsonLinesWriter writer(out, nullptr);
+            for (const Element *element : document->querySelectorAll(request.argument, pool))
+            {
+                writer.writeMatch(request.name, element);
+            }
+            writer.finish();
+            break;
+        }
+        case Count:
+            payload = std::to_string(findDocument(request.name)->querySelectorAll(request.argument, pool).size());
+            break;
+        case Extract:
+        {
+            auto document = findDocument(request.name);
+            auto extraction = findTemplate(request.argument);
+            OutputBuffer out(payload);
+            JsonLinesWriter writer(out, extraction.get());
+            for (const auto &record : extraction->extract(document->getRoot()))
+            {
+                writer.writeRecord(request.name, record);
+            }
+            writer.finish();
+            break;
+        }
+        case Stats:
+            payload = statistics();
+            break;
+        default:
+            throw std::invalid_argument("未知的请求");
+        }
+        return payload;
+    }
+
+    void dispatch(const std::shared_ptr<Connection> &connection, const std::shared_ptr<Request> &request)
+    {
+        connection->beginRequest();
+        if (connection->ordering().admit(request))
+        {
+            submit(connection, request);
+        }
+    }
+
+    // 在线程池中执行请求并回复，然后放行该连接上等待它的请求
+    void submit(const std::shared_ptr<Connection> &connection, const std::shared_ptr<Request> &request)
+    {
+        pool.submit([this, connection, request]
+                    {
+            bool ok = true;
+            std::string payload;
+            try
+            {
+                payload = execute(*request);
+            }
+            catch (const std::exception &e)
+            {
+                ok = false;
+                payload = e.what();
+            }
+            uint64_t micros = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                                                        std::chrono::steady_clock::now() - request->received)
+                                                        .count());
+            metrics.record(request->kind, micros);
+            try
+            {
+                connection->respond(request->id, ok, payload, micros);
+            }
+            catch (const std::exception &)
+            {
+                // 客户端已断开，丢弃响应
+            }
+            for (const auto &next : connection->ordering().complete(*request))
+            {
+                submit(connection, next);
+            }
+            connection->endRequest(); });
+    }
+
+    // 读取一个连接上的全部请求，返回时该连接上的请求都已完成
+    void serveConnection(const std::shared_ptr<Connection> &connection)
+    {
+        std::string line;
+        while (connection->readLine(line))
+        {
+            if (line.empty())
+            {
+                continue;
+            }
+            auto request = std::make_shared<Request>();
+            request->received = std::chrono::steady_clock::now();
+            std::string_view rest(line);
+            request->id = std::string(nextWord(rest));
+            request->kind = kindOf(nextWord(rest));
+            if (request->kind != Stats && request->kind != Invalid)
+            {
+                request->name = std::string(nextWord(rest));
+                size_t start = rest.find_first_not_of(' ');
+                request->argument = start == std::string_view::npos ? std::string() : std::string(rest.substr(start));
+                bool needsArgument = request->kind != Drop;
+                if (request->name.empty() || (needsArgument && request->argument.empty()))
+                {
+                    request->kind = Invalid;
+                }
+            }
+            if (request->kind == Put)
+            {
+                char *end = nullptr;
+                unsigned long long length = std::strtoull(request->argument.c_str(), &end, 10);
+                if (*end != '\0')
+                {
+                    break;
+                }
+                // 超出预算的内容不分配内存，读取后丢弃
+                size_t maxBody = limits.maxBytes ? std::min(limits.maxBytes, MAX_BODY) : MAX_BODY;
+                if (length > maxBody)
+                {
+                    if (!connection->skipBytes(static_cast<size_t>(length)))
+                    {
+                        break;
+                    }
+                    request->error = "PUT 的内容超过 " + std::to_string(maxBody) + " 字节的上限";
+                }
+                else if (!connection->readBytes(static_cast<size_t>(length), request->body))
+                {
+                    break;
+                }
+            }
+            dispatch(connection, request);
+        }
+        connection->drain();
+    }
+
+public:
+    explicit QueryServer(ThreadPool &threadPool, DocumentLimits documentLimits = DocumentLimits())
+        : pool(threadPool), limits(documentLimits)
+    {
+    }
+
+    // 在标准输入/输出上服务，直到输入结束
+    void serveStdio()
+    {
+        std::signal(SIGPIPE, SIG_IGN);
+        serveConnection(std::make_shared<Connection>(STDIN_FILENO, STDOUT_FILENO, false));
+    }
+
+    // 在 Unix 域套接字上服务（已存在的套接字文件会被替换），每个连接由一个线程读取请求。不会返回，出错时抛出异常
+    void serveSocket(const std::string &path)
+    {
+        std::signal(SIGPIPE, SIG_IGN);
+        sockaddr_un address{};
+        if (path.size() >= sizeof(address.sun_path))
+        {
+            throw std::invalid_argument("套接字路径过长: " + path);
+        }
+        address.sun_family = AF_UNIX;
+        std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+        int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listener < 0)
+        {
+            throw std::runtime_error(std::string("无法创建套接字: ") + std::strerror(errno));
+        }
+        ::unlink(path.c_str());
+        if (::bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0 || ::listen(listener, 64) < 0)
+        {
+            int error = errno;
+            ::close(listener);
+            throw std::runtime_error("无法监听 " + path + ": " + std::strerror(error));
+        }
+        while (true)
+        {
+            int client = ::accept(listener, nullptr, nullptr);
+            if (client < 0)
+            {
+                if (errno == EINTR || errno == ECONNABORTED)
+                {
+                    continue;
+                }
+                int error = errno;
+                ::close(listener);
+                throw std::runtime_error(std::string("accept 失败: ") + std::strerror(error));
+            }
+            auto connection = std::make_shared<Connection>(client, client, true);
+            std::thread([this, connection]
+                        { serveConnection(connection); })
+                .detach();
+        }
+    }
+
+    // 各命令的延迟统计，之后是线程池各工作线程的统计
+    std::string statistics() const
+    {
+        return metrics.report() + pool.report();
+    }
+};
+
+#endif
@@ -0,0 +1,411 @@
+#ifndef STATICSELECTOR_CPP
+#define STATICSELECTOR_CPP
+
+// 编译期选择器：compileSelector<"div.item > a">() 在编译期按 tokenize()/MatchSelector 的语法解析选择器，
+// 生成的匹配器类型中每个原子检查都是内联的常量比较，运行时没有解析、按选择器种类的分支和动态字符串。
+// 需要 C++20（字符串字面量作为模板参数）。
+#if __cplusplus >= 202002L
+
+#include <string_view>
+#include <array>
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <utility>
+#include "element.cpp"
+#include "selectormatcher.cpp"
+
+template <size_t N>
+struct FixedString
+{
+    char data[N]{};
+
+    constexpr FixedString(const char (&text)[N])
+    {
+        for (size_t i = 0; i < N; ++i)
+        {
+            data[i] = text[i];
+        }
+    }
+
+    constexpr std::string_view view() const
+    {
+        return std::string_view(data, N - 1);
+    }
+};
+
+namespace staticselector
+{
+    constexpr size_t MAX_ALTERNATIVES = 4;
+    constexpr size_t MAX_PARTS = 8;
+    constexpr size_t MAX_ATOMS = 8;
+
+    enum class AtomKind
+    {
+        Tag,
+        Class,
+        Id,
+        FirstChild,
+        LastChild,
+        OnlyChild,
+        FirstOfType,
+        Empty,
+    };
+
+    // 原子只记录在选择器文字中的位置，名字在编译期取出
+    struct Atom
+    {
+        AtomKind kind = AtomKind::Tag;
+        size_t offset = 0;
+        size_t length = 0;
+    };
+
+    struct Compound
+    {
+        Atom atoms[MAX_ATOMS]{};
+        size_t atomCount = 0;
+        SelectorType combinator = SelectorType::Simple;
+    };
+
+    struct Complex
+    {
+        Compound parts[MAX_PARTS]{};
+        size_t partCount = 0;
+    };
+
+    struct Parsed
+    {
+        Complex alternatives[MAX_ALTERNATIVES]{};
+        size_t alternativeCount = 0;
+        const char *error = nullptr;
+    };
+
+    // 类型选择器的小写形式：解析器把标签名转为小写，匹配时不区分大小写
+    template <size_t N>
+    constexpr std::array<char, N> lowercase(std::string_view text)
+    {
+        std::array<char, N> out{};
+        for (size_t i = 0; i < N; ++i)
+        {
+            out[i] = text[i] >= 'A' && text[i] <= 'Z' ? static_cast<char>(text[i] - 'A' + 'a') : text[i];
+        }
+        return out;
+    }
+
+    constexpr bool isCombinator(char ch)
+    {
+        return ch == '>' || ch == '+' || ch == '~' || ch == ',' || ch == ' ';
+    }
+
+    constexpr bool isAtomStart(char ch)
+    {
+        return ch == '.' || ch == '#' || ch == ':';
+    }
+
+    // 解析一个复合选择器，如 div.item#main:first-child；* 不产生原子
+    constexpr void parseCompound(std::string_view text, Compound &compound, Parsed &parsed)
+    {
+        size_t pos = 0;
+        while (pos < text.size() && !parsed.error)
+        {
+            char lead = text[pos];
+            size_t start = isAtomStart(lead) ? pos + 1 : pos;
+            if (lead == ':' && start < text.size() && text[start] == ':')
+            {
+                ++start;
+            }
+            size_t end = start;
+            while (end < text.size() && !isAtomStart(text[end]))
+            {
+                ++end;
+            }
+            std::string_view name = text.substr(start, end - start);
+            pos = end;
+
+            if (lead == '*' && name == "*")
+            {
+                continue;
+            }
+            if (name.empty())
+            {
+                parsed.error = "空的选择器原子";
+                return;
+            }
+            Atom atom{AtomKind::Tag, start, name.size()};
+            if (lead == '.')
+            {
+                atom.kind = AtomKind::Class;
+            }
+            else if (lead == '#')
+            {
+                atom.kind = AtomKind::Id;
+            }
+            else if (lead == ':')
+            {
+                if (name == "first-child")
+                    atom.kind = AtomKind::FirstChild;
+                else if (name == "last-child")
+                    atom.kind = AtomKind::LastChild;
+                else if (name == "only-child")
+                    atom.kind = AtomKind::OnlyChild;
+                else if (name == "first-of-type")
+                    atom.kind = AtomKind::FirstOfType;
+                else if (name == "empty")
+                    atom.kind = AtomKind::Empty;
+                else
+                {
+                    parsed.error = "编译期选择器不支持该伪类，请使用 CssSelectorMatcher";
+                    return;
+                }
+            }
+            if (compound.atomCount == MAX_ATOMS)
+            {
+                parsed.error = "复合选择器中的原子过多";
+                return;
+            }
+            compound.atoms[compound.atomCount++] = atom;
+        }
+    }
+
+    // 与 compileSelector(const std::string &) 相同的切分规则：组合符两侧的空格被忽略
+    constexpr Parsed parse(std::string_view text)
+    {
+        Parsed parsed;
+        Complex current;
+        SelectorType pending = SelectorType::Simple;
+        size_t pos = 0;
+
+        auto finish = [&]()
+        {
+            if (current.partCount > 0)
+            {
+                if (parsed.alternativeCount == MAX_ALTERNATIVES)
+                {
+                    parsed.error = "逗号分隔的选择器过多";
+                    return;
+                }
+                parsed.alternatives[parsed.alternativeCount++] = current;
+            }
+            current = Complex();
+            pending = SelectorType::Simple;
+        };
+
+        while (pos < text.size() && !parsed.error)
+        {
+            char ch = text[pos];
+            if (ch == ',')
+            {
+                finish();
+                ++pos;
+            }
+            else if (ch == ' ')
+            {
+                if (current.partCount > 0 && pending == SelectorType::Simple)
+                {
+                    pending = SelectorType::Descendant;
+                }
+                ++pos;
+            }
+            else if (ch == '>' || ch == '+' || ch == '~')
+            {
+                pending = ch == '>' ? SelectorType::Child : ch == '+' ? SelectorType::Adjacent
+                                                                      : SelectorType::General;
+                ++pos;
+            }
+            else
+            {
+                size_t end = pos;
+                while (end < text.size() && !isCombinator(text[end]))
+                {
+                    if (text[end] == '(' || text[end] == '[')
+                    {
+                        parsed.error = "编译期选择器不支持带参数的伪类和属性选择器，请使用 CssSelectorMatcher";
+                        return parsed;
+                    }
+                    ++end;
+                }
+                if (current.partCount == MAX_PARTS)
+                {
+                    parsed.error = "选择器层级过多";
+                    return parsed;
+                }
+                Compound &compound = current.parts[current.partCount++];
+                compound.combinator = current.partCount == 1 ? SelectorType::Simple : pending;
+                parseCompound(text.substr(pos, end - pos), compound, parsed);
+                // 原子偏移相对整个选择器
+                for (size_t i = 0; i < compound.atomCount; ++i)
+                {
+                    compound.atoms[i].offset += pos;
+                }
+                pending = SelectorType::Simple;
+                pos = end;
+            }
+        }
+        if (!parsed.error)
+        {
+            finish();
+        }
+        if (!parsed.error && parsed.alternativeCount == 0)
+        {
+            parsed.error = "空选择器";
+        }
+        return parsed;
+    }
+}
+
+template <FixedString Text>
+class StaticSelector
+{
+private:
+    static constexpr staticselector::Parsed parsed = staticselector::parse(Text.view());
+    static_assert(parsed.error == nullptr, "选择器无法在编译期解析");
+
+    template <size_t Alt, size_t Part, size_t AtomIndex>
+    static bool matchAtom(const Element *element)
+    {
+        constexpr staticselector::Atom atom = parsed.alternatives[Alt].parts[Part].atoms[AtomIndex];
+        constexpr std::string_view name = Text.view().substr(atom.offset, atom.length);
+        using staticselector::AtomKind;
+        if constexpr (atom.kind == AtomKind::Tag)
+        {
+            static constexpr std::array<char, name.size()> tag = staticselector::lowercase<name.size()>(name);
+            return element->tagName.size() == tag.size() && std::string_view(element->tagName) == std::string_view(tag.data(), tag.size());
+        }
+        else if constexpr (atom.kind == AtomKind::Class)
+        {
+            return element->hasClass(name);
+        }
+        else if constexpr (atom.kind == AtomKind::Id)
+        {
+            return element->id == name;
+        }
+        else if constexpr (atom.kind == AtomKind::FirstChild)
+        {
+            return element->parentElement && element->siblingIndex == 0;
+        }
+        else if constexpr (atom.kind == AtomKind::LastChild)
+        {
+            return element->parentElement && element->siblingIndex + 1 == element->parentElement->childElementCount;
+        }
+        else if constexpr (atom.kind == AtomKind::OnlyChild)
+        {
+            return element->parentElement && element->parentElement->childElementCount == 1;
+        }
+        else if constexpr (atom.kind == AtomKind::FirstOfType)
+        {
+            return element->parentElement && element->typeIndex == 0;
+        }
+        else
+        {
+            return element->children.empty();
+        }
+    }
+
+    // 只有 * 的复合选择器没有原子，element 不被使用
+    template <size_t Alt, size_t Part, size_t... AtomIndex>
+    static bool matchCompound([[maybe_unused]] const Element *element, std::index_sequence<AtomIndex...>)
+    {
+        return (matchAtom<Alt, Part, AtomIndex>(element) && ...);
+    }
+
+    template <size_t Alt, size_t Part>
+    static bool matchCompound(const Element *element)
+    {
+        return matchCompound<Alt, Part>(element, std::make_index_sequence<parsed.alternatives[Alt].parts[Part].atomCount>());
+    }
+
+    // parts[Part] 已与 element 匹配，按组合符继续向左匹配
+    template <size_t Alt, size_t Part>
+    static bool matchLeft(const Element *element)
+    {
+        if constexpr (Part == 0)
+        {
+            return true;
+        }
+        else
+        {
+            constexpr SelectorType combinator = parsed.alternatives[Alt].parts[Part].combinator;
+            if constexpr (combinator == SelectorType::Child)
+            {
+                const Element *parent = element->parentElement;
+                return parent && matchCompound<Alt, Part - 1>(parent) && matchLeft<Alt, Part - 1>(parent);
+            }
+            else if constexpr (combinator == SelectorType::Descendant)
+            {
+                for (const Element *ancestor = element->parentElement; ancestor; ancestor = ancestor->parentElement)
+                {
+                    if (matchCompound<Alt, Part - 1>(ancestor) && matchLeft<Alt, Part - 1>(ancestor))
+                    {
+                        return true;
+                    }
+                }
+                return false;
+            }
+            else if constexpr (combinator == SelectorType::Adjacent)
+            {
+                const Element *sibling = element->previousElementSibling;
+                return sibling && matchCompound<Alt, Part - 1>(sibling) && matchLeft<Alt, Part - 1>(sibling);
+            }
+            else
+            {
+                for (const Element *sibling = element->previousElementSibling; sibling; sibling = sibling->previousElementSibling)
+                {
+                    if (matchCompound<Alt, Part - 1>(sibling) && matchLeft<Alt, Part - 1>(sibling))
+                    {
+                        return true;
+                    }
+                }
+                return false;
+            }
+        }
+    }
+
+    template <size_t Alt>
+    static bool matchAlternative(const Element *element)
+    {
+        constexpr size_t last = parsed.alternatives[Alt].partCount - 1;
+        return matchCompound<Alt, last>(element) && matchLeft<Alt, last>(element);
+    }
+
+    template <size_t... Alt>
+    static bool matchAny(const Element *element, std::index_sequence<Alt...>)
+    {
+        return (matchAlternative<Alt>(element) || ...);
+    }
+
+    static void collect(Element *element, std::vector<std::shared_ptr<Element>> &results)
+    {
+        for (Element *child = element->firstElementChild; child; child = child->nextElementSibling)
+        {
+            if (matches(child))
+            {
+                results.push_back(child->shared_from_this());
+            }
+            collect(child, results);
+        }
+    }
+
+public:
+    static bool matches(const Element *element)
+    {
+        return matchAny(element, std::make_index_sequence<parsed.alternativeCount>());
+    }
+
+    // 返回 root 的所有后代中匹配的元素，按文档顺序排列
+    static std::vector<std::shared_ptr<Element>> match(const std::shared_ptr<Element> &root)
+    {
+        std::vector<std::shared_ptr<Element>> results;
+        collect(root.get(), results);
+        return results;
+    }
+};
+
+template <FixedString Text>
+constexpr StaticSelector<Text> compileSelector()
+{
+    return StaticSelector<Text>();
+}
+
+#endif
+
+#endif
@@ -0,0 +1,177 @@
+#ifndef TAGS_CPP
+#define TAGS_CPP
+
+#include <string_view>
+#include <cstdint>
+
+// 标签分类，可以按位组合
+enum TagCategory : uint8_t
+{
+    TagNone = 0,
+    TagVoid = 1,       // 没有内容和结束标签，如 <br>、<img>
+    TagRawText = 2,    // 内容按原始文本处理直到对应的结束标签，如 <script>、<style>、<textarea>
+    TagImpliedEnd = 4, // 遇到同类开始标签或父元素结束时可省略结束标签，如 <p>、<li>
+    TagFormatting = 8, // 格式化元素，错误嵌套时需要重建，如 <b>、<a>
+};
+
+// 按长度和首字母分派后比较整个名字，每个标签最多比较一两次；标签名应为小写
+constexpr uint8_t classifyTag(std::string_view tag)
+{
+    switch (tag.size())
+    {
+    case 1:
+        switch (tag[0])
+        {
+        case 'p':
+            return TagImpliedEnd;
+        case 'a':
+        case 'b':
+        case 'i':
+        case 's':
+        case 'u':
+            return TagFormatting;
+        }
+        return TagNone;
+    case 2:
+        switch (tag[0])
+        {
+        case 'b':
+            return tag == "br" ? TagVoid : TagNone;
+        case 'h':
+            return tag == "hr" ? TagVoid : TagNone;
+        case 'l':
+            return tag == "li" ? TagImpliedEnd : TagNone;
+        case 'd':
+            return tag == "dd" || tag == "dt" ? TagImpliedEnd : TagNone;
+        case 'r':
+            return tag == "rb" || tag == "rp" || tag == "rt" ? TagImpliedEnd : TagNone;
+        case 'e':
+            return tag == "em" ? TagFormatting : TagNone;
+        case 't':
+            // td/th/tr 的结束标签也可以省略
+            return tag == "tt" ? TagFormatting : tag == "td" || tag == "th" || tag == "tr" ? TagImpliedEnd : TagNone;
+        }
+        return TagNone;
+    case 3:
+        switch (tag[0])
+        {
+        case 'c':
+            return tag == "col" ? TagVoid : TagNone;
+        case 'i':
+            return tag == "img" ? TagVoid : TagNone;
+        case 'w':
+            return tag == "wbr" ? TagVoid : TagNone;
+        case 'x':
+            return tag == "xmp" ? TagRawText : TagNone;
+        case 'r':
+            return tag == "rtc" ? TagImpliedEnd : TagNone;
+        case 'b':
+            return tag == "big" ? TagFormatting : TagNone;
+        }
+        return TagNone;
+    case 4:
+        switch (tag[0])
+        {
+        case 'a':
+            return tag == "area" ? TagVoid : TagNone;
+        case 'b':
+            return tag == "base" ? TagVoid : TagNone;
+        case 'l':
+            return tag == "link" ? TagVoid : TagNone;
+        case 'm':
+            return tag == "meta" ? TagVoid : TagNone;
+        case 'c':
+            return tag == "code" ? TagFormatting : TagNone;
+        case 'f':
+            return tag == "font" ? TagFormatting : TagNone;
+        case 'n':
+            return tag == "nobr" ? TagFormatting : TagNone;
+        }
+        return TagNone;
+    case 5:
+        switch (tag[0])
+        {
+        case 'e':
+            return tag == "embed" ? TagVoid : TagNone;
+        case 'i':
+            return tag == "input" ? TagVoid : TagNone;
+        case 'p':
+            return tag == "param" ? TagVoid : TagNone;
+        case 't':
+            return tag == "track" ? TagVoid : tag == "title" ? TagRawText
+                                          : tag == "tbody" || tag == "thead" || tag == "tfoot" ? TagImpliedEnd
+                                                                                            : TagNone;
+        case 'f':
+            return tag == "frame" ? TagVoid : TagNone;
+        case 's':
+            return tag == "style" ? TagRawText : tag == "small" ? TagFormatting
+                                                                : TagNone;
+        }
+        return TagNone;
+    case 6:
+        switch (tag[0])
+        {
+        case 'k':
+            return tag == "keygen" ? TagVoid : TagNone;
+        case 's':
+            return tag == "source" ? TagVoid : tag == "script" ? TagRawText
+                                           : tag == "strike" || tag == "strong" ? TagFormatting
+                                                                                : TagNone;
+        case 'i':
+            return tag == "iframe" ? TagRawText : TagNone;
+        case 'o':
+            return tag == "option" ? TagImpliedEnd : TagNone;
+        }
+        return TagNone;
+    case 7:
+        switch (tag[0])
+        {
+        case 'c':
+            return tag == "command" ? TagVoid : TagNone;
+        case 'i':
+            return tag == "isindex" ? TagVoid : TagNone;
+        case 'n':
+            return tag == "noembed" ? TagRawText : TagNone;
+        }
+        return TagNone;
+    case 8:
+        switch (tag[0])
+        {
+        case 'b':
+            return tag == "basefont" ? TagVoid : TagNone;
+        case 't':
+            return tag == "textarea" ? TagRawText : TagNone;
+        case 'n':
+            return tag == "noframes" ? TagRawText : TagNone;
+        case 'o':
+            return tag == "optgroup" ? TagImpliedEnd : TagNone;
+        }
+        return TagNone;
+    }
+    return TagNone;
+}
+
+constexpr bool isVoidTag(std::string_view tag)
+{
+    return (classifyTag(tag) & TagVoid) != 0;
+}
+
+constexpr bool isRawTextTag(std::string_view tag)
+{
+    return (classifyTag(tag) & TagRawText) != 0;
+}
+
+constexpr bool isImpliedEndTag(std::string_view tag)
+{
+    return (classifyTag(tag) & TagImpliedEnd) != 0;
+}
+
+constexpr bool isFormattingTag(std::string_view tag)
+{
+    return (classifyTag(tag) & TagFormatting) != 0;
+}
+
+static_assert(isVoidTag("br") && isVoidTag("basefont") && !isVoidTag("b"), "标签分类错误");
+static_assert(isRawTextTag("script") && isImpliedEndTag("li") && isFormattingTag("strong"), "标签分类错误");
+
+#endif
@@ -0,0 +1,230 @@
+#ifndef TEXT_CPP
+#define TEXT_CPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include "entities.cpp"
+
+namespace whitespace
+{
+    inline bool isSpace(char ch)
+    {
+        return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r' || ch == '\f' || ch == '\v';
+    }
+
+    // 8 个字节中是否有小于 n 的字节（n <= 128）
+    inline bool hasByteLess(uint64_t word, uint8_t n)
+    {
+        return ((word - 0x0101010101010101ULL * n) & ~word & 0x8080808080808080ULL) != 0;
+    }
+
+    // 8 个字节中是否有等于 ch 的字节
+    inline bool hasByte(uint64_t word, uint8_t ch)
+    {
+        return hasByteLess(word ^ (0x0101010101010101ULL * ch), 1);
+    }
+
+    // 原始文本是否需要规范化（合并空白、去掉首尾空白、解码字符引用）。
+    // 正文中的大部分文本是由单个空格分隔的词，每次检查 8 个字节，只有含控制字符、空格或 '&' 的字才逐字节检查
+    inline bool needsNormalization(std::string_view raw)
+    {
+        if (raw.empty())
+        {
+            return false;
+        }
+        if (isSpace(raw.front()) || isSpace(raw.back()))
+        {
+            return true;
+        }
+        const char *data = raw.data();
+        size_t size = raw.size();
+        size_t at = 0;
+        bool prevSpace = false;
+        while (at < size)
+        {
+            if (at + 8 <= size)
+            {
+                uint64_t word;
+                std::memcpy(&word, data + at, 8);
+                if (!hasByteLess(word, 0x21) && !hasByte(word, '&'))
+                {
+                    prevSpace = false;
+                    at += 8;
+                    continue;
+                }
+            }
+            size_t end = std::min(size, at + 8);
+            for (; at < end; ++at)
+            {
+                char ch = data[at];
+                if (ch == '&' || (isSpace(ch) && (ch != ' ' || prevSpace)))
+                {
+                    return true;
+                }
+                prevSpace = ch == ' ';
+            }
+        }
+        return false;
+    }
+
+    // 去掉首尾空白、把连续空白合并为一个空格，然后解码字符引用（&nbsp; 等解码出的空白得以保留）
+    inline std::string normalize(std::string_view raw)
+    {
+        std::string result;
+        result.reserve(raw.size());
+        bool prevSpace = true;
+        for (char c : raw)
+        {
+            if (isSpace(c))
+            {
+                if (!prevSpace)
+                {
+                    result += ' ';
+                    prevSpace = true;
+                }
+            }
+            else
+            {
+                result += c;
+                prevSpace = false;
+            }
+        }
+        if (!result.empty() && result.back() == ' ')
+        {
+            result.pop_back();
+        }
+        decodeEntitiesInPlace(result);
+        return result;
+    }
+
+    // 规范化之后是否为空（只含空白）
+    inline bool isBlank(std::string_view raw)
+    {
+        for (char ch : raw)
+        {
+            if (!isSpace(ch))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+// 文本表：文档中的所有文本节点按文档顺序拼接，每个文本节点之后跟一个换行。
+// 元素记录其后代文本节点在表中的下标范围 [firstText, lastText)，
+// 于是元素的文本是表中的一段连续切片，长度和哈希由前缀值相减得到，都不需要遍历子树。
+// 解析时只登记原始文本，拼接和规范化推迟到第一次查询时进行（之后追加的文本增量处理）；
+// 查询可以并发进行，登记只在解析时由单个线程进行。
+class TextTable
+{
+public:
+    // 多项式滚动哈希的底数
+    static constexpr uint64_t HASH_BASE = 1099511628211ULL;
+
+private:
+    struct Entry
+    {
+        std::string_view raw; // 指向文档字符串区域中的原始文本
+        bool normalize;       // 是否需要规范化
+    };
+
+    std::vector<Entry> entries;
+    mutable std::mutex buildMutex;
+    mutable std::atomic<size_t> built{0};  // 已拼接的文本节点个数
+    mutable std::string joined;
+    mutable std::vector<size_t> starts{0};       // 第 i 个文本节点在 joined 中的起点，最后一项是 joined 的长度
+    mutable std::vector<uint64_t> prefixHash{0}; // joined 前 starts[i] 个字节的哈希
+
+    static uint64_t power(uint64_t base, size_t exponent)
+    {
+        uint64_t result = 1;
+        for (; exponent; exponent >>= 1, base *= base)
+        {
+            if (exponent & 1)
+            {
+                result *= base;
+            }
+        }
+        return result;
+    }
+
+    void ensureBuilt() const
+    {
+        if (built.load(std::memory_order_acquire) == entries.size())
+        {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(buildMutex);
+        uint64_t hash = prefixHash.back();
+        for (size_t i = built.load(std::memory_order_relaxed); i < entries.size(); ++i)
+        {
+            const Entry &entry = entries[i];
+            std::string normalized = entry.normalize ? whitespace::normalize(entry.raw) : std::string();
+            std::string_view value = entry.normalize ? std::string_view(normalized) : entry.raw;
+            for (char ch : value)
+            {
+                hash = hash * HASH_BASE + static_cast<unsigned char>(ch);
+            }
+            hash = hash * HASH_BASE + '\n';
+            joined.append(value.data(), value.size());
+            joined += '\n';
+            starts.push_back(joined.size());
+            prefixHash.push_back(hash);
+        }
+        built.store(entries.size(), std::memory_order_release);
+    }
+
+public:
+    TextTable() = default;
+    TextTable(const TextTable &) = delete;
+    TextTable &operator=(const TextTable &) = delete;
+
+    // 登记一个文本节点的原始文本（必须在表的生存期内有效），返回它的下标
+    uint32_t append(std::string_view raw, bool normalize)
+    {
+        entries.push_back({raw, normalize});
+        return static_cast<uint32_t>(entries.size() - 1);
+    }
+
+    // 文本节点个数
+    uint32_t count() const
+    {
+        return static_cast<uint32_t>(entries.size());
+    }
+
+    // 下标 [first, last) 的文本节点，每个之后跟一个换行
+    std::string_view slice(uint32_t first, uint32_t last) const
+    {
+        ensureBuilt();
+        return std::string_view(joined).substr(starts[first], starts[last] - starts[first]);
+    }
+
+    // 下标 [first, last) 的文本节点的总长度，不含换行
+    size_t length(uint32_t first, uint32_t last) const
+    {
+        ensureBuilt();
+        return starts[last] - starts[first] - (last - first);
+    }
+
+    // 把长度为 length 的文本的哈希 next 接在哈希 hash 之后，结果等于拼接后文本的哈希
+    static uint64_t concatHash(uint64_t hash, uint64_t next, size_t length)
+    {
+        return hash * power(HASH_BASE, length) + next;
+    }
+
+    // slice(first, last) 的多项式哈希，O(log n)
+    uint64_t hash(uint32_t first, uint32_t last) const
+    {
+        ensureBuilt();
+        return prefixHash[last] - prefixHash[first] * power(HASH_BASE, starts[last] - starts[first]);
+    }
+};
+
+#endif
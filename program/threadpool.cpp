@@ -0,0 +1,347 @@
+#ifndef THREADPOOL_CPP
+#define THREADPOOL_CPP
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// 工作窃取线程池：每个工作线程有自己的任务双端队列。
+// 工作线程从自己队列的尾部取任务（后进先出，缓存友好），空闲时从其他线程队列的头部窃取。
+// 在工作线程内部提交的任务进入该线程自己的队列，外部提交的任务轮流分配给各个队列。
+// 常驻查询服务的请求和其中的并行匹配（FrozenDocument::querySelectorAll(selector, pool)）共享同一个线程池
+// （见 defaultThreadPool），统计通过 STATS 请求报告。
+class ThreadPool
+{
+public:
+    using Task = std::function<void()>;
+
+    // 单个工作线程的统计，通过 stats() 读取
+    struct WorkerStats
+    {
+        uint64_t tasksExecuted = 0;
+        uint64_t steals = 0;          // 从其他线程队列窃取的任务数
+        uint64_t busyNanoseconds = 0; // 执行任务的累计时间
+        double utilization = 0;       // busyNanoseconds / 线程池存活时间
+    };
+
+private:
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        std::thread thread;
+        std::atomic<uint64_t> tasksExecuted{0};
+        std::atomic<uint64_t> steals{0};
+        std::atomic<uint64_t> busyNanoseconds{0};
+    };
+
+    // 当前线程所属的线程池和工作线程编号，外部线程为空
+    struct CurrentWorker
+    {
+        ThreadPool *pool = nullptr;
+        size_t index = 0;
+    };
+    static CurrentWorker &current()
+    {
+        thread_local CurrentWorker worker;
+        return worker;
+    }
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::mutex sleepMutex;
+    std::condition_variable wakeUp;
+    std::condition_variable idle;
+    std::atomic<size_t> queued{0};  // 已提交但尚未取出的任务
+    std::atomic<size_t> pending{0}; // 已提交但尚未执行完的任务
+    std::atomic<size_t> nextQueue{0};
+    std::atomic<bool> stopping{false};
+    std::exception_ptr firstError;
+    std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+    bool popLocal(size_t index, Task &task)
+    {
+        Worker &worker = *workers[index];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if (worker.tasks.empty())
+        {
+            return false;
+        }
+        task = std::move(worker.tasks.back());
+        worker.tasks.pop_back();
+        return true;
+    }
+
+    bool steal(size_t thief, Task &task)
+    {
+        for (size_t offset = 1; offset <= workers.size(); ++offset)
+        {
+            size_t victim = (thief + offset) % workers.size();
+            Worker &worker = *workers[victim];
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            if (!worker.tasks.empty())
+            {
+                task = std::move(worker.tasks.front());
+                worker.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // 执行一个任务；isWorker 为 false 时只窃取，不计入任何工作线程的统计
+    bool runOne(size_t index, bool isWorker)
+    {
+        Task task;
+        bool local = isWorker && popLocal(index, task);
+        if (!local && !steal(index, task))
+        {
+            return false;
+        }
+        --queued;
+        auto begin = std::chrono::steady_clock::now();
+        try
+        {
+            task();
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            if (!firstError)
+            {
+                firstError = std::current_exception();
+            }
+        }
+        if (isWorker)
+        {
+            Worker &worker = *workers[index];
+            auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin);
+            worker.busyNanoseconds += static_cast<uint64_t>(elapsed.count());
+            ++worker.tasksExecuted;
+            if (!local)
+            {
+                ++worker.steals;
+            }
+        }
+        if (--pending == 0)
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            idle.notify_all();
+        }
+        return true;
+    }
+
+    void workerLoop(size_t index)
+    {
+        current() = {this, index};
+        while (true)
+        {
+            if (runOne(index, true))
+            {
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wakeUp.wait(lock, [this]
+                        { return stopping || queued > 0; });
+            if (stopping && queued == 0)
+            {
+                return;
+            }
+        }
+    }
+
+    static void pinToCpu(std::thread &thread, size_t index)
+    {
+#if defined(__linux__)
+        unsigned cpus = std::max(1u, std::thread::hardware_concurrency());
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(index % cpus, &set);
+        pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+#else
+        (void)thread;
+        (void)index;
+#endif
+    }
+
+public:
+    // threadCount 为 0 时使用硬件线程数；pinThreads 为 true 时把第 i 个工作线程绑定到第 i 个 CPU（仅 Linux）
+    explicit ThreadPool(size_t threadCount = 0, bool pinThreads = false)
+    {
+        if (threadCount == 0)
+        {
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+        }
+        for (size_t i = 0; i < threadCount; ++i)
+        {
+            workers.push_back(std::make_unique<Worker>());
+        }
+        for (size_t i = 0; i < threadCount; ++i)
+        {
+            workers[i]->thread = std::thread(&ThreadPool::workerLoop, this, i);
+            if (pinThreads)
+            {
+                pinToCpu(workers[i]->thread, i);
+            }
+        }
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    // 等待已提交的任务全部执行完再退出
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wakeUp.notify_all();
+        for (auto &worker : workers)
+        {
+            worker->thread.join();
+        }
+    }
+
+    size_t size() const
+    {
+        return workers.size();
+    }
+
+    void submit(Task task)
+    {
+        CurrentWorker &self = current();
+        size_t index = self.pool == this ? self.index : nextQueue++ % workers.size();
+        // 先增加计数再入队，任务被取出时计数不会下溢
+        ++pending;
+        ++queued;
+        {
+            std::lock_guard<std::mutex> lock(workers[index]->mutex);
+            workers[index]->tasks.push_back(std::move(task));
+        }
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        wakeUp.notify_one();
+    }
+
+    // 等待所有已提交的任务完成，并重新抛出其中第一个异常。只能在线程池外部调用
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        idle.wait(lock, [this]
+                  { return pending == 0; });
+        if (firstError)
+        {
+            std::exception_ptr error = firstError;
+            firstError = nullptr;
+            std::rethrow_exception(error);
+        }
+    }
+
+    // 把 [0, count) 切成大小为 grain 的块并行执行 body(begin, end)，返回时全部完成。
+    // 调用线程在等待期间也会执行任务，因此可以在任务内部嵌套调用。
+    template <typename Body>
+    void parallelFor(size_t count, size_t grain, Body body)
+    {
+        if (count == 0)
+        {
+            return;
+        }
+        grain = std::max<size_t>(grain, 1);
+        if (count <= grain || workers.size() == 1)
+        {
+            body(size_t(0), count);
+            return;
+        }
+        std::atomic<size_t> remaining{(count + grain - 1) / grain};
+        std::mutex errorMutex;
+        std::exception_ptr error;
+        for (size_t begin = 0; begin < count; begin += grain)
+        {
+            size_t end = std::min(count, begin + grain);
+            submit([&, begin, end]
+                   {
+                try
+                {
+                    body(begin, end);
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock(errorMutex);
+                    if (!error)
+                    {
+                        error = std::current_exception();
+                    }
+                }
+                --remaining; });
+        }
+        CurrentWorker &self = current();
+        bool isWorker = self.pool == this;
+        size_t index = isWorker ? self.index : 0;
+        while (remaining > 0)
+        {
+            if (!runOne(index, isWorker))
+            {
+                std::this_thread::yield();
+            }
+        }
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+    }
+
+    std::vector<WorkerStats> stats() const
+    {
+        double lifetime = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                                  std::chrono::steady_clock::now() - startTime)
+                                                  .count());
+        std::vector<WorkerStats> result;
+        for (const auto &worker : workers)
+        {
+            WorkerStats stats;
+            stats.tasksExecuted = worker->tasksExecuted;
+            stats.steals = worker->steals;
+            stats.busyNanoseconds = worker->busyNanoseconds;
+            stats.utilization = lifetime > 0 ? stats.busyNanoseconds / lifetime : 0;
+            result.push_back(stats);
+        }
+        return result;
+    }
+
+    // 每个工作线程一行：worker=编号 tasks steals busy_ms utilization（百分比）
+    std::string report() const
+    {
+        std::string out;
+        std::vector<WorkerStats> all = stats();
+        for (size_t i = 0; i < all.size(); ++i)
+        {
+            out += "worker=" + std::to_string(i) + " tasks=" + std::to_string(all[i].tasksExecuted) +
+                   " steals=" + std::to_string(all[i].steals) +
+                   " busy_ms=" + std::to_string(all[i].busyNanoseconds / 1000000) +
+                   " utilization=" + std::to_string(static_cast<int>(all[i].utilization * 100 + 0.5)) + "%\n";
+        }
+        return out;
+    }
+};
+
+// 进程共享的线程池，首次使用时按硬件线程数创建
+ThreadPool &defaultThreadPool()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+#endif
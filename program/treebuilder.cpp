@@ -0,0 +1,638 @@
+#ifndef TREEBUILDER_CPP
+#define TREEBUILDER_CPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <initializer_list>
+#include <algorithm>
+#include <iterator>
+#include "element.cpp"
+#include "tags.cpp"
+
+// 容错的树构建器：按浏览器的方式处理现实网页中不规范的标记，而不是在第一个错误处放弃。
+// - 省略的结束标签：<p> 遇到块级元素、<li>/<dd>/<dt>/<option>/<tr>/<td> 遇到同类开始标签时自动关闭。
+// - 错误嵌套：结束标签只在作用域内查找对应的元素（与规范相同，块级元素的结束标签不越过表格和单元格，
+//   其他结束标签不越过块级等特殊元素），找不到时被忽略；找到时关闭它之上的所有元素，
+//   其中被隐式关闭的格式化元素（<b>、<i>、<a> 等）会在随后的文本或行内元素之前重新打开。
+//   格式化元素的结束标签按 adoption agency 算法处理：其中的块级元素被移到格式化元素之后，
+//   块级元素的内容包进格式化元素的副本，如 <b>1<p>2</b>3</p> 得到 <b>1</b><p><b>2</b>3</p>。
+//   与规范一样，单元格（td、th、caption）打开时在待重建列表中放入标记，格式化元素不会越过标记重建，
+//   单元格关闭时丢弃标记之后的部分；表格结构标签之前也不重建，因此格式化元素不会跨单元格或行。
+// - 没有对应开始标签的结束标签被忽略，</p> 插入一个空的 <p>，</br> 按 <br> 处理。
+// 每个标签最多扫描一次打开元素栈（格式化元素的结束标签最多 8 轮），待重建的格式化元素最多保留
+// MAX_PENDING_FORMATTING 个，开销有上界。
+// 标签名应已转为小写。
+// 调用者在每个记号之前通过 setSourcePosition 告知记号在源文本中的范围，元素据此记录 sourceStart/sourceEnd：
+// 被结束标签关闭的元素结束于结束标签之后，被隐式关闭的元素结束于引起关闭的记号之前。
+// 文本节点按文档顺序登记到文档的文本表，元素在打开和关闭时记录文本表的下标范围 firstText/lastText。
+// 每个插入的节点都向文档的 StringArena 登记估计大小；超出节点预算时不再插入新节点。
+class TreeBuilder
+{
+private:
+    static constexpr size_t MAX_PENDING_FORMATTING = 8;
+
+    std::shared_ptr<Element> root;
+    std::vector<Element *> open; // 打开元素栈，open[0] 是根
+    std::vector<const Element *> pendingFormatting; // 被隐式关闭、等待重建的格式化元素，空指针是单元格标记
+    size_t foreignDepth = 0; // 打开的 svg/math 数量，其中的 /> 自闭合有效
+    uint32_t tokenStart = Element::NO_SOURCE; // 当前记号在源文本中的范围
+    uint32_t tokenEnd = Element::NO_SOURCE;
+
+    static bool isOneOf(std::string_view tag, std::initializer_list<std::string_view> names)
+    {
+        for (std::string_view name : names)
+        {
+            if (tag == name)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static bool isForeign(std::string_view tag)
+    {
+        return tag == "svg" || tag == "math";
+    }
+
+    // 这些开始标签会先关闭处于按钮作用域中的 <p>，且不会重建格式化元素
+    static bool closesParagraph(std::string_view tag)
+    {
+        return isOneOf(tag, {"address", "article", "aside", "blockquote", "center", "details", "dialog", "dir",
+                             "div", "dl", "fieldset", "figcaption", "figure", "footer", "form", "h1", "h2", "h3",
+                             "h4", "h5", "h6", "header", "hgroup", "hr", "li", "dd", "dt", "main", "menu", "nav",
+                             "ol", "p", "pre", "section", "summary", "table", "ul", "xmp", "plaintext", "listing"});
+    }
+
+    // 规范中的特殊元素：格式化元素的结束标签把其中最近的一个移出格式化元素，其他结束标签不越过它们
+    static bool isSpecial(std::string_view tag)
+    {
+        return closesParagraph(tag) || isTableStructure(tag) ||
+               isOneOf(tag, {"applet", "body", "button", "frameset", "head", "html", "iframe", "marquee", "noembed",
+                             "noframes", "noscript", "object", "script", "select", "style", "template", "textarea", "title"});
+    }
+
+    // 规范中默认作用域的边界：块级元素的结束标签不越过这些元素
+    static bool isScopeBoundary(std::string_view tag)
+    {
+        return isOneOf(tag, {"applet", "caption", "html", "table", "td", "th", "marquee", "object", "template"});
+    }
+
+    static bool isTableScopeBoundary(std::string_view tag)
+    {
+        return tag == "html" || tag == "table" || tag == "template";
+    }
+
+    // 表格结构标签之前不重建格式化元素
+    static bool isTableStructure(std::string_view tag)
+    {
+        return isOneOf(tag, {"table", "caption", "colgroup", "col", "tbody", "thead", "tfoot", "tr", "td", "th"});
+    }
+
+    // 打开时在待重建列表中放入标记的元素
+    static bool isCell(std::string_view tag)
+    {
+        return tag == "td" || tag == "th" || tag == "caption";
+    }
+
+    static bool isHeading(std::string_view tag)
+    {
+        return tag.size() == 2 && tag[0] == 'h' && tag[1] >= '1' && tag[1] <= '6';
+    }
+
+    // 从栈顶向下查找 names 中的元素，遇到 boundaries 中的元素则停止；找不到返回 0
+    size_t findOpen(std::initializer_list<std::string_view> names, std::initializer_list<std::string_view> boundaries) const
+    {
+        for (size_t i = open.size(); i-- > 1;)
+        {
+            if (isOneOf(open[i]->tagName, names))
+            {
+                return i;
+            }
+            if (isOneOf(open[i]->tagName, boundaries))
+            {
+                return 0;
+            }
+        }
+        return 0;
+    }
+
+    size_t findOpen(std::string_view name) const
+    {
+        for (size_t i = open.size(); i-- > 1;)
+        {
+            if (open[i]->tagName == name)
+            {
+                return i;
+            }
+        }
+        return 0;
+    }
+
+    // 从栈顶向下查找名为 name 的元素，遇到 boundary(标签名) 为真的元素则停止；找不到返回 0
+    template <typename Boundary>
+    size_t findOpen(std::string_view name, Boundary boundary) const
+    {
+        for (size_t i = open.size(); i-- > 1;)
+        {
+            if (open[i]->tagName == name)
+            {
+                return i;
+            }
+            if (boundary(open[i]->tagName))
+            {
+                return 0;
+            }
+        }
+        return 0;
+    }
+
+    uint32_t textCount() const
+    {
+        return root->arena->texts().count();
+    }
+
+    // 节点的估计大小：对象本身、make_shared 的控制块和父节点 children 中的指针
+    template <typename T>
+    static constexpr size_t nodeBytes()
+    {
+        return sizeof(T) + 2 * sizeof(void *) + sizeof(std::shared_ptr<Node>);
+    }
+
+    // 在预算内登记一个节点，超出节点预算时返回 false
+    bool admitElement(const Element &element)
+    {
+        return root->arena->chargeNode(nodeBytes<Element>() + element.attributes.size() * sizeof(Attribute));
+    }
+
+    void pushOpen(Element *element)
+    {
+        element->firstText = textCount();
+        open.push_back(element);
+    }
+
+    // 丢弃最后一个单元格标记及其后的待重建元素
+    void clearToMarker()
+    {
+        auto marker = std::find(pendingFormatting.rbegin(), pendingFormatting.rend(), nullptr);
+        pendingFormatting.erase(marker == pendingFormatting.rend() ? pendingFormatting.begin() : std::prev(marker.base()),
+                                pendingFormatting.end());
+    }
+
+    // 弹出 open[index] 及其上的所有元素；其上被隐式关闭的格式化元素记录下来以便重建。
+    // 被关闭的单元格中的格式化元素不会重建
+    void closeTo(size_t index)
+    {
+        std::vector<const Element *> closed;
+        bool inCell = false;
+        for (size_t i = index; i < open.size(); ++i)
+        {
+            if (isCell(open[i]->tagName))
+            {
+                clearToMarker();
+                inCell = true;
+            }
+            else if (i > index && !inCell && isFormattingTag(open[i]->tagName))
+            {
+                closed.push_back(open[i]);
+            }
+        }
+        pendingFormatting.insert(pendingFormatting.end(), closed.begin(), closed.end());
+        if (pendingFormatting.size() > MAX_PENDING_FORMATTING)
+        {
+            pendingFormatting.erase(pendingFormatting.begin(),
+                                    pendingFormatting.end() - MAX_PENDING_FORMATTING);
+        }
+        for (size_t i = index; i < open.size(); ++i)
+        {
+            if (isForeign(open[i]->tagName))
+            {
+                --foreignDepth;
+            }
+            open[i]->sourceEnd = open[i]->sourceStart == Element::NO_SOURCE ? Element::NO_SOURCE : tokenStart;
+            open[i]->sourceClosed = false;
+            open[i]->lastText = textCount();
+        }
+        open.resize(index);
+    }
+
+    // 由结束标签关闭 open[index]：该元素结束于结束标签之后
+    void closeByEndTag(size_t index)
+    {
+        Element *closing = open[index];
+        closeTo(index);
+        if (closing->sourceStart != Element::NO_SOURCE)
+        {
+            closing->sourceEnd = tokenEnd;
+            closing->sourceClosed = true;
+        }
+    }
+
+    void closeIfCurrent(std::string_view name)
+    {
+        if (open.size() > 1 && open.back()->tagName == name)
+        {
+            closeTo(open.size() - 1);
+        }
+    }
+
+    // 格式化元素的副本（复制标签名和属性），没有源文本范围；超出节点预算时返回空指针
+    std::shared_ptr<Element> cloneFormatting(const Element &original)
+    {
+        if (!admitElement(original))
+        {
+            return nullptr;
+        }
+        auto clone = createElement(original.tagName);
+        clone->arena = root->arena;
+        for (const auto &attribute : original.attributes)
+        {
+            clone->setAttribute(AttributeNames::name(attribute.nameId), attribute.value());
+        }
+        return clone;
+    }
+
+    // 按原来的顺序重新打开最后一个单元格标记之后被隐式关闭的格式化元素
+    void reconstructFormatting()
+    {
+        auto marker = std::find(pendingFormatting.rbegin(), pendingFormatting.rend(), nullptr);
+        auto first = marker.base();
+        std::vector<const Element *> pending(first, pendingFormatting.end());
+        pendingFormatting.erase(first, pendingFormatting.end());
+        for (const Element *original : pending)
+        {
+            auto clone = cloneFormatting(*original);
+            if (!clone)
+            {
+                return;
+            }
+            open.back()->appendChild(clone);
+            pushOpen(clone.get());
+        }
+    }
+
+    // 把元素（可能是还没有插入的副本）移为 parent 的最后一个子节点
+    static void moveTo(Element *parent, const std::shared_ptr<Element> &element)
+    {
+        if (element->parentElement)
+        {
+            element->parentElement->removeChild(element);
+        }
+        parent->appendChild(element);
+    }
+
+    // adoption agency 的一步：open[index] 是格式化元素，open[block] 是其上最近的特殊元素。
+    // 两者之间的格式化元素复制（最多 3 个）并依次嵌套，其他元素只出栈；特殊元素连同这些副本
+    // 移到格式化元素的父元素下，特殊元素原有的内容包进格式化元素的副本，副本取代格式化元素留在栈中。
+    // 文本节点的先后顺序不变，文本表的下标范围仍然连续
+    void adoptOnce(size_t index, size_t block)
+    {
+        Element *formatting = open[index];
+        Element *furthest = open[block];
+        Element *common = open[index - 1];
+        uint32_t cut = furthest->sourceStart;
+        // 格式化元素和中间的元素结束于特殊元素之前
+        auto end = [&](Element *element)
+        {
+            if (isForeign(element->tagName))
+            {
+                --foreignDepth;
+            }
+            element->lastText = furthest->firstText;
+            element->sourceClosed = false;
+            if (cut == Element::NO_SOURCE)
+            {
+                element->sourceStart = Element::NO_SOURCE;
+            }
+            element->sourceEnd = element->sourceStart == Element::NO_SOURCE ? Element::NO_SOURCE : cut;
+        };
+
+        std::shared_ptr<Element> last = furthest->shared_from_this();
+        std::vector<Element *> clones; // 由内向外
+        size_t counter = 0;
+        for (size_t i = block - 1; i > index; --i)
+        {
+            Element *node = open[i];
+            end(node);
+            if (++counter > 3 || !isFormattingTag(node->tagName))
+            {
+                continue;
+            }
+            auto clone = cloneFormatting(*node);
+            if (!clone)
+            {
+                continue;
+            }
+            clone->firstText = furthest->firstText;
+            moveTo(clone.get(), last);
+            last = clone;
+            clones.push_back(clone.get());
+        }
+        end(formatting);
+        moveTo(common, last);
+
+        auto replacement = cloneFormatting(*formatting);
+        std::vector<Element *> rebuilt(open.begin(), open.begin() + static_cast<std::ptrdiff_t>(index));
+        rebuilt.insert(rebuilt.end(), clones.rbegin(), clones.rend());
+        rebuilt.push_back(furthest);
+        if (replacement)
+        {
+            std::vector<std::shared_ptr<Node>> contents = furthest->children;
+            furthest->clearChildren();
+            for (const auto &child : contents)
+            {
+                replacement->appendChild(child);
+            }
+            furthest->appendChild(replacement);
+            replacement->firstText = furthest->firstText;
+            rebuilt.push_back(replacement.get());
+            // 特殊元素的内容多了一层合成的元素，源文本不再对应，改为从树生成
+            furthest->sourceStart = Element::NO_SOURCE;
+            furthest->sourceEnd = Element::NO_SOURCE;
+        }
+        rebuilt.insert(rebuilt.end(), open.begin() + static_cast<std::ptrdiff_t>(block) + 1, open.end());
+        open = std::move(rebuilt);
+    }
+
+    // 格式化元素的结束标签：在默认作用域内找到对应的格式化元素，其上有特殊元素时先做 adoption agency，
+    // 最多 8 轮，之后关闭格式化元素。找不到时返回 false
+    bool adopt(std::string_view tag)
+    {
+        for (int round = 0; round < 8; ++round)
+        {
+            size_t index = findOpen(tag, isScopeBoundary);
+            if (index == 0)
+            {
+                return round > 0;
+            }
+            size_t block = index + 1;
+            while (block < open.size() && !isSpecial(open[block]->tagName))
+            {
+                ++block;
+            }
+            if (block == open.size())
+            {
+                closeByEndTag(index);
+                return true;
+            }
+            adoptOnce(index, block);
+        }
+        return true;
+    }
+
+    void dropPending(std::string_view name)
+    {
+        for (size_t i = pendingFormatting.size(); i-- > 0 && pendingFormatting[i];)
+        {
+            if (pendingFormatting[i]->tagName == name)
+            {
+                pendingFormatting.erase(pendingFormatting.begin() + static_cast<std::ptrdiff_t>(i));
+                return;
+            }
+        }
+    }
+
+    // 新开始标签隐含的结束标签
+    void closeImplied(std::string_view tag)
+    {
+        if (closesParagraph(tag))
+        {
+            if (size_t p = findOpen({"p"}, {"button", "table", "td", "th", "caption", "marquee", "object", "applet", "template", "html"}))
+            {
+                closeTo(p);
+            }
+        }
+        if (tag == "li")
+        {
+            if (size_t li = findOpen({"li"}, {"ul", "ol", "table", "td", "th"}))
+            {
+                closeTo(li);
+            }
+        }
+        else if (tag == "dd" || tag == "dt")
+        {
+            if (size_t item = findOpen({"dd", "dt"}, {"dl", "table", "td", "th"}))
+            {
+                closeTo(item);
+            }
+        }
+        else if (tag == "option")
+        {
+            closeIfCurrent("option");
+        }
+        else if (tag == "optgroup")
+        {
+            closeIfCurrent("option");
+            closeIfCurrent("optgroup");
+        }
+        else if (tag == "tr")
+        {
+            if (size_t row = findOpen({"tr"}, {"table", "tbody", "thead", "tfoot"}))
+            {
+                closeTo(row);
+            }
+        }
+        else if (tag == "td" || tag == "th")
+        {
+            if (size_t cell = findOpen({"td", "th"}, {"tr", "table"}))
+            {
+                closeTo(cell);
+            }
+        }
+        else if (tag == "tbody" || tag == "thead" || tag == "tfoot")
+        {
+            if (size_t section = findOpen({"tbody", "thead", "tfoot"}, {"table"}))
+            {
+                closeTo(section);
+            }
+        }
+        else if (isHeading(tag) && isHeading(open.back()->tagName))
+        {
+            closeTo(open.size() - 1);
+        }
+        else if (tag == "a")
+        {
+            // <a> 不能嵌套，先关闭仍然打开的 <a>
+            if (findOpen({"a"}, {"table", "td", "th"}))
+            {
+                adopt("a");
+                dropPending("a");
+            }
+        }
+    }
+
+public:
+    explicit TreeBuilder(const std::shared_ptr<Element> &rootElement) : root(rootElement)
+    {
+        if (!root->arena)
+        {
+            root->arena = std::make_shared<StringArena>();
+        }
+        // 已有内容的根节点（向同一文档追加解析）不记录文本范围
+        root->firstText = root->children.empty() ? textCount() : Element::NO_SOURCE;
+        open.push_back(root.get());
+    }
+
+    const std::shared_ptr<Element> &getRoot() const
+    {
+        return root;
+    }
+
+    // 下一个记号在源文本中的范围 [start, end)；超出 32 位的位置不记录
+    void setSourcePosition(size_t start, size_t end)
+    {
+        bool fits = end < Element::NO_SOURCE;
+        tokenStart = fits ? static_cast<uint32_t>(start) : Element::NO_SOURCE;
+        tokenEnd = fits ? static_cast<uint32_t>(end) : Element::NO_SOURCE;
+    }
+
+    // 插入开始标签对应的元素，元素的属性应已设置好
+    void startTag(const std::shared_ptr<Element> &element, bool selfClosing)
+    {
+        const std::string &tag = element->tagName;
+        // 重复的 html/head/body 开始标签被忽略
+        if ((tag == "html" || tag == "head" || tag == "body") && findOpen(tag))
+        {
+            return;
+        }
+        if (!admitElement(*element))
+        {
+            return;
+        }
+        closeImplied(tag);
+        if (!closesParagraph(tag) && !isTableStructure(tag))
+        {
+            reconstructFormatting();
+        }
+        open.back()->appendChild(element);
+        element->sourceStart = tokenStart;
+        if (isVoidTag(tag) || (selfClosing && foreignDepth > 0))
+        {
+            element->sourceEnd = tokenEnd;
+            element->sourceClosed = true;
+            element->firstText = element->lastText = textCount();
+            return;
+        }
+        if (isForeign(tag))
+        {
+            ++foreignDepth;
+        }
+        if (isCell(tag))
+        {
+            pendingFormatting.push_back(nullptr);
+        }
+        pushOpen(element.get());
+    }
+
+    void endTag(std::string_view tag)
+    {
+        if (tag == "br")
+        {
+            auto br = createElement("br");
+            br->arena = root->arena;
+            startTag(br, false);
+            // 由 </br> 合成的元素没有对应的源文本
+            br->sourceStart = Element::NO_SOURCE;
+            br->sourceEnd = Element::NO_SOURCE;
+            return;
+        }
+        if (isVoidTag(tag))
+        {
+            return;
+        }
+        if (isFormattingTag(tag))
+        {
+            if (!adopt(tag))
+            {
+                dropPending(tag);
+            }
+            return;
+        }
+        size_t index = 0;
+        if (tag == "p")
+        {
+            index = findOpen({"p"}, {"button", "table", "td", "th", "caption", "marquee", "object", "applet", "template", "html"});
+        }
+        else if (tag == "li")
+        {
+            index = findOpen(tag, [](std::string_view name)
+                             { return isScopeBoundary(name) || name == "ol" || name == "ul"; });
+        }
+        else if (isTableStructure(tag))
+        {
+            index = findOpen(tag, isTableScopeBoundary);
+        }
+        else if (isSpecial(tag))
+        {
+            index = findOpen(tag, isScopeBoundary);
+        }
+        else
+        {
+            // 其他元素（span、自定义元素等）的结束标签不越过特殊元素
+            index = findOpen(tag, isSpecial);
+        }
+        if (index == 0)
+        {
+            if (tag == "p")
+            {
+                // 没有打开的 <p> 时 </p> 产生一个空段落
+                if (root->arena->chargeNode(nodeBytes<Element>()))
+                {
+                    auto paragraph = createElement("p");
+                    paragraph->arena = root->arena;
+                    open.back()->appendChild(paragraph);
+                    paragraph->firstText = paragraph->lastText = textCount();
+                }
+            }
+            else
+            {
+                dropPending(tag);
+            }
+            return;
+        }
+        closeByEndTag(index);
+    }
+
+    // 插入文本节点；raw 是文档字符串区域中的原始文本，normalize 表示读取时需要合并空白和解码
+    void text(std::string_view raw, bool normalize)
+    {
+        if (raw.empty())
+        {
+            return;
+        }
+        reconstructFormatting();
+        if (!root->arena->chargeNode(nodeBytes<Text>() + sizeof(std::string_view) + sizeof(size_t)))
+        {
+            return;
+        }
+        root->arena->texts().append(raw, normalize);
+        auto node = std::make_shared<Text>();
+        node->setRawValue(raw, normalize);
+        open.back()->appendChild(node);
+    }
+
+    // 当前插入位置的元素
+    const Element *currentElement() const
+    {
+        return open.back();
+    }
+
+    // 文档结束：仍然打开的元素都视为在此处隐式关闭
+    void finish()
+    {
+        if (open.size() > 1)
+        {
+            closeTo(1);
+        }
+        if (root->firstText != Element::NO_SOURCE)
+        {
+            root->lastText = textCount();
+        }
+        pendingFormatting.clear();
+        foreignDepth = 0;
+    }
+};
+
+#endif